@@ -0,0 +1,160 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Host stand-in for the parts of the Mira API used by the message modules, so
+ * that host tests build them without MiraOS. Functions are defined by each
+ * test. Not a replacement for mira.h on target. */
+
+#ifndef MIRA_H
+#define MIRA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t clock_time_t;
+#define CLOCK_SECOND (1000)
+clock_time_t clock_time(void);
+
+typedef enum
+{
+    MIRA_SUCCESS = 0,
+    MIRA_ERROR_NO_MEMORY,
+    MIRA_ERROR,
+} mira_status_t;
+
+typedef struct
+{
+    uint8_t u8[16];
+} mira_net_address_t;
+
+#define MIRA_NET_MAX_ADDRESS_STR_LEN (40)
+
+typedef enum
+{
+    MIRA_NET_STATE_NOT_ASSOCIATED,
+    MIRA_NET_STATE_ASSOCIATED,
+    MIRA_NET_STATE_JOINED,
+    MIRA_NET_STATE_IS_COORDINATOR,
+} mira_net_state_t;
+
+mira_net_state_t mira_net_get_state(void);
+
+typedef struct mira_net_udp_connection mira_net_udp_connection_t;
+
+typedef struct
+{
+    const mira_net_address_t* source_address;
+    uint16_t source_port;
+    const mira_net_address_t* destination_address;
+    uint16_t destination_port;
+} mira_net_udp_callback_metadata_t;
+
+mira_status_t mira_net_udp_send_to(mira_net_udp_connection_t* connection,
+                                   const mira_net_address_t* addr,
+                                   uint16_t port,
+                                   const void* data,
+                                   uint16_t data_len);
+
+const char* mira_net_toolkit_format_address(char* buffer, const mira_net_address_t* addr);
+
+/* Processes, as protothreads */
+typedef unsigned short lc_t;
+struct pt
+{
+    lc_t lc;
+};
+typedef unsigned char process_event_t;
+typedef void* process_data_t;
+
+#define PT_WAITING (0)
+#define PT_YIELDED (1)
+#define PT_EXITED (2)
+#define PT_ENDED (3)
+#define PT_THREAD(name_args) char name_args
+#define PT_BEGIN(pt)            \
+    {                           \
+        char PT_YIELD_FLAG = 1; \
+        if (PT_YIELD_FLAG) {    \
+            ;                   \
+        }                       \
+        switch ((pt)->lc) {     \
+            case 0:
+#define PT_END(pt)     \
+    }                  \
+    PT_YIELD_FLAG = 0; \
+    (pt)->lc = 0;      \
+    return PT_ENDED;   \
+    }
+#define PT_YIELD_UNTIL(pt, cond)                   \
+    do {                                           \
+        PT_YIELD_FLAG = 0;                         \
+        (pt)->lc = __LINE__;                       \
+        case __LINE__:                             \
+            if ((PT_YIELD_FLAG == 0) || !(cond)) { \
+                return PT_YIELDED;                 \
+            }                                      \
+    } while (0)
+#define PT_YIELD(pt) PT_YIELD_UNTIL(pt, 1)
+
+struct process
+{
+    struct process* next;
+    const char* name;
+    PT_THREAD((*thread)(struct pt*, process_event_t, process_data_t));
+    struct pt pt;
+    unsigned char state, needspoll;
+};
+
+#define PROCESS_THREAD(name, ev, data)                            \
+    static PT_THREAD(process_thread_##name(struct pt* process_pt, \
+                                           process_event_t ev,    \
+                                           process_data_t data))
+#define PROCESS_NAME(name) extern struct process name
+#define PROCESS(name, strname)                                                  \
+    PROCESS_THREAD(name, ev, data);                                             \
+    struct process name = { NULL, strname, process_thread_##name, { 0 }, 0, 0 }
+#define PROCESS_BEGIN() PT_BEGIN(process_pt)
+#define PROCESS_END() PT_END(process_pt)
+#define PROCESS_YIELD() PT_YIELD(process_pt)
+#define PROCESS_YIELD_UNTIL(cond) PT_YIELD_UNTIL(process_pt, cond)
+#define PROCESS_WAIT_EVENT() PROCESS_YIELD()
+#define PROCESS_WAIT_EVENT_UNTIL(cond) PROCESS_YIELD_UNTIL(cond)
+
+#define PROCESS_BROADCAST (NULL)
+#define PROCESS_ERR_OK (0)
+#define PROCESS_EVENT_POLL (0x82)
+#define PROCESS_EVENT_TIMER (0x88)
+
+process_event_t process_alloc_event(void);
+int process_post(struct process* p, process_event_t ev, process_data_t data);
+void process_poll(struct process* p);
+void process_start(struct process* p, process_data_t data);
+void process_exit(struct process* p);
+int process_is_running(struct process* p);
+
+#endif
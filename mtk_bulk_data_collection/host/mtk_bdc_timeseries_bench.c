@@ -0,0 +1,203 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Host benchmark of module mtk_bdc_timeseries: compression ratio and encode
+ * time per sample on synthetic sensor data, against the generic compressor of
+ * module mtk_bdc_compress. See README.md for building and running it. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_CYCLES 1
+#else
+#define BENCH_HAS_CYCLES 0
+#endif
+
+#include "mtk_bdc_compress.h"
+#include "mtk_bdc_timeseries.h"
+
+/* MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES, not included here since
+ * mtk_bulk_data_collection.h needs mira.h */
+#define BLOCK_SIZE (330)
+
+#define MAX_SAMPLES (4000)
+#define N_CHANNELS (4)
+#define N_RUNS (100)
+
+/* Timestamp and channels, in little endian */
+#define RAW_SAMPLE_BYTES (sizeof(uint32_t) + N_CHANNELS * sizeof(int16_t))
+
+static mtk_bdcts_sample_t samples[MAX_SAMPLES];
+static mtk_bdcts_sample_t decoded[MAX_SAMPLES];
+static uint8_t encoded[MAX_SAMPLES * RAW_SAMPLE_BYTES];
+static uint8_t raw[MAX_SAMPLES * RAW_SAMPLE_BYTES];
+static uint8_t compressed[BLOCK_SIZE];
+
+static uint32_t lcg_state = 1;
+
+/* Deterministic, for results to be reproducible */
+static int32_t noise_get(int32_t amplitude)
+{
+    lcg_state = lcg_state * 1103515245u + 12345u;
+    if (amplitude == 0) {
+        return 0;
+    }
+    return (int32_t)((lcg_state >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+/* Samples every second, in ms, with some jitter. Channels are slow ramps and
+ * oscillations, such as temperatures and humidity, plus noise. */
+static void samples_generate(uint16_t n_samples, int32_t noise)
+{
+    uint32_t timestamp = 1700000000u;
+
+    for (uint16_t i = 0; i < n_samples; ++i) {
+        timestamp += 1000 + noise_get(2);
+        samples[i].timestamp = timestamp;
+        samples[i].channels[0] = (int16_t)(2150 + i / 20 + noise_get(noise));
+        samples[i].channels[1] = (int16_t)(4500 + ((i / 50) % 2 ? 30 : -30) + noise_get(noise));
+        samples[i].channels[2] = (int16_t)(-1200 + (i % 200) + noise_get(noise));
+        samples[i].channels[3] = (int16_t)(noise_get(noise) * 4);
+    }
+}
+
+static uint16_t raw_pack(uint16_t n_samples)
+{
+    uint8_t* buffer = raw;
+
+    for (uint16_t i = 0; i < n_samples; ++i) {
+        for (int b = 0; b < 4; ++b) {
+            *buffer++ = (samples[i].timestamp >> (8 * b)) & 0xff;
+        }
+        for (int c = 0; c < N_CHANNELS; ++c) {
+            uint16_t v = (uint16_t)samples[i].channels[c];
+            *buffer++ = v & 0xff;
+            *buffer++ = v >> 8;
+        }
+    }
+
+    return buffer - raw;
+}
+
+/* Generic compressor on the raw samples, block by block as sub-packets are,
+ * blocks that don't compress being sent as is. */
+static uint32_t generic_len_get(uint16_t raw_len)
+{
+    uint32_t total = 0;
+
+    for (uint16_t offset = 0; offset < raw_len; offset += BLOCK_SIZE) {
+        uint16_t len = (raw_len - offset < BLOCK_SIZE) ? raw_len - offset : BLOCK_SIZE;
+        int ret = mtk_bdccmp_compress(compressed, len - 1, raw + offset, len);
+        total += (ret < 0) ? len : (uint32_t)ret;
+    }
+
+    return total;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    uint16_t n_samples = (argc > 1) ? (uint16_t)atoi(argv[1]) : 2000;
+    int32_t noise = (argc > 2) ? atoi(argv[2]) : 3;
+    int len = 0;
+
+    if (n_samples == 0 || n_samples > MAX_SAMPLES) {
+        fprintf(stderr, "usage: %s [n_samples (1-%d)] [noise amplitude]\n", argv[0], MAX_SAMPLES);
+        return 1;
+    }
+
+    samples_generate(n_samples, noise);
+    uint16_t raw_len = raw_pack(n_samples);
+
+#if BENCH_HAS_CYCLES
+    uint64_t cycles = 0;
+#endif
+    double ns = 0;
+    for (int run = 0; run < N_RUNS; ++run) {
+        double start_ns = now_ns();
+#if BENCH_HAS_CYCLES
+        uint64_t start = __rdtsc();
+#endif
+        len = mtk_bdcts_encode(
+          encoded, sizeof(encoded), BLOCK_SIZE, samples, n_samples, N_CHANNELS);
+#if BENCH_HAS_CYCLES
+        cycles += __rdtsc() - start;
+#endif
+        ns += now_ns() - start_ns;
+    }
+    if (len < 0) {
+        fprintf(stderr, "mtk_bdcts_encode failed\n");
+        return 1;
+    }
+
+    int n_decoded = mtk_bdcts_decode(decoded, MAX_SAMPLES, BLOCK_SIZE, encoded, len);
+    if (n_decoded != n_samples) {
+        fprintf(stderr, "mtk_bdcts_decode: %d samples of %d\n", n_decoded, n_samples);
+        return 1;
+    }
+    for (uint16_t i = 0; i < n_samples; ++i) {
+        if (decoded[i].timestamp != samples[i].timestamp ||
+            memcmp(decoded[i].channels, samples[i].channels, N_CHANNELS * sizeof(int16_t)) != 0) {
+            fprintf(stderr, "sample %d decoded differently\n", i);
+            return 1;
+        }
+    }
+
+    uint32_t generic_len = generic_len_get(raw_len);
+
+    printf("samples:            %d, %d channels, noise +/-%d\n", n_samples, N_CHANNELS, noise);
+    printf("raw:                %d bytes (%u per sample)\n", raw_len, (unsigned)RAW_SAMPLE_BYTES);
+    printf("mtk_bdcts:          %d bytes, %.2f per sample, ratio %.2f, %d blocks of %d\n",
+           len,
+           (double)len / n_samples,
+           (double)raw_len / len,
+           (len + BLOCK_SIZE - 1) / BLOCK_SIZE,
+           BLOCK_SIZE);
+    printf("mtk_bdccmp:         %u bytes, ratio %.2f\n",
+           (unsigned)generic_len,
+           (double)raw_len / generic_len);
+#if BENCH_HAS_CYCLES
+    printf("encode:             %.1f cycles per sample, %.1f ns per sample\n",
+           (double)cycles / N_RUNS / n_samples,
+           ns / N_RUNS / n_samples);
+#else
+    printf("encode:             %.1f ns per sample\n", ns / N_RUNS / n_samples);
+#endif
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Host test of the message formats: messages are packed by the send functions
+ * of the message modules, unpacked by their handlers, and the events posted
+ * compared with what was sent. See README.md for building and running it. */
+
+#include <mira.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_events.h"
+#include "mtk_bdc_request.h"
+#include "mtk_bdc_signal.h"
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            printf("%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, \
+                   __func__, #cond);                                     \
+            n_failed++;                                                  \
+        }                                                                \
+    } while (0)
+
+static int n_failed;
+
+/* Last message sent, and last event posted */
+static uint8_t sent[1024];
+static uint16_t sent_len;
+static process_event_t posted_ev;
+static process_data_t posted_data;
+
+static const mira_net_address_t peer = { { 0xfd, 0x00, [15] = 0x01 } };
+static const mira_net_udp_callback_metadata_t peer_metadata = {
+    .source_address = &peer,
+    .source_port = 7338,
+};
+
+mira_status_t mira_net_udp_send_to(mira_net_udp_connection_t* connection,
+                                   const mira_net_address_t* addr,
+                                   uint16_t port,
+                                   const void* data,
+                                   uint16_t data_len)
+{
+    if (data_len > sizeof(sent)) {
+        return MIRA_ERROR;
+    }
+    memcpy(sent, data, data_len);
+    sent_len = data_len;
+    return MIRA_SUCCESS;
+}
+
+const char* mira_net_toolkit_format_address(char* buffer, const mira_net_address_t* addr)
+{
+    buffer[0] = '\0';
+    return buffer;
+}
+
+process_event_t process_alloc_event(void)
+{
+    static process_event_t next_event = 0x10;
+    return next_event++;
+}
+
+int process_post(struct process* p, process_event_t ev, process_data_t data)
+{
+    if (p == PROCESS_BROADCAST) {
+        posted_ev = ev;
+        posted_data = data;
+    }
+    return PROCESS_ERR_OK;
+}
+
+void process_poll(struct process* p)
+{
+}
+
+void process_start(struct process* p, process_data_t data)
+{
+}
+
+void process_exit(struct process* p)
+{
+}
+
+int process_is_running(struct process* p)
+{
+    return 1;
+}
+
+/* Pass the last message sent to handle, returning the data of the event
+ * posted, or NULL. */
+static const void* loop_back(void (*handle)(const void*,
+                                            const uint16_t,
+                                            const mira_net_udp_callback_metadata_t*))
+{
+    posted_data = NULL;
+    handle(sent, sent_len, &peer_metadata);
+    return posted_data;
+}
+
+static void test_request_delta(void)
+{
+    uint32_t hashes[MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS];
+    const uint8_t n_hashes = 5;
+
+    for (uint8_t i = 0; i < n_hashes; ++i) {
+        hashes[i] = 0x01020304u * (i + 1) ^ 0xa5a5a5a5u;
+    }
+
+    mtk_bdcreq_init(NULL);
+    CHECK(mtk_bdcreq_send_delta(&peer, 7338, 0x1234, 0x1f, 20, n_hashes, hashes) == 0);
+
+    const mtk_bdc_event_requested_data_t* request = loop_back(mtk_bdcreq_handle_data);
+    CHECK(request != NULL && posted_ev == event_bdc_requested);
+    if (request == NULL) {
+        return;
+    }
+    CHECK(request->packet_id == 0x1234);
+    CHECK(request->mask == 0x1f);
+    CHECK(request->period_ms == 20);
+    CHECK(request->n_hashes == n_hashes);
+    for (uint8_t i = 0; i < n_hashes && i < request->n_hashes; ++i) {
+        CHECK(request->hashes[i] == hashes[i]);
+    }
+}
+
+static void test_request_batch(void)
+{
+    const uint16_t batch_ids[] = { 0x0102, 0x0304, 0xfedc, 7 };
+    const uint8_t n_batch = sizeof(batch_ids) / sizeof(batch_ids[0]);
+
+    mtk_bdcreq_init(NULL);
+    CHECK(mtk_bdcreq_send_batch(&peer, 7338, 0x4321, 0x3, 50, n_batch, batch_ids) == 0);
+
+    const mtk_bdc_event_requested_data_t* request = loop_back(mtk_bdcreq_handle_data);
+    CHECK(request != NULL && posted_ev == event_bdc_requested);
+    if (request == NULL) {
+        return;
+    }
+    CHECK(request->packet_id == 0x4321);
+    CHECK(request->mask == 0x3);
+    CHECK(request->period_ms == 50);
+    CHECK(request->n_batch == n_batch);
+    for (uint8_t i = 0; i < n_batch && i < request->n_batch; ++i) {
+        CHECK(request->batch_ids[i] == batch_ids[i]);
+    }
+}
+
+static void test_manifest(void)
+{
+    const mtk_bulk_data_collection_manifest_entry_t entries[] = {
+        { .packet_id = 0x1001, .n_sub_packets = 1, .len = 12, .priority = 0 },
+        { .packet_id = 0x2002, .n_sub_packets = 5, .len = 1500, .priority = 200 },
+        { .packet_id = 0xabcd, .n_sub_packets = 64, .len = 0x5208, .priority = 7 },
+    };
+    const uint8_t n_entries = sizeof(entries) / sizeof(entries[0]);
+
+    mtk_bdcsig_init(NULL);
+    CHECK(mtk_bdcsig_send_manifest(&peer, entries, n_entries) == 0);
+
+    const mtk_bdc_event_manifest_data_t* manifest = loop_back(mtk_bdcsig_handle_data);
+    CHECK(manifest != NULL && posted_ev == event_bdc_manifest);
+    if (manifest == NULL) {
+        return;
+    }
+    CHECK(manifest->n_entries == n_entries);
+    for (uint8_t i = 0; i < n_entries && i < manifest->n_entries; ++i) {
+        CHECK(manifest->entries[i].packet_id == entries[i].packet_id);
+        CHECK(manifest->entries[i].n_sub_packets == entries[i].n_sub_packets);
+        CHECK(manifest->entries[i].len == entries[i].len);
+        CHECK(manifest->entries[i].priority == entries[i].priority);
+    }
+}
+
+int main(void)
+{
+    test_request_delta();
+    test_request_batch();
+    test_manifest();
+
+    printf("%s\n", (n_failed == 0) ? "ok" : "FAILED");
+
+    return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+
+#include "mtk_bdc_compress.h"
+
+/* Block format (LZSS):
+ *
+ * A control byte is followed by up to 8 items, each being either a literal
+ * byte or a match. Bit i of the control byte, from the least significant,
+ * tells if item i is a match. A match copies length bytes from distance bytes
+ * back in the decompressed data, and is coded on two bytes:
+ *
+ *  +------------------------+--------------------------+------------------------+
+ *  | distance bits 0-7 (8)  | distance bits 8-11 (4)   | length - 3 (4 bits)    |
+ *  +------------------------+--------------------------+------------------------+
+ *
+ * The decompressed length isn't part of the block, but known by the receiver.
+ */
+
+#define MATCH_MIN_LEN (3)
+#define MATCH_MAX_LEN (MATCH_MIN_LEN + 0x0f)
+#define MATCH_MAX_DISTANCE (0x0fff)
+
+int mtk_bdccmp_compress(uint8_t* dst, uint16_t dst_cap, const uint8_t* src, uint16_t src_len)
+{
+    uint16_t in = 0;
+    uint16_t out = 0;
+    uint16_t control_pos = 0;
+    uint8_t item = 8;
+
+    while (in < src_len) {
+        if (item == 8) {
+            if (out >= dst_cap) {
+                return -1;
+            }
+            control_pos = out++;
+            dst[control_pos] = 0;
+            item = 0;
+        }
+
+        /* Longest match in the data before, closest first */
+        uint16_t best_len = 0;
+        uint16_t best_distance = 0;
+        uint16_t max_len = src_len - in;
+        if (max_len > MATCH_MAX_LEN) {
+            max_len = MATCH_MAX_LEN;
+        }
+        uint16_t window = (in > MATCH_MAX_DISTANCE) ? MATCH_MAX_DISTANCE : in;
+
+        for (uint16_t distance = 1; distance <= window && best_len < max_len; ++distance) {
+            uint16_t len = 0;
+            /* Matches may overlap the current position, as in run lengths */
+            while (len < max_len && src[in - distance + len] == src[in + len]) {
+                len++;
+            }
+            if (len > best_len) {
+                best_len = len;
+                best_distance = distance;
+            }
+        }
+
+        if (best_len >= MATCH_MIN_LEN) {
+            if (out + 2 > dst_cap) {
+                return -1;
+            }
+            dst[out++] = best_distance & 0xff;
+            dst[out++] = ((best_distance >> 4) & 0xf0) | (best_len - MATCH_MIN_LEN);
+            dst[control_pos] |= 1 << item;
+            in += best_len;
+        } else {
+            if (out + 1 > dst_cap) {
+                return -1;
+            }
+            dst[out++] = src[in++];
+        }
+        item++;
+    }
+
+    return out;
+}
+
+int mtk_bdccmp_decompress(uint8_t* dst, uint16_t dst_len, const uint8_t* src, uint16_t src_len)
+{
+    uint16_t in = 0;
+    uint16_t out = 0;
+
+    while (out < dst_len) {
+        if (in >= src_len) {
+            return -1;
+        }
+        uint8_t control = src[in++];
+
+        for (uint8_t item = 0; item < 8 && out < dst_len; ++item) {
+            if (control & (1 << item)) {
+                if (in + 2 > src_len) {
+                    return -1;
+                }
+                uint16_t distance = src[in] | ((uint16_t)(src[in + 1] & 0xf0) << 4);
+                uint16_t len = (src[in + 1] & 0x0f) + MATCH_MIN_LEN;
+                in += 2;
+
+                if (distance == 0 || distance > out || out + len > dst_len) {
+                    return -1;
+                }
+                for (uint16_t i = 0; i < len; ++i, ++out) {
+                    dst[out] = dst[out - distance];
+                }
+            } else {
+                if (in >= src_len) {
+                    return -1;
+                }
+                dst[out++] = src[in++];
+            }
+        }
+    }
+
+    return (in == src_len) ? out : -1;
+}
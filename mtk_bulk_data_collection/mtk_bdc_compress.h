@@ -0,0 +1,44 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_COMPRESS_H
+#define MTK_BDC_COMPRESS_H
+
+/* Function identifier prefix: mtk_bdccmp_ */
+
+#include <stdint.h>
+
+/* Compress src_len bytes of src into dst, as one block decodable on its own.
+ * Returns the compressed length, or -1 if it doesn't fit in dst_cap bytes. To
+ * only keep compressed blocks that save space, pass dst_cap < src_len. */
+int mtk_bdccmp_compress(uint8_t* dst, uint16_t dst_cap, const uint8_t* src, uint16_t src_len);
+
+/* Decompress a block of src_len bytes into dst, which must decompress to
+ * exactly dst_len bytes. Returns dst_len, or -1 if the block is malformed. */
+int mtk_bdccmp_decompress(uint8_t* dst, uint16_t dst_len, const uint8_t* src, uint16_t src_len);
+
+#endif
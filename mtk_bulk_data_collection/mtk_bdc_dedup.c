@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mtk_bdc_dedup.h"
+
+typedef struct
+{
+    bool used;
+    uint32_t content_hash;
+    uint16_t len;
+    uint32_t last_used;
+} entry_t;
+
+static entry_t entries[MTK_BULK_DATA_COLLECTION_DEDUP_CACHE_SIZE];
+
+/* Increases at each use, for least recently used replacement. */
+static uint32_t use_count;
+
+static entry_t* entry_find(uint32_t content_hash, uint16_t len);
+
+void mtk_bdcdup_add(uint32_t content_hash, uint16_t len)
+{
+    entry_t* entry = entry_find(content_hash, len);
+
+    if (entry == NULL) {
+        entry = &entries[0];
+        for (int i = 0; i < MTK_BULK_DATA_COLLECTION_DEDUP_CACHE_SIZE; ++i) {
+            if (!entries[i].used) {
+                entry = &entries[i];
+                break;
+            }
+            /* Compare ages rather than counts, for wrap-around */
+            if (use_count - entries[i].last_used > use_count - entry->last_used) {
+                entry = &entries[i];
+            }
+        }
+        entry->used = true;
+        entry->content_hash = content_hash;
+        entry->len = len;
+    }
+
+    entry->last_used = ++use_count;
+}
+
+bool mtk_bdcdup_contains(uint32_t content_hash, uint16_t len)
+{
+    entry_t* entry = entry_find(content_hash, len);
+
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->last_used = ++use_count;
+    return true;
+}
+
+static entry_t* entry_find(uint32_t content_hash, uint16_t len)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_DEDUP_CACHE_SIZE; ++i) {
+        if (entries[i].used && entries[i].content_hash == content_hash &&
+            entries[i].len == len) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,48 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_DEDUP_H
+#define MTK_BDC_DEDUP_H
+
+/* Function identifier prefix: mtk_bdcdup_ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of received packets remembered by content. The least recently used
+ * is replaced when full. */
+#ifndef MTK_BULK_DATA_COLLECTION_DEDUP_CACHE_SIZE
+#define MTK_BULK_DATA_COLLECTION_DEDUP_CACHE_SIZE (4)
+#endif
+
+/* Note that a packet with content_hash and len was received. */
+void mtk_bdcdup_add(uint32_t content_hash, uint16_t len);
+
+/* Check if a packet with content_hash and len was received recently. */
+bool mtk_bdcdup_contains(uint32_t content_hash, uint16_t len);
+
+#endif
@@ -0,0 +1,345 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <string.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_discovery.h"
+#include "mtk_bdc_signal.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+static const uint8_t lpdsc_header[MTK_BULK_DATA_COLLECTION_HEADER_SIZE] = { 0x6d, 0xd1 };
+
+/* The query stops the answers to the query with the same id */
+#define LPDSC_FLAG_STOP (0x01)
+/* min_id and max_id are sent */
+#define LPDSC_FLAG_FILTER_ID (0x02)
+/* min_len is sent */
+#define LPDSC_FLAG_FILTER_LEN (0x04)
+
+/* Largest query: header, query_id, flags, window_ms and all filters */
+#define LPDSC_MAX_LEN                                                                 \
+    (sizeof(lpdsc_header) + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint16_t) + \
+     3 * sizeof(uint16_t))
+
+typedef struct
+{
+    uint8_t query_id;
+    uint8_t flags;
+    mtk_bdcdsc_query_t query;
+} lpdsc_message_t;
+
+static mira_net_udp_connection_t* lpdsc_udp_connection;
+static mira_net_address_t lpdsc_group_addr;
+
+/* Receiver: id of the last query */
+static uint8_t lpdsc_query_id;
+
+/* Sender: packet offered, and answer pending to the query of lpdsc_answer_id
+ * from lpdsc_answer_dst. lpdsc_answered is set once sent, so that a repeated
+ * query isn't answered twice. */
+static const mtk_bulk_data_collection_packet_t* lpdsc_offer;
+static struct ctimer lpdsc_answer_timer;
+static mira_net_address_t lpdsc_answer_dst;
+static uint8_t lpdsc_answer_id;
+static bool lpdsc_answer_pending;
+static bool lpdsc_answered;
+
+static void lpdsc_udp_callback(mira_net_udp_connection_t* connection,
+                               const void* data,
+                               uint16_t data_len,
+                               const mira_net_udp_callback_metadata_t* metadata,
+                               void* storage);
+
+static int lpdsc_send(const lpdsc_message_t* message);
+
+static uint8_t lpdsc_pack_buffer(uint8_t* buffer, const lpdsc_message_t* message);
+
+static int lpdsc_unpack_buffer(lpdsc_message_t* message, const uint8_t* buffer, uint16_t len);
+
+static bool lpdsc_offer_matches(const mtk_bdcdsc_query_t* query);
+
+static clock_time_t lpdsc_backoff_get(uint16_t window_ms);
+
+static void lpdsc_answer(void* arg);
+
+int mtk_bdcdsc_init(const mira_net_address_t* group_addr)
+{
+    if (lpdsc_udp_connection != NULL) {
+        (void)mira_net_udp_close(lpdsc_udp_connection);
+    }
+
+    mira_net_toolkit_copy_address(&lpdsc_group_addr, group_addr);
+
+    lpdsc_udp_connection = mira_net_udp_bind_address(&lpdsc_group_addr,
+                                                     NULL,
+                                                     MTK_BULK_DATA_COLLECTION_DISCOVERY_UDP_PORT,
+                                                     MTK_BULK_DATA_COLLECTION_DISCOVERY_UDP_PORT,
+                                                     lpdsc_udp_callback,
+                                                     NULL);
+    if (lpdsc_udp_connection == NULL) {
+        P_ERR("%s: mira_net_udp_bind_address\n", __func__);
+        return -1;
+    }
+
+    if (mira_net_udp_multicast_group_join(lpdsc_udp_connection, &lpdsc_group_addr) !=
+        MIRA_SUCCESS) {
+        P_ERR("%s: mira_net_udp_multicast_group_join\n", __func__);
+        mira_net_udp_close(lpdsc_udp_connection);
+        lpdsc_udp_connection = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int mtk_bdcdsc_query(const mtk_bdcdsc_query_t* query)
+{
+    lpdsc_message_t message = {
+        .query_id = ++lpdsc_query_id,
+        .query = *query,
+    };
+
+    if (query->max_id != 0) {
+        message.flags |= LPDSC_FLAG_FILTER_ID;
+    }
+    if (query->min_len != 0) {
+        message.flags |= LPDSC_FLAG_FILTER_LEN;
+    }
+
+    return lpdsc_send(&message);
+}
+
+int mtk_bdcdsc_stop(void)
+{
+    lpdsc_message_t message = {
+        .query_id = lpdsc_query_id,
+        .flags = LPDSC_FLAG_STOP,
+    };
+
+    return lpdsc_send(&message);
+}
+
+void mtk_bdcdsc_offer_set(const mtk_bulk_data_collection_packet_t* packet)
+{
+    lpdsc_offer = packet;
+    lpdsc_answered = false;
+
+    if (packet == NULL && lpdsc_answer_pending) {
+        ctimer_stop(&lpdsc_answer_timer);
+        lpdsc_answer_pending = false;
+    }
+}
+
+static int lpdsc_send(const lpdsc_message_t* message)
+{
+    uint8_t buffer[LPDSC_MAX_LEN];
+
+    if (lpdsc_udp_connection == NULL) {
+        return -1;
+    }
+
+    P_DEBUG("Sending discovery query %d, flags 0x%02x\n", message->query_id, message->flags);
+
+    uint8_t len = lpdsc_pack_buffer(buffer, message);
+
+    mira_status_t ret = mira_net_udp_send_to(lpdsc_udp_connection,
+                                             &lpdsc_group_addr,
+                                             MTK_BULK_DATA_COLLECTION_DISCOVERY_UDP_PORT,
+                                             buffer,
+                                             len);
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void lpdsc_udp_callback(mira_net_udp_connection_t* connection,
+                               const void* data,
+                               uint16_t data_len,
+                               const mira_net_udp_callback_metadata_t* metadata,
+                               void* storage)
+{
+    lpdsc_message_t message;
+
+    if (lpdsc_unpack_buffer(&message, data, data_len) < 0) {
+        return;
+    }
+
+    bool same_query =
+      message.query_id == lpdsc_answer_id &&
+      memcmp(&lpdsc_answer_dst, metadata->source_address, sizeof(mira_net_address_t)) == 0;
+
+    if (message.flags & LPDSC_FLAG_STOP) {
+        if (same_query && lpdsc_answer_pending) {
+            P_DEBUG("%s: answer to query %d stopped\n", __func__, message.query_id);
+            ctimer_stop(&lpdsc_answer_timer);
+            lpdsc_answer_pending = false;
+        }
+        return;
+    }
+
+    if ((same_query && (lpdsc_answer_pending || lpdsc_answered)) || lpdsc_offer == NULL ||
+        !lpdsc_offer_matches(&message.query)) {
+        return;
+    }
+
+    mira_net_toolkit_copy_address(&lpdsc_answer_dst, metadata->source_address);
+    lpdsc_answer_id = message.query_id;
+    lpdsc_answer_pending = true;
+    lpdsc_answered = false;
+
+    ctimer_set(
+      &lpdsc_answer_timer, lpdsc_backoff_get(message.query.window_ms), lpdsc_answer, NULL);
+}
+
+static bool lpdsc_offer_matches(const mtk_bdcdsc_query_t* query)
+{
+    if (query->max_id != 0 &&
+        (lpdsc_offer->id < query->min_id || lpdsc_offer->id > query->max_id)) {
+        return false;
+    }
+
+    return lpdsc_offer->len >= query->min_len;
+}
+
+/* Random delay within a part of the window that shrinks as the offered packet
+ * grows, so that large packets tend to answer first. */
+static clock_time_t lpdsc_backoff_get(uint16_t window_ms)
+{
+    uint32_t n_sub_packets = lpdsc_offer->num_sub_packets;
+    if (n_sub_packets > MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS) {
+        n_sub_packets = MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS;
+    }
+
+    uint32_t span_ms = (uint32_t)window_ms *
+                       (MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS + 1 - n_sub_packets) /
+                       MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS;
+    uint32_t delay_ms = (span_ms > 0) ? mira_random_generate() % (span_ms + 1) : 0;
+
+    return delay_ms * CLOCK_SECOND / 1000;
+}
+
+static void lpdsc_answer(void* arg)
+{
+    lpdsc_answer_pending = false;
+
+    if (lpdsc_offer == NULL) {
+        return;
+    }
+
+    RUN_CHECK(mtk_bdcsig_send_packet(&lpdsc_answer_dst, lpdsc_offer));
+    lpdsc_answered = true;
+}
+
+/* Discovery query format:
+ *
+ *  +-------------------+--------------------+----------------+---------------------+
+ *  | header  (16 bits) | query_id  (8 bits) | flags (8 bits) | window_ms (16 bits) | ...
+ *  +-------------------+--------------------+----------------+---------------------+
+ *
+ *  +---------------------------------------------------------+
+ *  | min_id, max_id (16 bits each, if FLAG_FILTER_ID is set) | ...
+ *  +---------------------------------------------------------+
+ *
+ *  +----------------------------------------------+
+ *  | min_len (16 bits, if FLAG_FILTER_LEN is set) |
+ *  +----------------------------------------------+
+ *
+ * Little endian. A stop has no filters, and window_ms 0.
+ */
+
+static uint8_t lpdsc_pack_buffer(uint8_t* buffer, const lpdsc_message_t* message)
+{
+    uint8_t* start = buffer;
+
+    memcpy(buffer, lpdsc_header, sizeof(lpdsc_header));
+    buffer += sizeof(lpdsc_header);
+
+    *buffer++ = message->query_id;
+    *buffer++ = message->flags;
+
+    LITTLE_ENDIAN_STORE(buffer, message->query.window_ms);
+    buffer += sizeof(message->query.window_ms);
+
+    if (message->flags & LPDSC_FLAG_FILTER_ID) {
+        LITTLE_ENDIAN_STORE(buffer, message->query.min_id);
+        buffer += sizeof(message->query.min_id);
+        LITTLE_ENDIAN_STORE(buffer, message->query.max_id);
+        buffer += sizeof(message->query.max_id);
+    }
+
+    if (message->flags & LPDSC_FLAG_FILTER_LEN) {
+        LITTLE_ENDIAN_STORE(buffer, message->query.min_len);
+        buffer += sizeof(message->query.min_len);
+    }
+
+    return buffer - start;
+}
+
+static int lpdsc_unpack_buffer(lpdsc_message_t* message, const uint8_t* buffer, uint16_t len)
+{
+    const uint8_t* end = buffer + len;
+
+    if (len < sizeof(lpdsc_header) + 2 * sizeof(uint8_t) + sizeof(uint16_t) ||
+        memcmp(buffer, lpdsc_header, sizeof(lpdsc_header)) != 0) {
+        return -1;
+    }
+    buffer += sizeof(lpdsc_header);
+
+    memset(message, 0, sizeof(*message));
+    message->query_id = *buffer++;
+    message->flags = *buffer++;
+
+    LITTLE_ENDIAN_LOAD(&message->query.window_ms, buffer);
+    buffer += sizeof(message->query.window_ms);
+
+    if (message->flags & LPDSC_FLAG_FILTER_ID) {
+        if (end - buffer < 2 * sizeof(uint16_t)) {
+            return -1;
+        }
+        LITTLE_ENDIAN_LOAD(&message->query.min_id, buffer);
+        buffer += sizeof(message->query.min_id);
+        LITTLE_ENDIAN_LOAD(&message->query.max_id, buffer);
+        buffer += sizeof(message->query.max_id);
+    }
+
+    if (message->flags & LPDSC_FLAG_FILTER_LEN) {
+        if (end - buffer < sizeof(uint16_t)) {
+            return -1;
+        }
+        LITTLE_ENDIAN_LOAD(&message->query.min_len, buffer);
+        buffer += sizeof(message->query.min_len);
+    }
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_DISCOVERY_H
+#define MTK_BDC_DISCOVERY_H
+
+/* Function identifier prefix: mtk_bdcdsc_ */
+
+#include <mira.h>
+#include <stdint.h>
+
+#include "mtk_bulk_data_collection.h"
+
+/* UDP port of discovery queries, sent to a multicast group */
+#ifndef MTK_BULK_DATA_COLLECTION_DISCOVERY_UDP_PORT
+#define MTK_BULK_DATA_COLLECTION_DISCOVERY_UDP_PORT (1521)
+#endif
+
+typedef struct
+{
+    /* Only packets with an id in [min_id, max_id] answer, if max_id != 0 */
+    uint16_t min_id;
+    uint16_t max_id;
+    /* Only packets of at least min_len bytes answer, if min_len != 0 */
+    uint16_t min_len;
+    /* Time over which the answers are spread, in ms */
+    uint16_t window_ms;
+} mtk_bdcdsc_query_t;
+
+/* Initialize the module, joining the multicast group group_addr, on which
+ * queries are sent. Format of the multicast address as for
+ * mira_net_udp_multicast_group_join(). */
+int mtk_bdcdsc_init(const mira_net_address_t* group_addr);
+
+/* Receiver: ask the senders of the group for their pending packet. Senders
+ * answer with a signal, posted as event_bdc_signaled_ready. */
+int mtk_bdcdsc_query(const mtk_bdcdsc_query_t* query);
+
+/* Receiver: stop the answers to the last query not sent yet, for example once
+ * the queue of packets to collect is full. */
+int mtk_bdcdsc_stop(void);
+
+/* Sender: set the packet to signal when queried, NULL for none. The packet must
+ * stay valid while set. */
+void mtk_bdcdsc_offer_set(const mtk_bulk_data_collection_packet_t* packet);
+
+#endif
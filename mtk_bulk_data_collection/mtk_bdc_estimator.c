@@ -0,0 +1,277 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mtk_bdc_estimator.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+/* Estimates follow Jacobson/Karels: smoothed values are kept scaled by 8 and
+ * mean deviations by 4, in clock ticks, so that the timeout is
+ * (srtt >> 3) + rttvar, i.e. mean + 4 * deviation. */
+typedef struct
+{
+    int32_t srtt;
+    int32_t rttvar;
+    bool valid;
+} estimate_t;
+
+typedef struct
+{
+    bool used;
+    mira_net_address_t addr;
+    clock_time_t last_used;
+
+    /* Request to first sub-packet */
+    estimate_t latency;
+    clock_time_t request_time;
+    bool awaiting_first;
+
+    /* Between consecutive sub-packets */
+    estimate_t inter_arrival;
+    clock_time_t last_arrival;
+    bool has_last_arrival;
+
+    /* Fraction of requested sub-packets lost per round, scaled by 256, and
+     * smoothed with gain 1/4. */
+    uint16_t loss;
+    bool loss_valid;
+    bool lossy;
+
+    /* Signal to reception of a whole packet */
+    estimate_t collection;
+} peer_t;
+
+static peer_t peers[MTK_BULK_DATA_COLLECTION_EST_CACHE_SIZE];
+
+static peer_t* peer_get(const mira_net_address_t* addr, bool create);
+
+static void estimate_sample(estimate_t* est, int32_t m);
+
+static clock_time_t estimate_timeout(const estimate_t* est);
+
+void mtk_bdcest_request_sent(const mira_net_address_t* addr)
+{
+    peer_t* peer = peer_get(addr, true);
+
+    peer->request_time = clock_time();
+    peer->awaiting_first = true;
+    peer->has_last_arrival = false;
+}
+
+void mtk_bdcest_subpacket_received(const mira_net_address_t* addr)
+{
+    peer_t* peer = peer_get(addr, true);
+    clock_time_t now = clock_time();
+
+    if (peer->awaiting_first) {
+        estimate_sample(&peer->latency, now - peer->request_time);
+        peer->awaiting_first = false;
+    } else if (peer->has_last_arrival) {
+        estimate_sample(&peer->inter_arrival, now - peer->last_arrival);
+    }
+
+    peer->last_arrival = now;
+    peer->has_last_arrival = true;
+}
+
+void mtk_bdcest_round_done(const mira_net_address_t* addr,
+                           uint8_t n_requested,
+                           uint8_t n_received)
+{
+    if (n_requested == 0 || n_received > n_requested) {
+        return;
+    }
+
+    peer_t* peer = peer_get(addr, true);
+    uint16_t sample = ((uint16_t)(n_requested - n_received) << 8) / n_requested;
+
+    if (peer->loss_valid) {
+        peer->loss = peer->loss - (peer->loss >> 2) + (sample >> 2);
+    } else {
+        peer->loss = sample;
+        peer->loss_valid = true;
+    }
+
+    if (peer->loss >= MTK_BULK_DATA_COLLECTION_EST_LOSSY_ENTER) {
+        peer->lossy = true;
+    } else if (peer->loss < MTK_BULK_DATA_COLLECTION_EST_LOSSY_LEAVE) {
+        peer->lossy = false;
+    }
+
+    P_DEBUG("%s: %d/%d received, loss estimate %d/256\n",
+            __func__,
+            n_received,
+            n_requested,
+            peer->loss);
+}
+
+clock_time_t mtk_bdcest_timeout_get(const mira_net_address_t* addr, clock_time_t fallback)
+{
+    peer_t* peer = peer_get(addr, false);
+    clock_time_t timeout;
+
+    if (peer == NULL) {
+        return fallback;
+    }
+
+    if (peer->awaiting_first || !peer->has_last_arrival) {
+        if (!peer->latency.valid) {
+            return fallback;
+        }
+        timeout = estimate_timeout(&peer->latency);
+    } else {
+        if (!peer->inter_arrival.valid) {
+            return fallback;
+        }
+        timeout = MTK_BULK_DATA_COLLECTION_EST_INTER_ARRIVAL_TIMEOUTS *
+                  estimate_timeout(&peer->inter_arrival);
+    }
+
+    if (timeout < MTK_BULK_DATA_COLLECTION_EST_MIN_TIMEOUT_MS * CLOCK_SECOND / 1000) {
+        timeout = MTK_BULK_DATA_COLLECTION_EST_MIN_TIMEOUT_MS * CLOCK_SECOND / 1000;
+    } else if (timeout > MTK_BULK_DATA_COLLECTION_EST_MAX_TIMEOUT_MS * CLOCK_SECOND / 1000) {
+        timeout = MTK_BULK_DATA_COLLECTION_EST_MAX_TIMEOUT_MS * CLOCK_SECOND / 1000;
+    }
+
+    return timeout;
+}
+
+int mtk_bdcest_retry_budget_get(const mira_net_address_t* addr, int fallback)
+{
+    peer_t* peer = peer_get(addr, false);
+
+    if (peer == NULL || !peer->loss_valid) {
+        return fallback;
+    }
+
+    /* Rounds needed for a sub-packet to get through with 99% probability, that
+     * is until loss^rounds < 1/100, plus one for a lost request. */
+    int retries = 1;
+    uint32_t remaining = peer->loss; /* loss^retries, scaled by 256 */
+    while (remaining * 100 >= 256 && retries < MTK_BULK_DATA_COLLECTION_EST_MAX_RETRIES) {
+        remaining = (remaining * peer->loss) >> 8;
+        retries++;
+    }
+    retries++;
+
+    if (retries < MTK_BULK_DATA_COLLECTION_EST_MIN_RETRIES) {
+        retries = MTK_BULK_DATA_COLLECTION_EST_MIN_RETRIES;
+    } else if (retries > MTK_BULK_DATA_COLLECTION_EST_MAX_RETRIES) {
+        retries = MTK_BULK_DATA_COLLECTION_EST_MAX_RETRIES;
+    }
+
+    return retries;
+}
+
+bool mtk_bdcest_lossy(const mira_net_address_t* addr)
+{
+    peer_t* peer = peer_get(addr, false);
+
+    return peer != NULL && peer->lossy;
+}
+
+void mtk_bdcest_collection_done(const mira_net_address_t* addr, clock_time_t duration)
+{
+    estimate_sample(&peer_get(addr, true)->collection, duration);
+}
+
+clock_time_t mtk_bdcest_collection_time_get(const mira_net_address_t* addr)
+{
+    peer_t* peer = peer_get(addr, false);
+
+    if (peer == NULL || !peer->collection.valid) {
+        return 0;
+    }
+
+    return peer->collection.srtt >> 3;
+}
+
+static peer_t* peer_get(const mira_net_address_t* addr, bool create)
+{
+    clock_time_t now = clock_time();
+    peer_t* victim = NULL;
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_EST_CACHE_SIZE; ++i) {
+        peer_t* peer = &peers[i];
+
+        if (!peer->used) {
+            if (victim == NULL || victim->used) {
+                victim = peer;
+            }
+            continue;
+        }
+
+        if (memcmp(&peer->addr, addr, sizeof(mira_net_address_t)) == 0) {
+            peer->last_used = now;
+            return peer;
+        }
+
+        /* Compare ages rather than time stamps, for wrap-around */
+        if (victim == NULL ||
+            (victim->used && (now - peer->last_used) > (now - victim->last_used))) {
+            victim = peer;
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    memcpy(&victim->addr, addr, sizeof(mira_net_address_t));
+    victim->last_used = now;
+
+    return victim;
+}
+
+static void estimate_sample(estimate_t* est, int32_t m)
+{
+    if (!est->valid) {
+        est->srtt = m << 3;
+        est->rttvar = m << 1;
+        est->valid = true;
+        return;
+    }
+
+    int32_t err = m - (est->srtt >> 3);
+    est->srtt += err;
+    if (err < 0) {
+        err = -err;
+    }
+    est->rttvar += err - (est->rttvar >> 2);
+}
+
+static clock_time_t estimate_timeout(const estimate_t* est)
+{
+    return (est->srtt >> 3) + est->rttvar;
+}
@@ -0,0 +1,111 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_ESTIMATOR_H
+#define MTK_BDC_ESTIMATOR_H
+
+/* Function identifier prefix: mtk_bdcest_ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of peers for which estimates are kept. The least recently used is
+ * replaced when full. */
+#ifndef MTK_BULK_DATA_COLLECTION_EST_CACHE_SIZE
+#define MTK_BULK_DATA_COLLECTION_EST_CACHE_SIZE (8)
+#endif
+
+/* Bounds of the derived receive timeout, in ms. */
+#ifndef MTK_BULK_DATA_COLLECTION_EST_MIN_TIMEOUT_MS
+#define MTK_BULK_DATA_COLLECTION_EST_MIN_TIMEOUT_MS (100)
+#endif
+#ifndef MTK_BULK_DATA_COLLECTION_EST_MAX_TIMEOUT_MS
+#define MTK_BULK_DATA_COLLECTION_EST_MAX_TIMEOUT_MS (60000)
+#endif
+
+/* Number of inter-arrival timeouts without a sub-packet before the stream is
+ * considered stopped. Above 1 to tolerate isolated losses. */
+#ifndef MTK_BULK_DATA_COLLECTION_EST_INTER_ARRIVAL_TIMEOUTS
+#define MTK_BULK_DATA_COLLECTION_EST_INTER_ARRIVAL_TIMEOUTS (3)
+#endif
+
+/* Bounds of the derived number of re-transmission requests. */
+#ifndef MTK_BULK_DATA_COLLECTION_EST_MIN_RETRIES
+#define MTK_BULK_DATA_COLLECTION_EST_MIN_RETRIES (2)
+#endif
+#ifndef MTK_BULK_DATA_COLLECTION_EST_MAX_RETRIES
+#define MTK_BULK_DATA_COLLECTION_EST_MAX_RETRIES (10)
+#endif
+
+/* Loss estimates, scaled by 256, above which the path to a peer is considered
+ * lossy, and below which it no longer is. Apart, as the loss of smaller
+ * sub-packets sent over a lossy path is lower. */
+#ifndef MTK_BULK_DATA_COLLECTION_EST_LOSSY_ENTER
+#define MTK_BULK_DATA_COLLECTION_EST_LOSSY_ENTER (64)
+#endif
+#ifndef MTK_BULK_DATA_COLLECTION_EST_LOSSY_LEAVE
+#define MTK_BULK_DATA_COLLECTION_EST_LOSSY_LEAVE (8)
+#endif
+
+/* Note that a request was sent to addr. The next sub-packet from addr samples
+ * the request-to-first-sub-packet latency. */
+void mtk_bdcest_request_sent(const mira_net_address_t* addr);
+
+/* Note that a sub-packet was received from addr. */
+void mtk_bdcest_subpacket_received(const mira_net_address_t* addr);
+
+/* Note the outcome of a request round: n_received of n_requested sub-packets
+ * arrived. Updates the loss estimate. */
+void mtk_bdcest_round_done(const mira_net_address_t* addr,
+                           uint8_t n_requested,
+                           uint8_t n_received);
+
+/* Time to wait for the next sub-packet from addr before requesting missing
+ * ones, in clock ticks. Derived from the latency estimate while waiting for the
+ * first sub-packet after a request, and from the inter-arrival estimate after.
+ * fallback is returned while there is no estimate. */
+clock_time_t mtk_bdcest_timeout_get(const mira_net_address_t* addr, clock_time_t fallback);
+
+/* Number of re-transmission requests to allow when collecting from addr,
+ * derived from the loss estimate. fallback is returned while there is no
+ * estimate. */
+int mtk_bdcest_retry_budget_get(const mira_net_address_t* addr, int fallback);
+
+/* Check if the path to addr is lossy, per the loss estimate and the
+ * thresholds above. False while there is no estimate. */
+bool mtk_bdcest_lossy(const mira_net_address_t* addr);
+
+/* Note that collecting a packet from addr took duration clock ticks, from its
+ * signal to its reception. */
+void mtk_bdcest_collection_done(const mira_net_address_t* addr, clock_time_t duration);
+
+/* Smoothed time to collect a packet from addr, in clock ticks, or 0 while there
+ * is no estimate. */
+clock_time_t mtk_bdcest_collection_time_get(const mira_net_address_t* addr);
+
+#endif
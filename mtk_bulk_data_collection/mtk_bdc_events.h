@@ -34,10 +34,27 @@ typedef struct
 {
     uint8_t n_sub_packets;
     uint16_t packet_id;
+    uint8_t flags; /* MTK_BULK_DATA_COLLECTION_FLAG_*, telling which fields below are set */
+    uint32_t content_hash;
+    uint16_t original_len;
+    uint16_t compressed_len;
+    uint16_t len;
+    uint16_t period_ms;
     mira_net_address_t src;
     uint16_t src_port;
 } mtk_bdc_event_signaled_data_t;
 
+/* Event: received a manifest of several large packets available */
+extern process_event_t event_bdc_manifest;
+typedef struct
+{
+    uint8_t n_entries;
+    mtk_bulk_data_collection_manifest_entry_t
+      entries[MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES];
+    mira_net_address_t src;
+    uint16_t src_port;
+} mtk_bdc_event_manifest_data_t;
+
 /* Event: received a request for large packet, with selected sub-packets */
 extern process_event_t event_bdc_requested;
 typedef struct
@@ -45,11 +62,48 @@ typedef struct
     uint16_t packet_id;
     uint64_t mask;
     uint16_t period_ms;
+    /* Delta requests: hashes of sub-packets 0 to n_hashes - 1 held by the
+     * receiver, 0 otherwise. See mtk_bulk_data_collection_delta_apply(). */
+    uint8_t n_hashes;
+    const uint32_t* hashes;
+    /* Batch requests: ids of packets to send whole right after this one, in
+     * order, chained by their next field. 0 otherwise. */
+    uint8_t n_batch;
+    const uint16_t* batch_ids;
+    /* Size of the sub-packets to send, which mask refers to, 0 for the
+     * default. See mtk_bulk_data_collection_sub_packet_size_set(). */
+    uint16_t sub_packet_size;
     /* source and port of the request, used as destination for large packet */
     mira_net_address_t src;
     uint16_t src_port;
 } mtk_bdc_event_requested_data_t;
 
+/* Event: received a NACK for sub-packets of a large packet being sent. Same
+ * data as event_bdc_requested. Handled by the sending process, which adds the
+ * sub-packets to its current transmission. */
+extern process_event_t event_bdc_nacked;
+
+/* Event: received a notice of sub-packets left unchanged since the version
+ * held by the receiver, in answer to a delta request. Same data as
+ * event_bdc_requested, mask telling the unchanged sub-packets. Handled by the
+ * receiving process. */
+extern process_event_t event_bdc_unchanged;
+
+/* Event: received an acknowledgement that the receiver holds a large packet,
+ * in place of a request or upon completion of a transfer. Same data as
+ * event_bdc_requested, without mask. */
+extern process_event_t event_bdc_acked;
+
+/* Event: received a rejection of a pushed large packet. Same data as
+ * event_bdc_requested, without mask. Handled by the sending process, which
+ * stops the transfer. */
+extern process_event_t event_bdc_rejected;
+
+/* Event: the sending process is done with a large packet, acknowledged by the
+ * receiver or kept for MTK_BULK_DATA_COLLECTION_TX_LINGER_MS without it. Its
+ * buffer may be reused. Data: the mtk_bulk_data_collection_packet_t sent */
+extern process_event_t event_bdc_released;
+
 /* Event: received a sub-packet */
 extern process_event_t event_bdc_subpacket_received;
 typedef struct
@@ -58,12 +112,18 @@ typedef struct
     uint8_t sub_packet_index;
     uint8_t n_sub_packets;
     uint16_t payload_len;
-    uint8_t* payload;
+    uint8_t* payload; /* where the payload was placed in the receiving packet */
     mira_net_address_t src;
     uint16_t src_port;
 } mtk_bdc_event_subpacket_data_t;
 
-/* Event: received a large packet */
+/* Event: received a large packet. Data: the mtk_bulk_data_collection_packet_t
+ * given to mtk_bulk_data_collection_receive_proc */
 extern process_event_t event_bdc_received;
 
+/* Event: reception of a large packet failed, after too many re-transmission
+ * requests, a write error, or a content hash mismatch. Same data as
+ * event_bdc_received. */
+extern process_event_t event_bdc_receive_failed;
+
 #endif
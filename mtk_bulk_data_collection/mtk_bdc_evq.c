@@ -0,0 +1,137 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mtk_bdc_evq.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+/* Posted to mtk_bdcevq_proc after each event, with the queue as data. Events
+ * are delivered in the order they are posted, so that the slot of the event,
+ * and those before it, are released once this one is received. */
+static process_event_t release_event;
+
+PROCESS(mtk_bdcevq_proc, "Bulk data collection event queue");
+
+int mtk_bdcevq_init(void)
+{
+    /* Releases posted before are ignored, each module resetting its queues */
+    release_event = process_alloc_event();
+
+    if (!process_is_running(&mtk_bdcevq_proc)) {
+        process_start(&mtk_bdcevq_proc, NULL);
+    }
+
+    return 0;
+}
+
+void mtk_bdcevq_reset(mtk_bdcevq_t* q)
+{
+    q->head = 0;
+    q->n_used = 0;
+    q->marked_mask = 0;
+}
+
+void* mtk_bdcevq_alloc(mtk_bdcevq_t* q)
+{
+    if (q->n_used == q->n_slots) {
+        q->stats.overflows++;
+        return NULL;
+    }
+
+    uint8_t index = (q->head + q->n_used) % q->n_slots;
+    q->n_used++;
+    if (q->n_used > q->stats.peak) {
+        q->stats.peak = q->n_used;
+    }
+
+    return (uint8_t*)q->slots + index * q->slot_size;
+}
+
+int mtk_bdcevq_post(mtk_bdcevq_t* q, process_event_t ev)
+{
+    uint8_t index = (q->head + q->n_used - 1) % q->n_slots;
+
+    if (process_post(PROCESS_BROADCAST, ev, (uint8_t*)q->slots + index * q->slot_size) !=
+        PROCESS_ERR_OK) {
+        P_ERR("%s: process_post\n", __func__);
+        mtk_bdcevq_cancel(q);
+        return -1;
+    }
+    q->stats.posted++;
+
+    /* Without it, the slot is released along with the next one posted */
+    if (process_post(&mtk_bdcevq_proc, release_event, q) == PROCESS_ERR_OK) {
+        q->marked_mask |= (uint32_t)1 << index;
+    }
+
+    return 0;
+}
+
+void mtk_bdcevq_cancel(mtk_bdcevq_t* q)
+{
+    if (q->n_used > 0) {
+        q->n_used--;
+    }
+}
+
+bool mtk_bdcevq_holds(const mtk_bdcevq_t* q, const void* slot)
+{
+    uint8_t index = ((const uint8_t*)slot - (const uint8_t*)q->slots) / q->slot_size;
+
+    return (index + q->n_slots - q->head) % q->n_slots < q->n_used;
+}
+
+void mtk_bdcevq_stats_get(const mtk_bdcevq_t* q, mtk_bdcevq_stats_t* stats)
+{
+    *stats = q->stats;
+}
+
+PROCESS_THREAD(mtk_bdcevq_proc, ev, data)
+{
+    PROCESS_BEGIN();
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == release_event);
+
+        /* Up to the first slot of which the release is posted, this one */
+        mtk_bdcevq_t* q = (mtk_bdcevq_t*)data;
+        bool marked = false;
+        while (!marked && q->n_used > 0) {
+            marked = (q->marked_mask >> q->head) & 1;
+            q->marked_mask &= ~((uint32_t)1 << q->head);
+            q->head = (q->head + 1) % q->n_slots;
+            q->n_used--;
+        }
+    }
+
+    PROCESS_END();
+}
@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_EVQ_H
+#define MTK_BDC_EVQ_H
+
+/* Function identifier prefix: mtk_bdcevq_ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Max number of slots of a queue, one bit each in marked_mask */
+#define MTK_BDCEVQ_MAX_SLOTS (32)
+
+/* Queue of event data slots, one per type of event data. Data of an event
+ * posted from the UDP callback is held in a slot until the event has been
+ * delivered to all processes, instead of in a single buffer overwritten by
+ * the next incoming message. Slots are taken and released in order, and there
+ * are at most MTK_BDCEVQ_MAX_SLOTS per queue. */
+typedef struct
+{
+    uint32_t posted;
+    uint32_t overflows; /* events dropped as all slots were in use */
+    uint8_t peak;       /* most slots in use at once */
+} mtk_bdcevq_stats_t;
+
+typedef struct
+{
+    void* slots;
+    uint16_t slot_size;
+    uint8_t n_slots;
+    uint8_t head; /* oldest slot in use */
+    uint8_t n_used;
+    uint32_t marked_mask; /* slots of which the release is posted */
+    mtk_bdcevq_stats_t stats;
+} mtk_bdcevq_t;
+
+/* Initializer of a queue of the slots of array slot_array. */
+#define MTK_BDCEVQ_INIT(slot_array)                              \
+    {                                                            \
+        .slots = (slot_array),                                   \
+        .slot_size = sizeof((slot_array)[0]),                    \
+        .n_slots = sizeof(slot_array) / sizeof((slot_array)[0]), \
+    }
+
+/* Initialize the module, starting the process releasing delivered slots. */
+int mtk_bdcevq_init(void);
+
+/* Release all slots of q, such as those of events not delivered before
+ * re-initializing. */
+void mtk_bdcevq_reset(mtk_bdcevq_t* q);
+
+/* Take the next slot of q, to fill with event data. Returns NULL, counting an
+ * overflow, if all slots are in use. */
+void* mtk_bdcevq_alloc(mtk_bdcevq_t* q);
+
+/* Post ev to all processes, with the slot last taken from q as data. The slot
+ * is released once the event has been delivered, or at once on failure. */
+int mtk_bdcevq_post(mtk_bdcevq_t* q, process_event_t ev);
+
+/* Release the slot last taken from q, without posting it. */
+void mtk_bdcevq_cancel(mtk_bdcevq_t* q);
+
+/* Check if slot of q is in use, its event not delivered yet. */
+bool mtk_bdcevq_holds(const mtk_bdcevq_t* q, const void* slot);
+
+/* Get the statistics of q. */
+void mtk_bdcevq_stats_get(const mtk_bdcevq_t* q, mtk_bdcevq_stats_t* stats);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mtk_bdc_fountain.h"
+
+static uint32_t prng_next(uint32_t* state);
+
+static uint8_t bit_count(uint64_t mask);
+
+static void xor_blocks(uint8_t* symbol, const uint8_t* data, uint16_t size, uint64_t mask);
+
+uint64_t mtk_bdcfnt_neighbors_get(uint16_t packet_id, uint8_t symbol_index, uint64_t blocks)
+{
+    uint32_t state = ((((uint32_t)packet_id) << 8) | symbol_index) * 2654435761u;
+    uint32_t n_blocks = bit_count(blocks);
+
+    if (n_blocks == 0) {
+        return 0;
+    }
+    if (state == 0) {
+        state = 1;
+    }
+
+    /* The ideal soliton CDF is 1/K + 1 - 1/d, so the degree for a uniform u in
+     * [0, 1) is the smallest d with d >= 1 / (1 - u + 1/K). Computed with u
+     * scaled by 65536. */
+    uint32_t u = prng_next(&state) & 0xffff;
+    uint32_t num = 65536 * n_blocks;
+    uint32_t den = n_blocks * (65536 - u) + 65536;
+    uint32_t degree = (num + den - 1) / den;
+    if (degree < 1) {
+        degree = 1;
+    } else if (degree > n_blocks) {
+        degree = n_blocks;
+    }
+
+    uint64_t neighbors = 0;
+    uint64_t candidates = blocks;
+    for (uint32_t n = 0; n < degree; ++n) {
+        /* The j-th of the blocks not picked yet */
+        uint32_t j = prng_next(&state) % (n_blocks - n);
+        for (uint8_t i = 0; i < 64; ++i) {
+            uint64_t bit = ((uint64_t)1) << i;
+            if ((candidates & bit) && j-- == 0) {
+                neighbors |= bit;
+                candidates &= ~bit;
+                break;
+            }
+        }
+    }
+
+    return neighbors;
+}
+
+void mtk_bdcfnt_encode(uint8_t* symbol,
+                       const uint8_t* data,
+                       uint16_t size,
+                       uint64_t neighbors)
+{
+    memset(symbol, 0, size);
+    xor_blocks(symbol, data, size, neighbors);
+}
+
+void mtk_bdcfnt_reduce(uint8_t* symbol,
+                       uint64_t* unknown,
+                       const uint8_t* data,
+                       uint16_t size,
+                       uint64_t known)
+{
+    uint64_t mask = *unknown & known;
+
+    xor_blocks(symbol, data, size, mask);
+    *unknown &= ~mask;
+}
+
+/* xorshift32 */
+static uint32_t prng_next(uint32_t* state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+static uint8_t bit_count(uint64_t mask)
+{
+    uint8_t n = 0;
+    while (mask != 0) {
+        mask &= mask - 1;
+        n++;
+    }
+    return n;
+}
+
+static void xor_blocks(uint8_t* symbol, const uint8_t* data, uint16_t size, uint64_t mask)
+{
+    for (uint8_t i = 0; i < 64 && mask != 0; ++i) {
+        uint64_t bit = ((uint64_t)1) << i;
+        if (!(mask & bit)) {
+            continue;
+        }
+        const uint8_t* block = data + (uint32_t)i * size;
+        for (uint16_t k = 0; k < size; ++k) {
+            symbol[k] ^= block[k];
+        }
+        mask &= ~bit;
+    }
+}
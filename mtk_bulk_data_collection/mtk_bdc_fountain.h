@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_FOUNTAIN_H
+#define MTK_BDC_FOUNTAIN_H
+
+/* Function identifier prefix: mtk_bdcfnt_ */
+
+#include <stdint.h>
+
+/* Repair symbols sent beyond the largest number of sub-packets missing at a
+ * receiver, for symbols that turn out to add nothing to it. */
+#ifndef MTK_BULK_DATA_COLLECTION_FOUNTAIN_OVERHEAD
+#define MTK_BULK_DATA_COLLECTION_FOUNTAIN_OVERHEAD (2)
+#endif
+
+/* Blocks, among those set in blocks, of which the repair symbol symbol_index of
+ * packet packet_id is the XOR. Both ends derive the same set from the ids,
+ * with a degree drawn from the ideal soliton distribution. */
+uint64_t mtk_bdcfnt_neighbors_get(uint16_t packet_id, uint8_t symbol_index, uint64_t blocks);
+
+/* Compute into symbol the XOR of the blocks set in neighbors, block i being
+ * size bytes at data + i * size. */
+void mtk_bdcfnt_encode(uint8_t* symbol,
+                       const uint8_t* data,
+                       uint16_t size,
+                       uint64_t neighbors);
+
+/* Remove from a symbol, of which unknown tells the blocks not removed yet, the
+ * blocks set in known, held at data as for mtk_bdcfnt_encode(). Once a single
+ * block is left in unknown, the symbol is that block. */
+void mtk_bdcfnt_reduce(uint8_t* symbol,
+                       uint64_t* unknown,
+                       const uint8_t* data,
+                       uint16_t size,
+                       uint64_t known);
+
+#endif
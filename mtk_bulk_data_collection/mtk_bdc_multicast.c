@@ -0,0 +1,278 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <string.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_multicast.h"
+#include "mtk_bdc_signal.h"
+#include "mtk_bdc_subpacket.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+static const uint8_t lpmc_header[MTK_BULK_DATA_COLLECTION_HEADER_SIZE] = { 0x3c, 0x5e };
+
+/* A repair notice of the sender, with the symbols of the round */
+#define LPMC_FLAG_REPAIR (0x01)
+
+/* NACK: header, packet_id, flags and mask */
+#define LPMC_NACK_LEN \
+    (sizeof(lpmc_header) + sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint64_t))
+
+/* Repair notice: NACK, first_symbol and n_symbols */
+#define LPMC_REPAIR_LEN (LPMC_NACK_LEN + 2 * sizeof(uint8_t))
+
+static mira_net_udp_connection_t* lpmc_udp_connection;
+static mira_net_address_t lpmc_group_addr;
+
+static mtk_bdcmc_nack_handler_t lpmc_nack_handler;
+
+static void lpmc_udp_callback(mira_net_udp_connection_t* connection,
+                              const void* data,
+                              uint16_t data_len,
+                              const mira_net_udp_callback_metadata_t* metadata,
+                              void* storage);
+
+static int lpmc_send_nack(const mtk_bdcmc_nack_t* nack);
+
+static uint8_t lpmc_pack_buffer(uint8_t* buffer, const mtk_bdcmc_nack_t* nack);
+
+static int lpmc_unpack_buffer(mtk_bdcmc_nack_t* nack, const uint8_t* buffer, uint16_t len);
+
+int mtk_bdcmc_init(const mira_net_address_t* group_addr)
+{
+    if (lpmc_udp_connection != NULL) {
+        (void)mira_net_udp_close(lpmc_udp_connection);
+    }
+
+    mira_net_toolkit_copy_address(&lpmc_group_addr, group_addr);
+
+    lpmc_udp_connection = mira_net_udp_bind_address(&lpmc_group_addr,
+                                                    NULL,
+                                                    MTK_BULK_DATA_COLLECTION_MULTICAST_UDP_PORT,
+                                                    MTK_BULK_DATA_COLLECTION_MULTICAST_UDP_PORT,
+                                                    lpmc_udp_callback,
+                                                    NULL);
+    if (lpmc_udp_connection == NULL) {
+        P_ERR("%s: mira_net_udp_bind_address\n", __func__);
+        return -1;
+    }
+
+    if (mira_net_udp_multicast_group_join(lpmc_udp_connection, &lpmc_group_addr) !=
+        MIRA_SUCCESS) {
+        P_ERR("%s: mira_net_udp_multicast_group_join\n", __func__);
+        mira_net_udp_close(lpmc_udp_connection);
+        lpmc_udp_connection = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void mtk_bdcmc_nack_handler_set(mtk_bdcmc_nack_handler_t handler)
+{
+    lpmc_nack_handler = handler;
+}
+
+int mtk_bdcmc_signal(const mtk_bulk_data_collection_packet_t* packet)
+{
+    if (lpmc_udp_connection == NULL) {
+        return -1;
+    }
+
+    return mtk_bdcsig_send_packet_on(
+      lpmc_udp_connection, &lpmc_group_addr, MTK_BULK_DATA_COLLECTION_MULTICAST_UDP_PORT, packet);
+}
+
+int mtk_bdcmc_send(uint16_t packet_id,
+                   uint8_t sub_packet_index,
+                   uint8_t n_sub_packets,
+                   const uint8_t* data,
+                   const uint16_t data_len)
+{
+    if (lpmc_udp_connection == NULL) {
+        return -1;
+    }
+
+    return mtk_bdcsp_send_on(lpmc_udp_connection,
+                             &lpmc_group_addr,
+                             MTK_BULK_DATA_COLLECTION_MULTICAST_UDP_PORT,
+                             packet_id,
+                             sub_packet_index,
+                             n_sub_packets,
+                             data,
+                             data_len);
+}
+
+int mtk_bdcmc_send_nack(uint16_t packet_id, uint64_t mask)
+{
+    mtk_bdcmc_nack_t nack = {
+        .packet_id = packet_id,
+        .mask = mask,
+    };
+
+    return lpmc_send_nack(&nack);
+}
+
+int mtk_bdcmc_send_repair(uint16_t packet_id,
+                          uint64_t mask,
+                          uint8_t first_symbol,
+                          uint8_t n_symbols)
+{
+    mtk_bdcmc_nack_t nack = {
+        .packet_id = packet_id,
+        .mask = mask,
+        .repair = true,
+        .first_symbol = first_symbol,
+        .n_symbols = n_symbols,
+    };
+
+    return lpmc_send_nack(&nack);
+}
+
+static int lpmc_send_nack(const mtk_bdcmc_nack_t* nack)
+{
+    uint8_t buffer[LPMC_REPAIR_LEN];
+
+    if (lpmc_udp_connection == NULL) {
+        return -1;
+    }
+
+    P_DEBUG("Sending multicast %s for packet %d\n",
+            nack->repair ? "repair notice" : "NACK",
+            nack->packet_id);
+
+    uint8_t len = lpmc_pack_buffer(buffer, nack);
+
+    mira_status_t ret = mira_net_udp_send_to(lpmc_udp_connection,
+                                             &lpmc_group_addr,
+                                             MTK_BULK_DATA_COLLECTION_MULTICAST_UDP_PORT,
+                                             buffer,
+                                             len);
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Signals and sub-packets sent to the group are handled as when sent to the
+ * node, NACKs and repair notices by the handler. */
+static void lpmc_udp_callback(mira_net_udp_connection_t* connection,
+                              const void* data,
+                              uint16_t data_len,
+                              const mira_net_udp_callback_metadata_t* metadata,
+                              void* storage)
+{
+    mtk_bdcmc_nack_t nack;
+
+    if (data_len < MTK_BULK_DATA_COLLECTION_HEADER_SIZE) {
+        P_ERR("%s: UDP packet too short\n", __func__);
+        return;
+    }
+
+    mtk_bdcsig_handle_data(data, data_len, metadata);
+    mtk_bdcsp_handle_data(data, data_len, metadata);
+
+    if (lpmc_unpack_buffer(&nack, data, data_len) < 0) {
+        return;
+    }
+    mira_net_toolkit_copy_address(&nack.src, metadata->source_address);
+
+    if (lpmc_nack_handler != NULL) {
+        lpmc_nack_handler(&nack);
+    }
+}
+
+/* Multicast NACK format:
+ *
+ *  +-------------------+----------------------+----------------+----------------+
+ *  | header  (16 bits) |  packet_id (16 bits) | flags (8 bits) | mask (64 bits) | ...
+ *  +-------------------+----------------------+----------------+----------------+
+ *
+ *  +--------------------------------------------------------------+
+ *  | first_symbol, n_symbols (8 bits each, if FLAG_REPAIR is set) |
+ *  +--------------------------------------------------------------+
+ *
+ * Little endian.
+ */
+
+static uint8_t lpmc_pack_buffer(uint8_t* buffer, const mtk_bdcmc_nack_t* nack)
+{
+    uint8_t* start = buffer;
+
+    memcpy(buffer, lpmc_header, sizeof(lpmc_header));
+    buffer += sizeof(lpmc_header);
+
+    LITTLE_ENDIAN_STORE(buffer, nack->packet_id);
+    buffer += sizeof(nack->packet_id);
+
+    *buffer++ = nack->repair ? LPMC_FLAG_REPAIR : 0;
+
+    LITTLE_ENDIAN_STORE(buffer, nack->mask);
+    buffer += sizeof(nack->mask);
+
+    if (nack->repair) {
+        *buffer++ = nack->first_symbol;
+        *buffer++ = nack->n_symbols;
+    }
+
+    return buffer - start;
+}
+
+static int lpmc_unpack_buffer(mtk_bdcmc_nack_t* nack, const uint8_t* buffer, uint16_t len)
+{
+    if (len < LPMC_NACK_LEN || memcmp(buffer, lpmc_header, sizeof(lpmc_header)) != 0) {
+        return -1;
+    }
+    buffer += sizeof(lpmc_header);
+
+    memset(nack, 0, sizeof(*nack));
+
+    LITTLE_ENDIAN_LOAD(&nack->packet_id, buffer);
+    buffer += sizeof(nack->packet_id);
+
+    nack->repair = (*buffer++ & LPMC_FLAG_REPAIR) != 0;
+
+    LITTLE_ENDIAN_LOAD(&nack->mask, buffer);
+    buffer += sizeof(nack->mask);
+
+    if (len != (nack->repair ? LPMC_REPAIR_LEN : LPMC_NACK_LEN)) {
+        P_ERR("%s: wrong multicast NACK size (%d)!\n", __func__, len);
+        return -1;
+    }
+
+    if (nack->repair) {
+        nack->first_symbol = *buffer++;
+        nack->n_symbols = *buffer++;
+    }
+
+    return 0;
+}
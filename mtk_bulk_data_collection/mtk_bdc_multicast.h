@@ -0,0 +1,116 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_MULTICAST_H
+#define MTK_BDC_MULTICAST_H
+
+/* Function identifier prefix: mtk_bdcmc_ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mtk_bulk_data_collection.h"
+
+/* UDP port of multicast transfers, on which signals, sub-packets and NACKs are
+ * sent to the group */
+#ifndef MTK_BULK_DATA_COLLECTION_MULTICAST_UDP_PORT
+#define MTK_BULK_DATA_COLLECTION_MULTICAST_UDP_PORT (1522)
+#endif
+
+/* Receiver: sub-packets still missing when a round goes quiet are NACKed after
+ * a random delay of up to this, in ms. A NACK of another receiver or a repair
+ * round covering them, heard meanwhile, cancels it. */
+#ifndef MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_BACKOFF_MS
+#define MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_BACKOFF_MS (1000)
+#endif
+
+/* Sender: time waited for a NACK after a round, in ms, before the transfer is
+ * done. Longer than the receive timeout of the receivers plus
+ * MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_BACKOFF_MS. */
+#ifndef MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WAIT_MS
+#define MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WAIT_MS (5000)
+#endif
+
+/* Sender: time NACKs are gathered after the first one, in ms, before the
+ * repair round. */
+#ifndef MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WINDOW_MS
+#define MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WINDOW_MS (500)
+#endif
+
+/* Sender: max number of repair rounds of a transfer */
+#ifndef MTK_BULK_DATA_COLLECTION_MULTICAST_MAX_ROUNDS
+#define MTK_BULK_DATA_COLLECTION_MULTICAST_MAX_ROUNDS (8)
+#endif
+
+/* NACK of a receiver, or notice of a repair round from the sender */
+typedef struct
+{
+    uint16_t packet_id;
+    /* Sub-packets missing, or repaired */
+    uint64_t mask;
+    /* Repair notices only: the round sends repair symbols first_symbol to
+     * first_symbol + n_symbols - 1, see mtk_bulk_data_collection_fountain_enable() */
+    bool repair;
+    uint8_t first_symbol;
+    uint8_t n_symbols;
+    mira_net_address_t src;
+} mtk_bdcmc_nack_t;
+
+/* Called at reception of a NACK or a repair notice, from the UDP callback. */
+typedef void (*mtk_bdcmc_nack_handler_t)(const mtk_bdcmc_nack_t* nack);
+
+/* Initialize the module, joining the multicast group group_addr, to which
+ * multicast transfers are sent. Format of the multicast address as for
+ * mira_net_udp_multicast_group_join(). */
+int mtk_bdcmc_init(const mira_net_address_t* group_addr);
+
+/* Set the handler of incoming NACKs and repair notices. */
+void mtk_bdcmc_nack_handler_set(mtk_bdcmc_nack_handler_t handler);
+
+/* Signal packet to the group. See mtk_bdcsig_send_packet(). */
+int mtk_bdcmc_signal(const mtk_bulk_data_collection_packet_t* packet);
+
+/* Send a sub-packet, or a repair symbol, to the group. Returns as
+ * mtk_bdcsp_send(). */
+int mtk_bdcmc_send(uint16_t packet_id,
+                   uint8_t sub_packet_index,
+                   uint8_t n_sub_packets,
+                   const uint8_t* data,
+                   const uint16_t data_len);
+
+/* Receiver: NACK the sub-packets of mask to the group, the sender and the
+ * other receivers. */
+int mtk_bdcmc_send_nack(uint16_t packet_id, uint64_t mask);
+
+/* Sender: announce to the group a repair round of the sub-packets of mask. */
+int mtk_bdcmc_send_repair(uint16_t packet_id,
+                          uint64_t mask,
+                          uint8_t first_symbol,
+                          uint8_t n_symbols);
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_pool.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+#if MTK_BULK_DATA_COLLECTION_POOL_BLOCKS > 255
+#error "MTK_BULK_DATA_COLLECTION_POOL_BLOCKS must be at most 255"
+#endif
+
+typedef struct
+{
+    const void* owner; /* NULL if free */
+    uint8_t index;
+    uint8_t refs;
+} block_t;
+
+static block_t blocks[MTK_BULK_DATA_COLLECTION_POOL_BLOCKS];
+static uint8_t block_data[MTK_BULK_DATA_COLLECTION_POOL_BLOCKS]
+                        [MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES];
+
+static mtk_bdcpool_stats_t stats = {
+    .n_blocks = MTK_BULK_DATA_COLLECTION_POOL_BLOCKS,
+};
+
+static int block_find(const void* owner, uint8_t index);
+
+uint8_t* mtk_bdcpool_alloc(const void* owner, uint8_t index)
+{
+    int i = block_find(owner, index);
+
+    if (i >= 0) {
+        return block_data[i];
+    }
+
+    i = block_find(NULL, 0);
+    if (i < 0) {
+        P_DEBUG("%s: no free block for sub-packet %d\n", __func__, index);
+        stats.failures++;
+        return NULL;
+    }
+
+    blocks[i].owner = owner;
+    blocks[i].index = index;
+    blocks[i].refs = 1;
+
+    stats.in_use++;
+    if (stats.in_use > stats.peak) {
+        stats.peak = stats.in_use;
+    }
+
+    return block_data[i];
+}
+
+uint8_t* mtk_bdcpool_get(const void* owner, uint8_t index)
+{
+    int i = block_find(owner, index);
+
+    return (i >= 0) ? block_data[i] : NULL;
+}
+
+bool mtk_bdcpool_held(const void* owner)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_POOL_BLOCKS; ++i) {
+        if (blocks[i].owner == owner) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void mtk_bdcpool_ref(const void* owner)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_POOL_BLOCKS; ++i) {
+        if (blocks[i].owner == owner && blocks[i].refs < UINT8_MAX) {
+            blocks[i].refs++;
+        }
+    }
+}
+
+void mtk_bdcpool_unref(const void* owner)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_POOL_BLOCKS; ++i) {
+        if (blocks[i].owner != owner) {
+            continue;
+        }
+        if (--blocks[i].refs == 0) {
+            blocks[i].owner = NULL;
+            stats.in_use--;
+        }
+    }
+}
+
+void mtk_bdcpool_stats_get(mtk_bdcpool_stats_t* s)
+{
+    *s = stats;
+}
+
+/* Find the block of sub-packet index of owner, or a free block for a NULL
+ * owner. */
+static int block_find(const void* owner, uint8_t index)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_POOL_BLOCKS; ++i) {
+        if (blocks[i].owner == owner && (owner == NULL || blocks[i].index == index)) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_POOL_H
+#define MTK_BDC_POOL_H
+
+/* Function identifier prefix: mtk_bdcpool_ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of blocks of the receive buffer pool, each holding a sub-packet of a
+ * pooled reception, or a slot of the reorder window of a reception. Each costs
+ * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES of RAM. */
+#ifndef MTK_BULK_DATA_COLLECTION_POOL_BLOCKS
+#define MTK_BULK_DATA_COLLECTION_POOL_BLOCKS (16)
+#endif
+
+/* Blocks are owned by a packet, one per sub-packet index, and carry a
+ * reference count. A block is free again once all its references are
+ * dropped. */
+typedef struct
+{
+    uint8_t n_blocks;
+    uint8_t in_use;
+    uint8_t peak;      /* most blocks in use at once */
+    uint32_t failures; /* blocks not allocated as all were in use */
+} mtk_bdcpool_stats_t;
+
+/* Get the block of sub-packet index of owner, allocating it with a single
+ * reference if owner has none. Returns NULL, counting a failure, if all blocks
+ * are in use. */
+uint8_t* mtk_bdcpool_alloc(const void* owner, uint8_t index);
+
+/* Get the block of sub-packet index of owner, NULL if it has none. */
+uint8_t* mtk_bdcpool_get(const void* owner, uint8_t index);
+
+/* Check if owner has any block. */
+bool mtk_bdcpool_held(const void* owner);
+
+/* Add a reference to every block of owner. */
+void mtk_bdcpool_ref(const void* owner);
+
+/* Drop a reference to every block of owner, freeing those left without. */
+void mtk_bdcpool_unref(const void* owner);
+
+/* Get the usage of the pool. */
+void mtk_bdcpool_stats_get(mtk_bdcpool_stats_t* stats);
+
+#endif
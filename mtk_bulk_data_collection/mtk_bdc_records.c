@@ -0,0 +1,254 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_events.h"
+#include "mtk_bdc_records.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+#if MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES > MTK_BULK_DATA_COLLECTION_REC_BUFFER_BYTES
+#error "MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES exceeds MTK_BULK_DATA_COLLECTION_REC_BUFFER_BYTES"
+#endif
+
+#if MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES >                                  \
+  (MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES)
+#error "MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES exceeds the size of a packet"
+#endif
+
+/* Batch sealed and registered, until released */
+typedef struct
+{
+    bool used;
+    uint16_t start;
+    uint16_t len;
+    mtk_bulk_data_collection_packet_t packet;
+} batch_t;
+
+PROCESS(mtk_bdcrec_proc, "Bulk data collection record batching");
+
+/* Batches never wrap: a record that doesn't fit at the end of the buffer seals
+ * the batch being filled, and starts the next one at the beginning. */
+static uint8_t ring[MTK_BULK_DATA_COLLECTION_REC_BUFFER_BYTES];
+static batch_t batches[MTK_BULK_DATA_COLLECTION_REC_MAX_BATCHES];
+
+/* Batch being filled, from open_start to head */
+static uint16_t open_start;
+static uint16_t head;
+
+static uint16_t next_id;
+static mtk_bdcrec_sealed_callback_t rec_sealed_callback;
+static void* rec_storage;
+static mtk_bdcrec_stats_t rec_stats;
+
+/* Age timer of the batch being filled */
+static struct etimer seal_timer;
+
+static bool region_busy(uint16_t start, uint16_t len);
+
+int mtk_bdcrec_start(uint16_t first_id,
+                     mtk_bdcrec_sealed_callback_t sealed_callback,
+                     void* storage)
+{
+    if (sealed_callback == NULL) {
+        return -1;
+    }
+
+    rec_sealed_callback = sealed_callback;
+    rec_storage = storage;
+    next_id = first_id;
+
+    memset(batches, 0, sizeof(batches));
+    memset(&rec_stats, 0, sizeof(rec_stats));
+    open_start = 0;
+    head = 0;
+
+    /* Kill possibly running batching before starting anew. */
+    process_exit(&mtk_bdcrec_proc);
+    process_start(&mtk_bdcrec_proc, NULL);
+
+    return 0;
+}
+
+int mtk_bdcrec_append(const void* record, uint8_t len)
+{
+    uint16_t frame_len = 1 + len;
+
+    if (len == 0) {
+        return -1;
+    }
+
+    if (head - open_start + frame_len > MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES) {
+        (void)mtk_bdcrec_flush();
+    }
+
+    if (head + frame_len > MTK_BULK_DATA_COLLECTION_REC_BUFFER_BYTES) {
+        if (mtk_bdcrec_flush() == 0) {
+            open_start = 0;
+            head = 0;
+        }
+    }
+
+    /* Sealing fails while all batches are in use, leaving the batch open */
+    if (head - open_start + frame_len > MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES ||
+        head + frame_len > MTK_BULK_DATA_COLLECTION_REC_BUFFER_BYTES ||
+        region_busy(head, frame_len)) {
+        P_DEBUG("%s: buffer full, record dropped\n", __func__);
+        rec_stats.dropped++;
+        return -1;
+    }
+
+    if (head == open_start) {
+        PROCESS_CONTEXT_BEGIN(&mtk_bdcrec_proc);
+        etimer_set(&seal_timer,
+                   (clock_time_t)MTK_BULK_DATA_COLLECTION_REC_SEAL_AGE_MS * CLOCK_SECOND / 1000);
+        PROCESS_CONTEXT_END(&mtk_bdcrec_proc);
+    }
+
+    ring[head] = len;
+    memcpy(&ring[head + 1], record, len);
+    head += frame_len;
+    rec_stats.appended++;
+
+    if (head - open_start >= MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES) {
+        (void)mtk_bdcrec_flush();
+    }
+
+    return 0;
+}
+
+int mtk_bdcrec_flush(void)
+{
+    batch_t* batch = NULL;
+
+    if (head == open_start) {
+        return 0;
+    }
+
+    for (int i = 0; batch == NULL && i < MTK_BULK_DATA_COLLECTION_REC_MAX_BATCHES; ++i) {
+        if (!batches[i].used) {
+            batch = &batches[i];
+        }
+    }
+    if (batch == NULL) {
+        P_DEBUG("%s: all batches in use\n", __func__);
+        return -1;
+    }
+
+    memset(&batch->packet, 0, sizeof(batch->packet));
+    if (mtk_bulk_data_collection_register_tx(
+          &batch->packet, next_id, &ring[open_start], head - open_start) < 0) {
+        P_ERR("%s: mtk_bulk_data_collection_register_tx\n", __func__);
+        return -1;
+    }
+
+    batch->used = true;
+    batch->start = open_start;
+    batch->len = head - open_start;
+    open_start = head;
+    next_id++;
+    rec_stats.sealed++;
+
+    etimer_stop(&seal_timer);
+
+    P_DEBUG("%s: batch %d of %d bytes\n", __func__, batch->packet.id, batch->len);
+
+    rec_sealed_callback(&batch->packet, rec_storage);
+
+    return 0;
+}
+
+void mtk_bdcrec_stats_get(mtk_bdcrec_stats_t* stats)
+{
+    *stats = rec_stats;
+}
+
+void mtk_bdcrec_iter_init(mtk_bdcrec_iter_t* iter, const uint8_t* data, uint16_t len)
+{
+    iter->data = data;
+    iter->len = len;
+    iter->offset = 0;
+}
+
+int mtk_bdcrec_iter_next(mtk_bdcrec_iter_t* iter, const uint8_t** record)
+{
+    if (iter->offset >= iter->len) {
+        return 0;
+    }
+
+    uint8_t len = iter->data[iter->offset];
+    if (len == 0 || iter->offset + 1 + len > iter->len) {
+        return -1;
+    }
+
+    *record = &iter->data[iter->offset + 1];
+    iter->offset += 1 + len;
+
+    return len;
+}
+
+PROCESS_THREAD(mtk_bdcrec_proc, ev, data)
+{
+    PROCESS_BEGIN();
+
+    while (1) {
+        PROCESS_WAIT_EVENT();
+
+        if (ev == event_bdc_released) {
+            for (int i = 0; i < MTK_BULK_DATA_COLLECTION_REC_MAX_BATCHES; ++i) {
+                if (batches[i].used && &batches[i].packet == data) {
+                    batches[i].used = false;
+                }
+            }
+            /* A batch left open for lack of a free one is sealed now if due */
+            if (head != open_start && etimer_expired(&seal_timer)) {
+                (void)mtk_bdcrec_flush();
+            }
+        } else if (ev == PROCESS_EVENT_TIMER && data == &seal_timer) {
+            (void)mtk_bdcrec_flush();
+        }
+    }
+
+    PROCESS_END();
+}
+
+/* Check if records of a sealed batch not yet released are in the region. */
+static bool region_busy(uint16_t start, uint16_t len)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_REC_MAX_BATCHES; ++i) {
+        if (batches[i].used && start < batches[i].start + batches[i].len &&
+            batches[i].start < start + len) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,111 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_RECORDS_H
+#define MTK_BDC_RECORDS_H
+
+/* Function identifier prefix: mtk_bdcrec_ */
+
+#include <mira.h>
+#include <stdint.h>
+
+#include "mtk_bulk_data_collection.h"
+
+/* Size of the ring buffer holding records, both of the batch being filled and
+ * of the batches sealed but not yet released. */
+#ifndef MTK_BULK_DATA_COLLECTION_REC_BUFFER_BYTES
+#define MTK_BULK_DATA_COLLECTION_REC_BUFFER_BYTES (2048)
+#endif
+
+/* A batch is sealed once it holds this many bytes, record lengths included. */
+#ifndef MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES
+#define MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES (1024)
+#endif
+
+/* A batch is sealed once its first record is this old, in ms. */
+#ifndef MTK_BULK_DATA_COLLECTION_REC_SEAL_AGE_MS
+#define MTK_BULK_DATA_COLLECTION_REC_SEAL_AGE_MS (60000)
+#endif
+
+/* Number of sealed batches not yet released at a time. */
+#ifndef MTK_BULK_DATA_COLLECTION_REC_MAX_BATCHES
+#define MTK_BULK_DATA_COLLECTION_REC_MAX_BATCHES (4)
+#endif
+
+/* Records are up to 255 bytes long. A batch is the sequence of its records,
+ * each preceded by its length, on one byte. */
+typedef struct
+{
+    uint32_t appended;
+    uint32_t dropped; /* records not appended as the buffer was full */
+    uint32_t sealed;
+} mtk_bdcrec_stats_t;
+
+/* Called with each sealed batch, registered for sending, see
+ * mtk_bulk_data_collection_register_tx(). Send it as any packet, for example
+ * with mtk_bdctxq_enqueue(). Its records are dropped from the buffer upon
+ * event_bdc_released. */
+typedef void (*mtk_bdcrec_sealed_callback_t)(mtk_bulk_data_collection_packet_t* packet,
+                                             void* storage);
+
+/* Walks the records of a received batch, see mtk_bdcrec_iter_next(). */
+typedef struct
+{
+    const uint8_t* data;
+    uint16_t len;
+    uint16_t offset;
+} mtk_bdcrec_iter_t;
+
+/* Start batching records, with an empty buffer. Batches are given packet ids
+ * from first_id up. The bulk data collection module must be initialized as
+ * sender, or dual. */
+int mtk_bdcrec_start(uint16_t first_id,
+                     mtk_bdcrec_sealed_callback_t sealed_callback,
+                     void* storage);
+
+/* Append a record of len bytes to the batch being filled, sealing it at
+ * MTK_BULK_DATA_COLLECTION_REC_SEAL_BYTES. Fails, counting a dropped record,
+ * if the buffer is full of batches not yet released. */
+int mtk_bdcrec_append(const void* record, uint8_t len);
+
+/* Seal the batch being filled, if it holds any record. */
+int mtk_bdcrec_flush(void);
+
+void mtk_bdcrec_stats_get(mtk_bdcrec_stats_t* stats);
+
+/* Start walking the records of a batch of len bytes, such as the payload of a
+ * received packet. */
+void mtk_bdcrec_iter_init(mtk_bdcrec_iter_t* iter, const uint8_t* data, uint16_t len);
+
+/* Get the next record, pointing to it in the data of the batch, without
+ * copying it. Returns its length, 0 past the last one, or -1 if the batch is
+ * malformed. */
+int mtk_bdcrec_iter_next(mtk_bdcrec_iter_t* iter, const uint8_t** record);
+
+PROCESS_NAME(mtk_bdcrec_proc);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_events.h"
+#include "mtk_bdc_relay.h"
+#include "mtk_bdc_scheduler.h"
+#include "mtk_bdc_txqueue.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+#if MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES >                               \
+  (MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES)
+#error "MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES exceeds the size of a packet"
+#endif
+
+/* Entry header: address of the sender, packet_id and len */
+#define ENTRY_HEADER_SIZE (sizeof(mira_net_address_t) + 2 * sizeof(uint16_t))
+
+typedef struct
+{
+    /* Registered and queued for sending, until released */
+    bool sealed;
+    uint16_t fill;
+    mtk_bulk_data_collection_packet_t packet;
+    uint8_t data[MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES];
+} batch_t;
+
+PROCESS(mtk_bdcrly_proc, "Bulk data collection relay");
+
+static batch_t batches[MTK_BULK_DATA_COLLECTION_RELAY_BATCHES];
+
+/* Batch being filled, NULL while all are sealed */
+static batch_t* open_batch;
+
+/* Packet being collected, received right after the end of open_batch */
+static mtk_bulk_data_collection_packet_t* rx_packet;
+
+/* Set once the batch being filled is due, until it is sealed */
+static bool seal_due;
+
+static mira_net_address_t rly_upstream;
+static uint16_t next_id;
+static uint8_t rly_priority;
+static mtk_bdcrly_stats_t rly_stats;
+
+/* Age timer of the batch being filled */
+static struct etimer seal_timer;
+
+static int relay_setup(mtk_bulk_data_collection_packet_t* packet,
+                       const mtk_bdc_event_signaled_data_t* signal,
+                       void* storage);
+
+static void relay_enqueue(const mtk_bdc_event_signaled_data_t* signal, uint8_t priority);
+
+static uint16_t signal_len_max(const mtk_bdc_event_signaled_data_t* signal);
+
+static void batch_append(const mtk_bulk_data_collection_packet_t* packet);
+
+int mtk_bdcrly_start(const mira_net_address_t* upstream, uint16_t first_id, uint8_t priority)
+{
+    memcpy(&rly_upstream, upstream, sizeof(mira_net_address_t));
+    next_id = first_id;
+    rly_priority = priority;
+
+    memset(batches, 0, sizeof(batches));
+    memset(&rly_stats, 0, sizeof(rly_stats));
+    open_batch = NULL;
+    rx_packet = NULL;
+    seal_due = false;
+
+    if (mtk_bdcsched_start(relay_setup, NULL) < 0) {
+        P_ERR("%s: mtk_bdcsched_start\n", __func__);
+        return -1;
+    }
+    if (mtk_bdctxq_start() < 0) {
+        P_ERR("%s: mtk_bdctxq_start\n", __func__);
+        return -1;
+    }
+
+    /* Kill possibly running relay before starting anew. */
+    process_exit(&mtk_bdcrly_proc);
+    process_start(&mtk_bdcrly_proc, NULL);
+
+    return 0;
+}
+
+int mtk_bdcrly_flush(void)
+{
+    if (open_batch == NULL || open_batch->fill == 0) {
+        return 0;
+    }
+
+    seal_due = true;
+
+    if (rx_packet != NULL) {
+        P_DEBUG("%s: packet %d being collected\n", __func__, rx_packet->id);
+        return -1;
+    }
+
+    memset(&open_batch->packet, 0, sizeof(open_batch->packet));
+    if (mtk_bulk_data_collection_register_tx(
+          &open_batch->packet, next_id, open_batch->data, open_batch->fill) < 0) {
+        P_ERR("%s: mtk_bulk_data_collection_register_tx\n", __func__);
+        return -1;
+    }
+    if (mtk_bdctxq_enqueue(&open_batch->packet, &rly_upstream, rly_priority, 0) < 0) {
+        P_DEBUG("%s: send queue full\n", __func__);
+        return -1;
+    }
+
+    P_DEBUG("%s: batch %d of %d bytes\n", __func__, next_id, open_batch->fill);
+
+    open_batch->sealed = true;
+    open_batch = NULL;
+    seal_due = false;
+    next_id++;
+    rly_stats.sealed++;
+
+    etimer_stop(&seal_timer);
+
+    return 0;
+}
+
+void mtk_bdcrly_stats_get(mtk_bdcrly_stats_t* stats)
+{
+    *stats = rly_stats;
+}
+
+void mtk_bdcrly_iter_init(mtk_bdcrly_iter_t* iter, const uint8_t* data, uint16_t len)
+{
+    iter->data = data;
+    iter->len = len;
+    iter->offset = 0;
+}
+
+int mtk_bdcrly_iter_next(mtk_bdcrly_iter_t* iter, mtk_bdcrly_entry_t* entry)
+{
+    if (iter->offset >= iter->len) {
+        return 0;
+    }
+
+    if (iter->offset + ENTRY_HEADER_SIZE > iter->len) {
+        return -1;
+    }
+
+    const uint8_t* buffer = &iter->data[iter->offset];
+    memcpy(&entry->src, buffer, sizeof(mira_net_address_t));
+    buffer += sizeof(mira_net_address_t);
+    LITTLE_ENDIAN_LOAD(&entry->packet_id, buffer);
+    buffer += sizeof(entry->packet_id);
+    LITTLE_ENDIAN_LOAD(&entry->len, buffer);
+    buffer += sizeof(entry->len);
+
+    if (iter->offset + ENTRY_HEADER_SIZE + entry->len > iter->len) {
+        return -1;
+    }
+
+    entry->data = buffer;
+    iter->offset += ENTRY_HEADER_SIZE + entry->len;
+
+    return 1;
+}
+
+PROCESS_THREAD(mtk_bdcrly_proc, ev, data)
+{
+    PROCESS_BEGIN();
+
+    while (1) {
+        PROCESS_WAIT_EVENT();
+
+        if (ev == event_bdc_signaled_ready) {
+            relay_enqueue(data, 0);
+        } else if (ev == event_bdc_manifest) {
+            const mtk_bdc_event_manifest_data_t* manifest = data;
+
+            for (uint8_t i = 0; i < manifest->n_entries; ++i) {
+                const mtk_bulk_data_collection_manifest_entry_t* entry = &manifest->entries[i];
+                mtk_bdc_event_signaled_data_t signal = {
+                    .n_sub_packets = entry->n_sub_packets,
+                    .packet_id = entry->packet_id,
+                    .flags = MTK_BULK_DATA_COLLECTION_FLAG_LENGTH,
+                    .len = entry->len,
+                    .src_port = manifest->src_port,
+                };
+                memcpy(&signal.src, &manifest->src, sizeof(mira_net_address_t));
+                relay_enqueue(&signal, entry->priority);
+            }
+        } else if ((ev == event_bdc_received || ev == event_bdc_receive_failed) &&
+                   rx_packet != NULL && data == rx_packet) {
+            if (ev == event_bdc_received) {
+                batch_append(rx_packet);
+            }
+            rx_packet = NULL;
+        } else if (ev == event_bdc_released) {
+            for (int i = 0; i < MTK_BULK_DATA_COLLECTION_RELAY_BATCHES; ++i) {
+                if (batches[i].sealed && &batches[i].packet == data) {
+                    batches[i].sealed = false;
+                    batches[i].fill = 0;
+                }
+            }
+        } else if (ev == PROCESS_EVENT_TIMER && data == &seal_timer) {
+            seal_due = true;
+        } else {
+            continue;
+        }
+
+        /* A batch left open while collecting, or with the send queue full */
+        if (seal_due) {
+            (void)mtk_bdcrly_flush();
+        }
+    }
+
+    PROCESS_END();
+}
+
+/* Set up the collection of a signaled packet, see
+ * mtk_bdcsched_setup_callback_t, right after the end of the batch being
+ * filled. Postponed while another packet is being collected, or until a batch
+ * is released. */
+static int relay_setup(mtk_bulk_data_collection_packet_t* packet,
+                       const mtk_bdc_event_signaled_data_t* signal,
+                       void* storage)
+{
+    uint16_t len = signal_len_max(signal);
+
+    if (rx_packet != NULL) {
+        return -1;
+    }
+
+    if (open_batch != NULL &&
+        open_batch->fill + ENTRY_HEADER_SIZE + len > MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES) {
+        (void)mtk_bdcrly_flush();
+    }
+
+    for (int i = 0; open_batch == NULL && i < MTK_BULK_DATA_COLLECTION_RELAY_BATCHES; ++i) {
+        if (!batches[i].sealed) {
+            open_batch = &batches[i];
+            open_batch->fill = 0;
+        }
+    }
+
+    if (open_batch == NULL ||
+        open_batch->fill + ENTRY_HEADER_SIZE + len > MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES) {
+        P_DEBUG("%s: no room for packet %d\n", __func__, signal->packet_id);
+        return -1;
+    }
+
+    packet->payload = &open_batch->data[open_batch->fill + ENTRY_HEADER_SIZE];
+    rx_packet = packet;
+
+    return 0;
+}
+
+/* Queue a signaled packet for collection, unless it comes from upstream, to
+ * which relayed packets go, or doesn't fit in a batch. */
+static void relay_enqueue(const mtk_bdc_event_signaled_data_t* signal, uint8_t priority)
+{
+    if (memcmp(&signal->src, &rly_upstream, sizeof(mira_net_address_t)) == 0 ||
+        (signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST)) {
+        return;
+    }
+
+    if (ENTRY_HEADER_SIZE + signal_len_max(signal) > MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES) {
+        P_DEBUG("%s: packet %d too large\n", __func__, signal->packet_id);
+        rly_stats.oversized++;
+        return;
+    }
+
+    if (mtk_bdcsched_enqueue(signal, priority, 0, 0) < 0) {
+        P_DEBUG("%s: scheduler queue full\n", __func__);
+    }
+}
+
+/* Size of the buffer to receive a signaled packet to. Its length is that of
+ * the whole sub-packets if not signaled. */
+static uint16_t signal_len_max(const mtk_bdc_event_signaled_data_t* signal)
+{
+    if (signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED) {
+        return signal->original_len;
+    }
+    if (signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_LENGTH) {
+        return signal->len;
+    }
+    return signal->n_sub_packets * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+}
+
+/* Write the entry header of a packet received at the end of the batch being
+ * filled, appending it to the batch. */
+static void batch_append(const mtk_bulk_data_collection_packet_t* packet)
+{
+    uint8_t* buffer = &open_batch->data[open_batch->fill];
+
+    if (open_batch->fill + ENTRY_HEADER_SIZE + packet->len >
+        MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES) {
+        P_ERR("%s: packet %d overflows the batch\n", __func__, packet->id);
+        return;
+    }
+
+    memcpy(buffer, &packet->node_addr, sizeof(mira_net_address_t));
+    buffer += sizeof(mira_net_address_t);
+    LITTLE_ENDIAN_STORE(buffer, packet->id);
+    buffer += sizeof(packet->id);
+    LITTLE_ENDIAN_STORE(buffer, packet->len);
+
+    if (open_batch->fill == 0) {
+        etimer_set(&seal_timer,
+                   (clock_time_t)MTK_BULK_DATA_COLLECTION_RELAY_SEAL_AGE_MS * CLOCK_SECOND / 1000);
+    }
+
+    open_batch->fill += ENTRY_HEADER_SIZE + packet->len;
+    rly_stats.relayed++;
+
+    P_DEBUG("%s: packet %d, batch at %d bytes\n", __func__, packet->id, open_batch->fill);
+}
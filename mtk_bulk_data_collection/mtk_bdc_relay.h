@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_RELAY_H
+#define MTK_BDC_RELAY_H
+
+/* Function identifier prefix: mtk_bdcrly_ */
+
+#include <mira.h>
+#include <stdint.h>
+
+#include "mtk_bulk_data_collection.h"
+
+/* Size of a batch of relayed packets, sent upstream as one packet. A signaled
+ * packet larger than a batch, its entry header included, is not relayed. */
+#ifndef MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES
+#define MTK_BULK_DATA_COLLECTION_RELAY_BATCH_BYTES (2048)
+#endif
+
+/* Number of batches, the one being filled and those sent but not yet
+ * released. */
+#ifndef MTK_BULK_DATA_COLLECTION_RELAY_BATCHES
+#define MTK_BULK_DATA_COLLECTION_RELAY_BATCHES (2)
+#endif
+
+/* A batch is sent once its first packet is this old, in ms. */
+#ifndef MTK_BULK_DATA_COLLECTION_RELAY_SEAL_AGE_MS
+#define MTK_BULK_DATA_COLLECTION_RELAY_SEAL_AGE_MS (30000)
+#endif
+
+/* A batch is the sequence of its packets, each preceded by the address of its
+ * sender, its packet id and its length. */
+typedef struct
+{
+    uint32_t relayed;   /* packets collected into batches */
+    uint32_t oversized; /* signaled packets not relayed as larger than a batch */
+    uint32_t sealed;    /* batches queued for sending upstream */
+} mtk_bdcrly_stats_t;
+
+/* Packet of a received batch, see mtk_bdcrly_iter_next() */
+typedef struct
+{
+    mira_net_address_t src;
+    uint16_t packet_id;
+    const uint8_t* data;
+    uint16_t len;
+} mtk_bdcrly_entry_t;
+
+/* Walks the packets of a received batch, see mtk_bdcrly_iter_next(). */
+typedef struct
+{
+    const uint8_t* data;
+    uint16_t len;
+    uint16_t offset;
+} mtk_bdcrly_iter_t;
+
+/* Start relaying, with empty batches. Packets signaled by other nodes than
+ * upstream are collected, one at a time, through the scheduler, see
+ * mtk_bdcsched_start(), and appended to a batch. Batches are sent to upstream
+ * through the send queue with priority, see mtk_bdctxq_start(), which the
+ * application may use for its own packets too, and are given packet ids from
+ * first_id up. The bulk data collection module must be initialized as dual. */
+int mtk_bdcrly_start(const mira_net_address_t* upstream, uint16_t first_id, uint8_t priority);
+
+/* Send the batch being filled, if it holds any packet. Fails while a packet is
+ * being collected into it, or the send queue is full, in which case it is sent
+ * as soon as possible. */
+int mtk_bdcrly_flush(void);
+
+void mtk_bdcrly_stats_get(mtk_bdcrly_stats_t* stats);
+
+/* Start walking the packets of a batch of len bytes, such as the payload of a
+ * received packet. */
+void mtk_bdcrly_iter_init(mtk_bdcrly_iter_t* iter, const uint8_t* data, uint16_t len);
+
+/* Get the next packet, pointing to its data in the batch, without copying it.
+ * Returns 1, 0 past the last one, or -1 if the batch is malformed. */
+int mtk_bdcrly_iter_next(mtk_bdcrly_iter_t* iter, mtk_bdcrly_entry_t* entry);
+
+PROCESS_NAME(mtk_bdcrly_proc);
+
+#endif
@@ -32,33 +32,89 @@
 
 #include "mtk_bulk_data_collection.h"
 #include "mtk_bdc_events.h"
+#include "mtk_bdc_evq.h"
+#include "mtk_bdc_request.h"
 
 #define DEBUG_LEVEL 0
 #include "mtk_bdc_utils.h"
 
 process_event_t event_bdc_requested;
+process_event_t event_bdc_nacked;
+process_event_t event_bdc_unchanged;
+process_event_t event_bdc_acked;
+process_event_t event_bdc_rejected;
 
 static const uint8_t lpreq_header[MTK_BULK_DATA_COLLECTION_HEADER_SIZE] = { 0xf2, 0x2a };
 
+/* Flags of the request message */
+#define LPREQ_FLAG_NACK (0x01)
+#define LPREQ_FLAG_DELTA (0x02)
+#define LPREQ_FLAG_UNCHANGED (0x04)
+#define LPREQ_FLAG_ACK (0x08)
+#define LPREQ_FLAG_BATCH (0x10)
+#define LPREQ_FLAG_REJECT (0x20)
+#define LPREQ_FLAG_SIZE (0x40)
+
+/* Largest request: header, packet_id, mask, period, flags, all sub-packet
+ * hashes, all batched packet ids and the sub-packet size. */
+#define LPREQ_MAX_LEN                                                                  \
+    (sizeof(lpreq_header) + sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint16_t) +   \
+     sizeof(uint8_t) + sizeof(uint8_t) +                                               \
+     MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS * sizeof(uint32_t) +            \
+     sizeof(uint8_t) + MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS * sizeof(uint16_t) + \
+     sizeof(uint16_t))
+
 static mira_net_udp_connection_t* lpreq_udp_connection;
 
-static void lpreq_pack_buffer(uint8_t* buffer,
-                              uint16_t packet_id,
-                              uint64_t mask,
-                              uint16_t period_ms);
+#if MTK_BULK_DATA_COLLECTION_REQUEST_EVENT_SLOTS > MTK_BDCEVQ_MAX_SLOTS
+#error "MTK_BULK_DATA_COLLECTION_REQUEST_EVENT_SLOTS must be at most MTK_BDCEVQ_MAX_SLOTS"
+#endif
+
+static mtk_bdc_event_requested_data_t
+  lpreq_event_slots[MTK_BULK_DATA_COLLECTION_REQUEST_EVENT_SLOTS];
+static mtk_bdcevq_t lpreq_evq = MTK_BDCEVQ_INIT(lpreq_event_slots);
+
+/* Hashes and batch ids of an incoming request, pointed to by the event of
+ * lpreq_lists_owner until it is delivered, so that event slots stay small. */
+static struct
+{
+    uint32_t hashes[MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS];
+    uint16_t batch_ids[MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS];
+} lpreq_lists;
+static const mtk_bdc_event_requested_data_t* lpreq_lists_owner;
+
+/* Requests are built here, as they are too large for the stack with hashes */
+static uint8_t lpreq_tx_buffer[LPREQ_MAX_LEN];
+
+static int lpreq_send(const mira_net_address_t* dst,
+                      const uint16_t dst_port,
+                      const mtk_bdc_event_requested_data_t* info,
+                      const uint8_t flags);
 
-static int lpreq_unpack_buffer(uint16_t* packet_id,
-                               uint64_t* mask,
-                               uint16_t* period_ms,
+static uint16_t lpreq_pack_buffer(uint8_t* buffer,
+                                  const mtk_bdc_event_requested_data_t* info,
+                                  uint8_t flags);
+
+static int lpreq_unpack_buffer(mtk_bdc_event_requested_data_t* info,
+                               uint8_t* flags,
                                const uint8_t* buffer,
-                               uint8_t len);
+                               uint16_t len);
+
+static bool lpreq_lists_take(const mtk_bdc_event_requested_data_t* info);
 
 int mtk_bdcreq_init(mira_net_udp_connection_t* udp_connection)
 {
     event_bdc_requested = process_alloc_event();
+    event_bdc_nacked = process_alloc_event();
+    event_bdc_unchanged = process_alloc_event();
+    event_bdc_acked = process_alloc_event();
+    event_bdc_rejected = process_alloc_event();
 
     lpreq_udp_connection = udp_connection;
 
+    mtk_bdcevq_reset(&lpreq_evq);
+    lpreq_lists_owner = NULL;
+
     return 0;
 }
 
@@ -67,30 +123,157 @@ int mtk_bdcreq_send(const mira_net_address_t* dst,
                     const uint16_t packet_id,
                     const uint64_t sub_packet_mask,
                     const uint16_t sub_packet_period_ms)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+        .mask = sub_packet_mask,
+        .period_ms = sub_packet_period_ms,
+    };
+
+    return lpreq_send(dst, dst_port, &info, 0);
+}
+
+int mtk_bdcreq_send_sized(const mira_net_address_t* dst,
+                          const uint16_t dst_port,
+                          const uint16_t packet_id,
+                          const uint64_t sub_packet_mask,
+                          const uint16_t sub_packet_period_ms,
+                          const uint16_t sub_packet_size)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+        .mask = sub_packet_mask,
+        .period_ms = sub_packet_period_ms,
+        .sub_packet_size = sub_packet_size,
+    };
+
+    /* Without a size, keep the original format */
+    return lpreq_send(dst, dst_port, &info, (sub_packet_size != 0) ? LPREQ_FLAG_SIZE : 0);
+}
+
+int mtk_bdcreq_send_nack(const mira_net_address_t* dst,
+                         const uint16_t dst_port,
+                         const uint16_t packet_id,
+                         const uint64_t sub_packet_mask,
+                         const uint16_t sub_packet_period_ms)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+        .mask = sub_packet_mask,
+        .period_ms = sub_packet_period_ms,
+    };
+
+    return lpreq_send(dst, dst_port, &info, LPREQ_FLAG_NACK);
+}
+
+int mtk_bdcreq_send_delta(const mira_net_address_t* dst,
+                          const uint16_t dst_port,
+                          const uint16_t packet_id,
+                          const uint64_t sub_packet_mask,
+                          const uint16_t sub_packet_period_ms,
+                          const uint8_t n_hashes,
+                          const uint32_t* hashes)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+        .mask = sub_packet_mask,
+        .period_ms = sub_packet_period_ms,
+        .n_hashes = n_hashes,
+        .hashes = hashes,
+    };
+
+    if (n_hashes > MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS) {
+        return -1;
+    }
+
+    return lpreq_send(dst, dst_port, &info, LPREQ_FLAG_DELTA);
+}
+
+int mtk_bdcreq_send_batch(const mira_net_address_t* dst,
+                          const uint16_t dst_port,
+                          const uint16_t packet_id,
+                          const uint64_t sub_packet_mask,
+                          const uint16_t sub_packet_period_ms,
+                          const uint8_t n_batch,
+                          const uint16_t* batch_ids)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+        .mask = sub_packet_mask,
+        .period_ms = sub_packet_period_ms,
+        .n_batch = n_batch,
+        .batch_ids = batch_ids,
+    };
+
+    if (n_batch > MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS) {
+        return -1;
+    }
+
+    return lpreq_send(dst, dst_port, &info, (n_batch > 0) ? LPREQ_FLAG_BATCH : 0);
+}
+
+int mtk_bdcreq_send_unchanged(const mira_net_address_t* dst,
+                              const uint16_t dst_port,
+                              const uint16_t packet_id,
+                              const uint64_t sub_packet_mask)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+        .mask = sub_packet_mask,
+    };
+
+    return lpreq_send(dst, dst_port, &info, LPREQ_FLAG_UNCHANGED);
+}
+
+int mtk_bdcreq_send_ack(const mira_net_address_t* dst,
+                        const uint16_t dst_port,
+                        const uint16_t packet_id)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+    };
+
+    return lpreq_send(dst, dst_port, &info, LPREQ_FLAG_ACK);
+}
+
+int mtk_bdcreq_send_reject(const mira_net_address_t* dst,
+                           const uint16_t dst_port,
+                           const uint16_t packet_id)
+{
+    mtk_bdc_event_requested_data_t info = {
+        .packet_id = packet_id,
+    };
+
+    return lpreq_send(dst, dst_port, &info, LPREQ_FLAG_REJECT);
+}
+
+static int lpreq_send(const mira_net_address_t* dst,
+                      const uint16_t dst_port,
+                      const mtk_bdc_event_requested_data_t* info,
+                      const uint8_t flags)
 {
 #if DEBUG_LEVEL > 0
     char addr_str_buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
 #endif
-    P_DEBUG("Sending lp request to %s: id %d, mask 0x%08" PRIu32 "%08" PRIu32 ", period %d ms\n",
+    P_DEBUG("Sending lp request (flags 0x%02x) to %s: id %d, mask 0x%08" PRIu32 "%08" PRIu32
+            ", period %d ms\n",
+            flags,
             mira_net_toolkit_format_address(addr_str_buffer, dst),
-            packet_id,
-            (uint32_t)(sub_packet_mask >> 32),
-            (uint32_t)(sub_packet_mask & UINT32_MAX),
-            sub_packet_period_ms);
+            info->packet_id,
+            (uint32_t)(info->mask >> 32),
+            (uint32_t)(info->mask & UINT32_MAX),
+            info->period_ms);
 
-    uint8_t request_buffer[sizeof(lpreq_header) + sizeof(packet_id) + sizeof(sub_packet_mask) +
-                           sizeof(sub_packet_period_ms)];
-
-    lpreq_pack_buffer(request_buffer, packet_id, sub_packet_mask, sub_packet_period_ms);
+    uint16_t request_len = lpreq_pack_buffer(lpreq_tx_buffer, info, flags);
 
     P_DEBUG("Request buffer: ");
-    for (int i = 0; i < sizeof(request_buffer); ++i) {
-        P_DEBUG("0x%02x ", request_buffer[i]);
+    for (int i = 0; i < request_len; ++i) {
+        P_DEBUG("0x%02x ", lpreq_tx_buffer[i]);
     }
     P_DEBUG("\n");
 
     mira_status_t ret = mira_net_udp_send_to(
-      lpreq_udp_connection, dst, dst_port, request_buffer, sizeof(request_buffer));
+      lpreq_udp_connection, dst, dst_port, lpreq_tx_buffer, request_len);
 
     if (ret != MIRA_SUCCESS) {
         P_ERR("[%d]: mira_net_udp_send_to\n", ret);
@@ -108,90 +291,265 @@ void mtk_bdcreq_handle_data(const void* data,
         return;
     }
 
-    uint16_t packet_id;
-    uint64_t mask;
-    uint16_t period;
-    if (lpreq_unpack_buffer(&packet_id, &mask, &period, data, data_len) < 0) {
+    /* Post event with data, held until delivered */
+    mtk_bdc_event_requested_data_t* event_data = mtk_bdcevq_alloc(&lpreq_evq);
+    if (event_data == NULL) {
+        P_ERR("%s: no event slot, request dropped\n", __func__);
+        return;
+    }
+    if (lpreq_lists_owner == event_data ||
+        (lpreq_lists_owner != NULL && !mtk_bdcevq_holds(&lpreq_evq, lpreq_lists_owner))) {
+        /* Event of the lists delivered, or its slot cancelled */
+        lpreq_lists_owner = NULL;
+    }
+
+    uint8_t flags;
+    if (lpreq_unpack_buffer(event_data, &flags, data, data_len) < 0) {
         P_ERR("%s: lpreq_unpack_buffer\n", __func__);
+        mtk_bdcevq_cancel(&lpreq_evq);
         return;
     }
 
     P_DEBUG("Request received for packet id %d, mask: 0x%08" PRIu32 "%08" PRIu32
-            ", period: %d ms\n",
-            packet_id,
-            (uint32_t)(mask >> 32),
-            (uint32_t)(mask & UINT32_MAX),
-            period);
-
-    /* Post event with data */
-    static mtk_bdc_event_requested_data_t lpreq_event_data;
-    lpreq_event_data = (mtk_bdc_event_requested_data_t){
-        .packet_id = packet_id,
-        .mask = mask,
-        .period_ms = period,
-        .src_port = metadata->source_port,
-    };
-    memcpy(&lpreq_event_data.src, metadata->source_address, sizeof(mira_net_address_t));
+            ", period: %d ms, flags 0x%02x\n",
+            event_data->packet_id,
+            (uint32_t)(event_data->mask >> 32),
+            (uint32_t)(event_data->mask & UINT32_MAX),
+            event_data->period_ms,
+            flags);
+
+    event_data->src_port = metadata->source_port;
+    memcpy(&event_data->src, metadata->source_address, sizeof(mira_net_address_t));
+
+    /* NACKs only concern the running transmission, and are kept apart from
+     * requests handled by the application. Likewise, notices of unchanged
+     * sub-packets only concern the running reception. */
+    process_event_t ev = event_bdc_requested;
+    if (flags & LPREQ_FLAG_NACK) {
+        ev = event_bdc_nacked;
+    } else if (flags & LPREQ_FLAG_UNCHANGED) {
+        ev = event_bdc_unchanged;
+    } else if (flags & LPREQ_FLAG_ACK) {
+        ev = event_bdc_acked;
+    } else if (flags & LPREQ_FLAG_REJECT) {
+        ev = event_bdc_rejected;
+    }
 
     /* TODO: post to specific processes instead of broadcast? */
-    if (process_post(PROCESS_BROADCAST, event_bdc_requested, &lpreq_event_data) != PROCESS_ERR_OK) {
-        P_ERR("%s: process_post!\n", __func__);
+    if (mtk_bdcevq_post(&lpreq_evq, ev) < 0) {
+        P_ERR("%s: mtk_bdcevq_post\n", __func__);
         return;
     }
 }
 
+void mtk_bdcreq_event_stats_get(mtk_bdcevq_stats_t* stats)
+{
+    mtk_bdcevq_stats_get(&lpreq_evq, stats);
+}
+
 /* Large packet request format:
  *
  *  +-------------------+----------------------+----------------+------------------+
- *  | header  (16 bits) |  packet_id (16_bits) | mask (64 bits) | period (16 bits) |
+ *  | header  (16 bits) |  packet_id (16_bits) | mask (64 bits) | period (16 bits) | ...
  *  +-------------------+----------------------+----------------+------------------+
  *
- * Little endian.
+ *  +-----------------+-------------------------------------------------------------+
+ *  | flags  (8 bits) | n_hashes (8 bits), hashes (32 bits each), if FLAG_DELTA set | ...
+ *  +-----------------+-------------------------------------------------------------+
+ *
+ *  +------------------------------------------------------------------+
+ *  | n_batch (8 bits), batch_ids (16 bits each), if FLAG_BATCH is set | ...
+ *  +------------------------------------------------------------------+
+ *
+ *  +------------------------------------------------+
+ *  | sub_packet_size (16 bits), if FLAG_SIZE is set |
+ *  +------------------------------------------------+
+ *
+ * Little endian. flags and the fields following it are optional, requests
+ * without it have no flag set. hashes are those of sub-packets 0 to
+ * n_hashes - 1.
  */
 
-static void lpreq_pack_buffer(uint8_t* buffer,
-                              uint16_t packet_id,
-                              uint64_t mask,
-                              uint16_t period_ms)
+static uint16_t lpreq_pack_buffer(uint8_t* buffer,
+                                  const mtk_bdc_event_requested_data_t* info,
+                                  uint8_t flags)
 {
+    uint8_t* start = buffer;
+
     memcpy(buffer, lpreq_header, sizeof(lpreq_header));
     buffer += sizeof(lpreq_header);
 
-    LITTLE_ENDIAN_STORE(buffer, packet_id);
-    buffer += sizeof(packet_id);
+    LITTLE_ENDIAN_STORE(buffer, info->packet_id);
+    buffer += sizeof(info->packet_id);
+
+    LITTLE_ENDIAN_STORE(buffer, info->mask);
+    buffer += sizeof(info->mask);
+
+    LITTLE_ENDIAN_STORE(buffer, info->period_ms);
+    buffer += sizeof(info->period_ms);
+
+    /* Without flags, keep the original format understood by all receivers */
+    if (flags == 0) {
+        return buffer - start;
+    }
+
+    LITTLE_ENDIAN_STORE(buffer, flags);
+    buffer += sizeof(flags);
 
-    LITTLE_ENDIAN_STORE(buffer, mask);
-    buffer += sizeof(mask);
+    if (flags & LPREQ_FLAG_DELTA) {
+        LITTLE_ENDIAN_STORE(buffer, info->n_hashes);
+        buffer += sizeof(info->n_hashes);
 
-    LITTLE_ENDIAN_STORE(buffer, period_ms);
-    buffer += sizeof(period_ms);
+        /* Through locals, LITTLE_ENDIAN_STORE() and LITTLE_ENDIAN_LOAD()
+         * having their own index i */
+        for (uint8_t i = 0; i < info->n_hashes; ++i) {
+            uint32_t hash = info->hashes[i];
+            LITTLE_ENDIAN_STORE(buffer, hash);
+            buffer += sizeof(hash);
+        }
+    }
+
+    if (flags & LPREQ_FLAG_BATCH) {
+        LITTLE_ENDIAN_STORE(buffer, info->n_batch);
+        buffer += sizeof(info->n_batch);
+
+        for (uint8_t i = 0; i < info->n_batch; ++i) {
+            uint16_t batch_id = info->batch_ids[i];
+            LITTLE_ENDIAN_STORE(buffer, batch_id);
+            buffer += sizeof(batch_id);
+        }
+    }
+
+    if (flags & LPREQ_FLAG_SIZE) {
+        LITTLE_ENDIAN_STORE(buffer, info->sub_packet_size);
+        buffer += sizeof(info->sub_packet_size);
+    }
+
+    return buffer - start;
 }
 
-static int lpreq_unpack_buffer(uint16_t* packet_id,
-                               uint64_t* mask,
-                               uint16_t* period_ms,
+static int lpreq_unpack_buffer(mtk_bdc_event_requested_data_t* info,
+                               uint8_t* flags,
                                const uint8_t* buffer,
-                               uint8_t len)
+                               uint16_t len)
 {
-    if ((packet_id == NULL) || (mask == NULL) || (period_ms == NULL) || (buffer == NULL)) {
+    if ((info == NULL) || (flags == NULL) || (buffer == NULL)) {
         P_ERR("%s: pointer error!\n", __func__);
         return -1;
     }
-    if (len != sizeof(lpreq_header) + sizeof(*packet_id) + sizeof(*mask) + sizeof(*period_ms)) {
+
+    const uint16_t base_len =
+      sizeof(lpreq_header) + sizeof(info->packet_id) + sizeof(info->mask) + sizeof(info->period_ms);
+    if (len < base_len) {
         P_ERR("%s: wrong lp request packet size (%d)!\n", __func__, len);
         return -1;
     }
 
     buffer += sizeof(lpreq_header);
 
-    LITTLE_ENDIAN_LOAD(packet_id, buffer);
-    buffer += sizeof(*packet_id);
-
-    LITTLE_ENDIAN_LOAD(mask, buffer);
-    buffer += sizeof(*mask);
+    LITTLE_ENDIAN_LOAD(&info->packet_id, buffer);
+    buffer += sizeof(info->packet_id);
+
+    LITTLE_ENDIAN_LOAD(&info->mask, buffer);
+    buffer += sizeof(info->mask);
+
+    LITTLE_ENDIAN_LOAD(&info->period_ms, buffer);
+    buffer += sizeof(info->period_ms);
+
+    uint16_t expected_len = base_len;
+    *flags = 0;
+    info->n_hashes = 0;
+    info->hashes = NULL;
+    info->n_batch = 0;
+    info->batch_ids = NULL;
+    info->sub_packet_size = 0;
+
+    if (len > base_len) {
+        LITTLE_ENDIAN_LOAD(flags, buffer);
+        buffer += sizeof(*flags);
+        expected_len += sizeof(*flags);
+
+        if (*flags & LPREQ_FLAG_DELTA) {
+            if (len < expected_len + sizeof(info->n_hashes)) {
+                P_ERR("%s: wrong lp request packet size (%d)!\n", __func__, len);
+                return -1;
+            }
+            LITTLE_ENDIAN_LOAD(&info->n_hashes, buffer);
+            buffer += sizeof(info->n_hashes);
+            expected_len += sizeof(info->n_hashes) + info->n_hashes * sizeof(info->hashes[0]);
+
+            if (info->n_hashes > MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS ||
+                len < expected_len) {
+                P_ERR("%s: wrong number of hashes (%d)!\n", __func__, info->n_hashes);
+                return -1;
+            }
+
+            if (!lpreq_lists_take(info)) {
+                return -1;
+            }
+            for (uint8_t i = 0; i < info->n_hashes; ++i) {
+                uint32_t hash;
+                LITTLE_ENDIAN_LOAD(&hash, buffer);
+                buffer += sizeof(hash);
+                lpreq_lists.hashes[i] = hash;
+            }
+            info->hashes = lpreq_lists.hashes;
+        }
+
+        if (*flags & LPREQ_FLAG_BATCH) {
+            if (len < expected_len + sizeof(info->n_batch)) {
+                P_ERR("%s: wrong lp request packet size (%d)!\n", __func__, len);
+                return -1;
+            }
+            LITTLE_ENDIAN_LOAD(&info->n_batch, buffer);
+            buffer += sizeof(info->n_batch);
+            expected_len += sizeof(info->n_batch) + info->n_batch * sizeof(info->batch_ids[0]);
+
+            if (info->n_batch > MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS || len < expected_len) {
+                P_ERR("%s: wrong number of batched packets (%d)!\n", __func__, info->n_batch);
+                return -1;
+            }
+
+            if (!lpreq_lists_take(info)) {
+                return -1;
+            }
+            for (uint8_t i = 0; i < info->n_batch; ++i) {
+                uint16_t batch_id;
+                LITTLE_ENDIAN_LOAD(&batch_id, buffer);
+                buffer += sizeof(batch_id);
+                lpreq_lists.batch_ids[i] = batch_id;
+            }
+            info->batch_ids = lpreq_lists.batch_ids;
+        }
+
+        if (*flags & LPREQ_FLAG_SIZE) {
+            expected_len += sizeof(info->sub_packet_size);
+            if (len < expected_len) {
+                P_ERR("%s: wrong lp request packet size (%d)!\n", __func__, len);
+                return -1;
+            }
+            LITTLE_ENDIAN_LOAD(&info->sub_packet_size, buffer);
+            buffer += sizeof(info->sub_packet_size);
+        }
+    }
 
-    LITTLE_ENDIAN_LOAD(period_ms, buffer);
-    buffer += sizeof(*period_ms);
+    if (len != expected_len) {
+        P_ERR("%s: wrong lp request packet size (%d)!\n", __func__, len);
+        return -1;
+    }
 
     return 0;
 }
+
+/* Take lpreq_lists for the request unpacked to info, failing if the event of
+ * another request still points to it. */
+static bool lpreq_lists_take(const mtk_bdc_event_requested_data_t* info)
+{
+    if (lpreq_lists_owner != NULL && lpreq_lists_owner != info) {
+        P_ERR("%s: lists of another request not delivered yet\n", __func__);
+        return false;
+    }
+
+    lpreq_lists_owner = info;
+    return true;
+}
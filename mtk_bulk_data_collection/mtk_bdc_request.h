@@ -33,6 +33,14 @@
 #include <stdint.h>
 
 #include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_evq.h"
+
+/* Number of incoming requests held until their event is delivered. Further
+ * requests are dropped meanwhile. Each costs the size of
+ * mtk_bdc_event_requested_data_t. */
+#ifndef MTK_BULK_DATA_COLLECTION_REQUEST_EVENT_SLOTS
+#define MTK_BULK_DATA_COLLECTION_REQUEST_EVENT_SLOTS (2)
+#endif
 
 int mtk_bdcreq_init(mira_net_udp_connection_t* udp_connection);
 
@@ -43,10 +51,72 @@ int mtk_bdcreq_send(const mira_net_address_t* dst,
                     const uint64_t sub_packet_mask,
                     const uint16_t sub_packet_period_ms);
 
+/* Send a negative acknowledgement for sub-packets found missing while the
+ * transfer is still running. The sender adds them to the sub-packets it is
+ * currently sending, see event_bdc_nacked. */
+int mtk_bdcreq_send_nack(const mira_net_address_t* dst,
+                         const uint16_t port,
+                         const uint16_t packet_id,
+                         const uint64_t sub_packet_mask,
+                         const uint16_t sub_packet_period_ms);
+
+/* Send a request for the sub-packets of sub_packet_mask that differ from those
+ * the receiver already holds. hashes are those of sub-packets 0 to n_hashes - 1
+ * held by the receiver: CRC-32 of the data followed by its 16 bit length. */
+int mtk_bdcreq_send_delta(const mira_net_address_t* dst,
+                          const uint16_t port,
+                          const uint16_t packet_id,
+                          const uint64_t sub_packet_mask,
+                          const uint16_t sub_packet_period_ms,
+                          const uint8_t n_hashes,
+                          const uint32_t* hashes);
+
+/* Send a request for large packet, in sub-packets of sub_packet_size bytes
+ * instead of MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES. Indexes of
+ * sub_packet_mask refer to sub-packets of that size. 0 requests the default
+ * size, as mtk_bdcreq_send(). */
+int mtk_bdcreq_send_sized(const mira_net_address_t* dst,
+                          const uint16_t port,
+                          const uint16_t packet_id,
+                          const uint64_t sub_packet_mask,
+                          const uint16_t sub_packet_period_ms,
+                          const uint16_t sub_packet_size);
+
+/* Send a request for large packet, followed by the n_batch packets of
+ * batch_ids, sent whole and back to back. See event_bdc_requested. */
+int mtk_bdcreq_send_batch(const mira_net_address_t* dst,
+                          const uint16_t port,
+                          const uint16_t packet_id,
+                          const uint64_t sub_packet_mask,
+                          const uint16_t sub_packet_period_ms,
+                          const uint8_t n_batch,
+                          const uint16_t* batch_ids);
+
+/* Tell the receiver of a delta request which of the requested sub-packets are
+ * unchanged, and won't be sent. See event_bdc_unchanged. */
+int mtk_bdcreq_send_unchanged(const mira_net_address_t* dst,
+                              const uint16_t port,
+                              const uint16_t packet_id,
+                              const uint64_t sub_packet_mask);
+
+/* Acknowledge to the sender that the packet is already held, in place of
+ * requesting it. See event_bdc_acked. */
+int mtk_bdcreq_send_ack(const mira_net_address_t* dst,
+                        const uint16_t port,
+                        const uint16_t packet_id);
+
+/* Reject a pushed packet, stopping its transfer. See event_bdc_rejected. */
+int mtk_bdcreq_send_reject(const mira_net_address_t* dst,
+                           const uint16_t port,
+                           const uint16_t packet_id);
+
 /* Handle incoming data, if relevant. This function first tests if the data is a
  * valid request message. If it is, it acts by posting an event. */
 void mtk_bdcreq_handle_data(const void* data,
                             const uint16_t data_len,
                             const mira_net_udp_callback_metadata_t* metadata);
 
+/* Get statistics of the events posted for incoming requests. */
+void mtk_bdcreq_event_stats_get(mtk_bdcevq_stats_t* stats);
+
 #endif
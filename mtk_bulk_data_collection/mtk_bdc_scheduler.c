@@ -0,0 +1,513 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_events.h"
+#include "mtk_bdc_estimator.h"
+#include "mtk_bdc_request.h"
+#include "mtk_bdc_scheduler.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+#if MTK_BULK_DATA_COLLECTION_SCHED_MAX_ACTIVE > MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS
+#error "MTK_BULK_DATA_COLLECTION_SCHED_MAX_ACTIVE exceeds MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS"
+#endif
+
+#define MS_TO_TICKS(ms) ((clock_time_t)(ms) * CLOCK_SECOND / 1000)
+
+/* Times are kept as start and duration rather than deadlines, so that
+ * comparisons of ages hold across wrap-around. */
+typedef struct
+{
+    bool used;
+    mtk_bdc_event_signaled_data_t signal;
+    uint8_t priority;
+    uint8_t hop_count;
+    uint16_t route_id;
+    clock_time_t enqueue_time;
+    uint8_t attempts;
+    /* Not collected until wait has elapsed since wait_start */
+    clock_time_t wait_start;
+    clock_time_t wait;
+    /* Packet being collected, NULL while waiting */
+    mtk_bulk_data_collection_packet_t* packet;
+} entry_t;
+
+typedef struct
+{
+    uint16_t route_id;
+    clock_time_t last_end;
+} route_t;
+
+PROCESS(mtk_bdcsched_proc, "Bulk data collection scheduler");
+
+static entry_t entries[MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE];
+static mtk_bulk_data_collection_packet_t packets[MTK_BULK_DATA_COLLECTION_SCHED_MAX_ACTIVE];
+
+/* End of the last collection on recently used routes. route_id 0 is free. */
+static route_t routes[MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE];
+
+static mtk_bdcsched_setup_callback_t sched_setup_callback;
+static void* sched_storage;
+static mtk_bdcsched_stats_t sched_stats;
+
+static clock_time_t schedule(void);
+
+static int entry_start(entry_t* entry);
+
+static void entry_end(entry_t* entry, bool received);
+
+static entry_t* entry_find(const mira_net_address_t* addr, uint16_t packet_id);
+
+static bool entry_ranks_before(const entry_t* a, const entry_t* b, clock_time_t now);
+
+static bool entry_ready(const entry_t* entry, clock_time_t now, clock_time_t* wait);
+
+static mtk_bulk_data_collection_packet_t* packet_free_get(void);
+
+static route_t* route_get(uint16_t route_id, bool create);
+
+static void push_reject(const mtk_bdc_event_signaled_data_t* signal);
+
+int mtk_bdcsched_start(mtk_bdcsched_setup_callback_t setup_callback, void* storage)
+{
+    if (setup_callback == NULL) {
+        return -1;
+    }
+
+    sched_setup_callback = setup_callback;
+    sched_storage = storage;
+
+    memset(entries, 0, sizeof(entries));
+    memset(routes, 0, sizeof(routes));
+    memset(&sched_stats, 0, sizeof(sched_stats));
+
+    /* Kill possibly running scheduler before starting anew. */
+    process_exit(&mtk_bdcsched_proc);
+    process_start(&mtk_bdcsched_proc, NULL);
+
+    return 0;
+}
+
+int mtk_bdcsched_enqueue(const mtk_bdc_event_signaled_data_t* signal,
+                         uint8_t priority,
+                         uint8_t hop_count,
+                         uint16_t route_id)
+{
+    clock_time_t now = clock_time();
+    entry_t* entry = entry_find(&signal->src, signal->packet_id);
+
+    if (entry != NULL && entry->packet != NULL) {
+        /* Being collected */
+        return 0;
+    }
+
+    entry_t new_entry = {
+        .used = true,
+        .signal = *signal,
+        .priority = priority,
+        .hop_count = hop_count,
+        .route_id = route_id,
+        .enqueue_time = now,
+    };
+
+    if (entry != NULL) {
+        /* Signaled again, keeping its place in the queue */
+        new_entry.enqueue_time = entry->enqueue_time;
+        new_entry.attempts = entry->attempts;
+        new_entry.wait_start = entry->wait_start;
+        new_entry.wait = entry->wait;
+    } else {
+        for (int i = 0; entry == NULL && i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+            if (!entries[i].used) {
+                entry = &entries[i];
+            }
+        }
+    }
+
+    if (entry == NULL) {
+        /* Full: replace the lowest ranked waiting packet, if it ranks lower */
+        entry_t* victim = NULL;
+        for (int i = 0; i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+            if (entries[i].packet == NULL &&
+                (victim == NULL || entry_ranks_before(victim, &entries[i], now))) {
+                victim = &entries[i];
+            }
+        }
+        sched_stats.dropped++;
+        if (victim == NULL || !entry_ranks_before(&new_entry, victim, now)) {
+            P_DEBUG("%s: queue full, packet %d dropped\n", __func__, signal->packet_id);
+            if (signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_PUSH) {
+                push_reject(signal);
+            }
+            return -1;
+        }
+        P_DEBUG("%s: queue full, packet %d dropped\n", __func__, victim->signal.packet_id);
+        entry = victim;
+    }
+
+    *entry = new_entry;
+
+    if (signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_PUSH) {
+        /* Pushed data is already on its way, and is either taken at once or
+         * rejected, to be collected as signaled packets later on. A duplicate,
+         * acknowledged instead, is not rejected. */
+        if (packet_free_get() == NULL || entry_start(entry) < 0) {
+            push_reject(signal);
+        }
+        entry->signal.flags &= ~MTK_BULK_DATA_COLLECTION_FLAG_PUSH;
+    }
+
+    process_poll(&mtk_bdcsched_proc);
+
+    return 0;
+}
+
+int mtk_bdcsched_enqueue_manifest(const mtk_bdc_event_manifest_data_t* manifest,
+                                  uint8_t hop_count,
+                                  uint16_t route_id)
+{
+    int n_queued = 0;
+
+    for (uint8_t i = 0; i < manifest->n_entries; ++i) {
+        const mtk_bulk_data_collection_manifest_entry_t* entry = &manifest->entries[i];
+        mtk_bdc_event_signaled_data_t signal = {
+            .n_sub_packets = entry->n_sub_packets,
+            .packet_id = entry->packet_id,
+            .flags = MTK_BULK_DATA_COLLECTION_FLAG_LENGTH,
+            .len = entry->len,
+            .src_port = manifest->src_port,
+        };
+        memcpy(&signal.src, &manifest->src, sizeof(mira_net_address_t));
+
+        if (mtk_bdcsched_enqueue(&signal, entry->priority, hop_count, route_id) == 0) {
+            n_queued++;
+        }
+    }
+
+    return n_queued;
+}
+
+void mtk_bdcsched_stats_get(mtk_bdcsched_stats_t* stats)
+{
+    *stats = sched_stats;
+    stats->queue_depth = 0;
+    stats->active = 0;
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+        if (!entries[i].used) {
+            continue;
+        }
+        if (entries[i].packet != NULL) {
+            stats->active++;
+        } else {
+            stats->queue_depth++;
+        }
+    }
+}
+
+PROCESS_THREAD(mtk_bdcsched_proc, ev, data)
+{
+    static struct etimer timer;
+
+    PROCESS_BEGIN();
+
+    while (1) {
+        PROCESS_WAIT_EVENT();
+
+        if (ev == event_bdc_received || ev == event_bdc_receive_failed) {
+            for (int i = 0; i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+                if (entries[i].used && entries[i].packet == data) {
+                    entry_end(&entries[i], ev == event_bdc_received);
+                }
+            }
+            /* Reuse the packet once all processes have handled the event */
+            process_poll(&mtk_bdcsched_proc);
+        } else if (ev == PROCESS_EVENT_POLL || (ev == PROCESS_EVENT_TIMER && data == &timer)) {
+            clock_time_t wait = schedule();
+            if (wait > 0) {
+                etimer_set(&timer, wait);
+            } else {
+                etimer_stop(&timer);
+            }
+        }
+    }
+
+    PROCESS_END();
+}
+
+/* Start the best ranked packets that are ready, as long as collections are
+ * available. Returns the time until the next waiting packet is ready, or 0. */
+static clock_time_t schedule(void)
+{
+    clock_time_t now = clock_time();
+    clock_time_t next_wait = 0;
+
+    while (packet_free_get() != NULL) {
+        entry_t* best = NULL;
+
+        for (int i = 0; i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+            entry_t* entry = &entries[i];
+            if (!entry->used || entry->packet != NULL) {
+                continue;
+            }
+
+            clock_time_t wait;
+            if (!entry_ready(entry, now, &wait)) {
+                if (wait > 0 && (next_wait == 0 || wait < next_wait)) {
+                    next_wait = wait;
+                }
+                continue;
+            }
+
+            if (best == NULL || entry_ranks_before(entry, best, now)) {
+                best = entry;
+            }
+        }
+
+        if (best == NULL) {
+            break;
+        }
+
+        if (entry_start(best) < 0) {
+            P_DEBUG("%s: packet %d postponed\n", __func__, best->signal.packet_id);
+            best->wait_start = now;
+            best->wait = MS_TO_TICKS(MTK_BULK_DATA_COLLECTION_SCHED_BACKOFF_MS);
+            if (next_wait == 0 || best->wait < next_wait) {
+                next_wait = best->wait;
+            }
+        }
+    }
+
+    return next_wait;
+}
+
+static int entry_start(entry_t* entry)
+{
+    mtk_bulk_data_collection_packet_t* packet = packet_free_get();
+    const mtk_bdc_event_signaled_data_t* signal = &entry->signal;
+
+    memset(packet, 0, sizeof(*packet));
+    packet->id = signal->packet_id;
+    packet->num_sub_packets = signal->n_sub_packets;
+    memcpy(&packet->node_addr, &signal->src, sizeof(mira_net_address_t));
+    packet->node_port = signal->src_port;
+    packet->period_ms = MTK_BULK_DATA_COLLECTION_SCHED_PERIOD_MS;
+    if (signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_PUSH) {
+        packet->period_ms = signal->period_ms;
+    }
+    packet->flags = signal->flags;
+    packet->content_hash = signal->content_hash;
+    packet->original_len = signal->original_len;
+    packet->compressed_len = signal->compressed_len;
+
+    if ((signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_LENGTH) &&
+        mtk_bulk_data_collection_dedup(packet, signal->len)) {
+        sched_stats.duplicates++;
+        entry->used = false;
+        return 0;
+    }
+
+    /* Small sub-packets over lossy paths, if the length is known */
+    if ((signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_LENGTH) &&
+        !(signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_PUSH)) {
+        (void)mtk_bulk_data_collection_sub_packet_size_set(
+          packet,
+          mtk_bulk_data_collection_sub_packet_size_choose(&signal->src, signal->len),
+          signal->len);
+    }
+
+    if (sched_setup_callback(packet, signal, sched_storage) < 0) {
+        return -1;
+    }
+
+    entry->packet = packet;
+    entry->attempts++;
+
+    P_DEBUG("%s: collecting packet %d, attempt %d\n",
+            __func__,
+            signal->packet_id,
+            entry->attempts);
+
+    int ret;
+    if (signal->flags & MTK_BULK_DATA_COLLECTION_FLAG_PUSH) {
+        /* All sub-packets are on their way, nothing to request */
+        ret = mtk_bulk_data_collection_receive_start(packet);
+    } else {
+        ret = mtk_bulk_data_collection_collect(packet);
+    }
+    if (ret < 0) {
+        P_ERR("%s: starting reception\n", __func__);
+        /* Ends as any failed collection, releasing what was set up */
+        if (process_post(PROCESS_BROADCAST, event_bdc_receive_failed, packet) != PROCESS_ERR_OK) {
+            P_ERR("%s: process_post event_bdc_receive_failed\n", __func__);
+        }
+    }
+
+    return 0;
+}
+
+static void entry_end(entry_t* entry, bool received)
+{
+    clock_time_t now = clock_time();
+
+    if (entry->route_id != 0) {
+        route_get(entry->route_id, true)->last_end = now;
+    }
+    entry->packet = NULL;
+
+    if (received) {
+        mtk_bdcest_collection_done(&entry->signal.src, now - entry->enqueue_time);
+        sched_stats.completed++;
+        entry->used = false;
+        return;
+    }
+
+    if (entry->attempts >= MTK_BULK_DATA_COLLECTION_SCHED_MAX_ATTEMPTS) {
+        P_DEBUG("%s: packet %d given up\n", __func__, entry->signal.packet_id);
+        sched_stats.failed++;
+        entry->used = false;
+        return;
+    }
+
+    sched_stats.retries++;
+    entry->wait_start = now;
+    entry->wait = MS_TO_TICKS(MTK_BULK_DATA_COLLECTION_SCHED_BACKOFF_MS)
+                  << (entry->attempts - 1);
+}
+
+static entry_t* entry_find(const mira_net_address_t* addr, uint16_t packet_id)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+        if (entries[i].used && entries[i].signal.packet_id == packet_id &&
+            memcmp(&entries[i].signal.src, addr, sizeof(mira_net_address_t)) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static bool entry_ranks_before(const entry_t* a, const entry_t* b, clock_time_t now)
+{
+    clock_time_t aging = MS_TO_TICKS(MTK_BULK_DATA_COLLECTION_SCHED_AGING_MS);
+    clock_time_t age_a = now - a->enqueue_time;
+    clock_time_t age_b = now - b->enqueue_time;
+    uint32_t priority_a = a->priority + age_a / aging;
+    uint32_t priority_b = b->priority + age_b / aging;
+
+    if (priority_a != priority_b) {
+        return priority_a > priority_b;
+    }
+    if (a->hop_count != b->hop_count) {
+        return a->hop_count < b->hop_count;
+    }
+    return age_a > age_b;
+}
+
+/* Check if the packet may be collected: after its backoff, and with its route
+ * idle for long enough. Otherwise, wait is set to the time until it may be, or
+ * 0 if that is when the collection on its route ends. */
+static bool entry_ready(const entry_t* entry, clock_time_t now, clock_time_t* wait)
+{
+    *wait = 0;
+
+    if (entry->route_id != 0) {
+        for (int i = 0; i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+            if (entries[i].used && entries[i].packet != NULL &&
+                entries[i].route_id == entry->route_id) {
+                return false;
+            }
+        }
+
+        route_t* route = route_get(entry->route_id, false);
+        clock_time_t spacing = MS_TO_TICKS(MTK_BULK_DATA_COLLECTION_SCHED_ROUTE_SPACING_MS);
+        if (route != NULL && now - route->last_end < spacing) {
+            *wait = spacing - (now - route->last_end);
+        }
+    }
+
+    if (now - entry->wait_start < entry->wait &&
+        entry->wait - (now - entry->wait_start) > *wait) {
+        *wait = entry->wait - (now - entry->wait_start);
+    }
+
+    return *wait == 0;
+}
+
+static mtk_bulk_data_collection_packet_t* packet_free_get(void)
+{
+    for (int p = 0; p < MTK_BULK_DATA_COLLECTION_SCHED_MAX_ACTIVE; ++p) {
+        bool used = false;
+        for (int i = 0; !used && i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+            used = entries[i].used && entries[i].packet == &packets[p];
+        }
+        if (!used) {
+            return &packets[p];
+        }
+    }
+    return NULL;
+}
+
+/* Route of route_id, or if create, the route ended the longest ago replaced. */
+static route_t* route_get(uint16_t route_id, bool create)
+{
+    clock_time_t now = clock_time();
+    route_t* victim = &routes[0];
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE; ++i) {
+        if (routes[i].route_id == route_id) {
+            return &routes[i];
+        }
+        if (routes[i].route_id == 0) {
+            victim = &routes[i];
+        } else if (victim->route_id != 0 &&
+                   now - routes[i].last_end > now - victim->last_end) {
+            victim = &routes[i];
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    victim->route_id = route_id;
+    return victim;
+}
+
+/* Reject a pushed packet, for the sender to stop pushing it. */
+static void push_reject(const mtk_bdc_event_signaled_data_t* signal)
+{
+    P_DEBUG("%s: pushed packet %d rejected\n", __func__, signal->packet_id);
+    if (mtk_bdcreq_send_reject(&signal->src, signal->src_port, signal->packet_id) < 0) {
+        P_ERR("%s: mtk_bdcreq_send_reject\n", __func__);
+    }
+}
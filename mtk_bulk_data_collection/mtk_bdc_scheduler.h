@@ -0,0 +1,132 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_SCHEDULER_H
+#define MTK_BDC_SCHEDULER_H
+
+/* Function identifier prefix: mtk_bdcsched_ */
+
+#include <mira.h>
+#include <stdint.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_events.h"
+
+/* Number of signaled packets waiting to be collected. When full, a new signal
+ * replaces the lowest ranked waiting packet if it ranks higher, and is dropped
+ * otherwise. */
+#ifndef MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE
+#define MTK_BULK_DATA_COLLECTION_SCHED_QUEUE_SIZE (8)
+#endif
+
+/* Number of packets collected at a time, at most
+ * MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS. */
+#ifndef MTK_BULK_DATA_COLLECTION_SCHED_MAX_ACTIVE
+#define MTK_BULK_DATA_COLLECTION_SCHED_MAX_ACTIVE MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS
+#endif
+
+/* Sub-packet period requested, in ms. The setup callback may change it. */
+#ifndef MTK_BULK_DATA_COLLECTION_SCHED_PERIOD_MS
+#define MTK_BULK_DATA_COLLECTION_SCHED_PERIOD_MS (50)
+#endif
+
+/* Time from the end of a collection to the start of the next one on the same
+ * route, in ms, for the traffic of the previous one to drain. */
+#ifndef MTK_BULK_DATA_COLLECTION_SCHED_ROUTE_SPACING_MS
+#define MTK_BULK_DATA_COLLECTION_SCHED_ROUTE_SPACING_MS (500)
+#endif
+
+/* Number of attempts to collect a packet before giving it up. */
+#ifndef MTK_BULK_DATA_COLLECTION_SCHED_MAX_ATTEMPTS
+#define MTK_BULK_DATA_COLLECTION_SCHED_MAX_ATTEMPTS (3)
+#endif
+
+/* Time from a failed attempt to the next one, in ms, doubled after each
+ * further failure. Also the time a packet is postponed by the setup callback. */
+#ifndef MTK_BULK_DATA_COLLECTION_SCHED_BACKOFF_MS
+#define MTK_BULK_DATA_COLLECTION_SCHED_BACKOFF_MS (2000)
+#endif
+
+/* Waiting time worth one priority level, in ms, so that packets of low
+ * priority are eventually collected. */
+#ifndef MTK_BULK_DATA_COLLECTION_SCHED_AGING_MS
+#define MTK_BULK_DATA_COLLECTION_SCHED_AGING_MS (10000)
+#endif
+
+typedef struct
+{
+    /* Packets waiting, and being collected */
+    uint8_t queue_depth;
+    uint8_t active;
+    /* Counters since mtk_bdcsched_start() */
+    uint32_t completed;
+    uint32_t duplicates;
+    uint32_t retries;
+    uint32_t failed;
+    uint32_t dropped;
+} mtk_bdcsched_stats_t;
+
+/* Set up packet to receive the signaled packet, by setting payload or
+ * registering a write callback, see mtk_bulk_data_collection_register_rx_sink().
+ * The packet is zero-initialized, with the information of the signal filled
+ * in, and its sub-packet size chosen for the path to the sender if the signal
+ * has a length, see mtk_bulk_data_collection_sub_packet_size_choose().
+ * Return < 0 to postpone the collection, for example while no buffer is
+ * available. Each collection set up ends with event_bdc_received or
+ * event_bdc_receive_failed with the packet, upon which what was set up can be
+ * released. */
+typedef int (*mtk_bdcsched_setup_callback_t)(mtk_bulk_data_collection_packet_t* packet,
+                                             const mtk_bdc_event_signaled_data_t* signal,
+                                             void* storage);
+
+/* Start scheduling collections. The bulk data collection module must be
+ * initialized as receiver, or dual. */
+int mtk_bdcsched_start(mtk_bdcsched_setup_callback_t setup_callback, void* storage);
+
+/* Queue a signaled packet for collection, typically from the handler of
+ * event_bdc_signaled_ready. Packets are collected by decreasing priority, raised
+ * while waiting, then by increasing hop_count, then in signal order. Packets
+ * with the same non-zero route_id, for example the first hop towards the
+ * sender, are not collected at the same time, and
+ * MTK_BULK_DATA_COLLECTION_SCHED_ROUTE_SPACING_MS apart. A packet already
+ * queued is updated. */
+int mtk_bdcsched_enqueue(const mtk_bdc_event_signaled_data_t* signal,
+                         uint8_t priority,
+                         uint8_t hop_count,
+                         uint16_t route_id);
+
+/* Queue each packet of a manifest, with the priority of its entry. Returns the
+ * number of packets queued. */
+int mtk_bdcsched_enqueue_manifest(const mtk_bdc_event_manifest_data_t* manifest,
+                                  uint8_t hop_count,
+                                  uint16_t route_id);
+
+void mtk_bdcsched_stats_get(mtk_bdcsched_stats_t* stats);
+
+PROCESS_NAME(mtk_bdcsched_proc);
+
+#endif
@@ -30,53 +30,179 @@
 
 #include "mtk_bulk_data_collection.h"
 #include "mtk_bdc_events.h"
+#include "mtk_bdc_evq.h"
 #include "mtk_bdc_signal.h"
 
 #define DEBUG_LEVEL 0
 #include "mtk_bdc_utils.h"
 
 process_event_t event_bdc_signaled_ready;
+process_event_t event_bdc_manifest;
 
 static const uint8_t lpsig_header[MTK_BULK_DATA_COLLECTION_HEADER_SIZE] = { 0x54, 0xab };
+static const uint8_t lpsig_manifest_header[MTK_BULK_DATA_COLLECTION_HEADER_SIZE] = { 0x54, 0xad };
+
+/* Packet flags sent in signals, all but FLAG_FOUNTAIN adding fields to the
+ * message */
+#define LPSIG_FIELD_FLAGS                                                                 \
+    (MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH | MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED | \
+     MTK_BULK_DATA_COLLECTION_FLAG_LENGTH | MTK_BULK_DATA_COLLECTION_FLAG_PUSH |          \
+     MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST | MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN)
+
+/* Flags of transfers started by the signal, which sends the period */
+#define LPSIG_PERIOD_FLAGS \
+    (MTK_BULK_DATA_COLLECTION_FLAG_PUSH | MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST)
+
+/* Largest signal: header, packet_id, n_sub_packets, flags and all optional
+ * fields. */
+#define LPSIG_MAX_LEN                                                                \
+    (sizeof(lpsig_header) + sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint8_t) + \
+     sizeof(uint32_t) + 4 * sizeof(uint16_t))
+
+/* Manifest entry: packet_id, n_sub_packets, len and priority */
+#define LPSIG_MANIFEST_ENTRY_LEN \
+    (sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint8_t))
+
+/* Largest manifest: header, n_entries and all entries */
+#define LPSIG_MANIFEST_MAX_LEN                        \
+    (sizeof(lpsig_manifest_header) + sizeof(uint8_t) + \
+     MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES * LPSIG_MANIFEST_ENTRY_LEN)
 
 static mira_net_udp_connection_t* lpsig_udp_connection;
 
-static void lpsig_pack_buffer(uint8_t* buffer, uint16_t packet_id, uint8_t n_sub_packets);
+#if MTK_BULK_DATA_COLLECTION_SIGNAL_EVENT_SLOTS > MTK_BDCEVQ_MAX_SLOTS
+#error "MTK_BULK_DATA_COLLECTION_SIGNAL_EVENT_SLOTS must be at most MTK_BDCEVQ_MAX_SLOTS"
+#endif
+#if MTK_BULK_DATA_COLLECTION_MANIFEST_EVENT_SLOTS > MTK_BDCEVQ_MAX_SLOTS
+#error "MTK_BULK_DATA_COLLECTION_MANIFEST_EVENT_SLOTS must be at most MTK_BDCEVQ_MAX_SLOTS"
+#endif
+
+static mtk_bdc_event_signaled_data_t lpsig_event_slots[MTK_BULK_DATA_COLLECTION_SIGNAL_EVENT_SLOTS];
+static mtk_bdcevq_t lpsig_evq = MTK_BDCEVQ_INIT(lpsig_event_slots);
+
+static mtk_bdc_event_manifest_data_t
+  lpsig_manifest_event_slots[MTK_BULK_DATA_COLLECTION_MANIFEST_EVENT_SLOTS];
+static mtk_bdcevq_t lpsig_manifest_evq = MTK_BDCEVQ_INIT(lpsig_manifest_event_slots);
 
-static int lpsig_unpack_buffer(uint8_t* n_sub_packets,
-                               uint16_t* packet_id,
+static int lpsig_send(mira_net_udp_connection_t* udp_connection,
+                      const mira_net_address_t* dst,
+                      uint16_t dst_port,
+                      const mtk_bdc_event_signaled_data_t* info);
+
+static uint8_t lpsig_pack_buffer(uint8_t* buffer, const mtk_bdc_event_signaled_data_t* info);
+
+static int lpsig_unpack_buffer(mtk_bdc_event_signaled_data_t* info,
                                const uint8_t* buffer,
                                uint8_t len);
 
+static uint16_t lpsig_manifest_pack_buffer(uint8_t* buffer,
+                                           const mtk_bulk_data_collection_manifest_entry_t* entries,
+                                           uint8_t n_entries);
+
+static int lpsig_manifest_unpack_buffer(mtk_bdc_event_manifest_data_t* manifest,
+                                        const uint8_t* buffer,
+                                        uint16_t len);
+
+static void lpsig_manifest_handle_data(const void* data,
+                                       const uint16_t data_len,
+                                       const mira_net_udp_callback_metadata_t* metadata);
+
 int mtk_bdcsig_init(mira_net_udp_connection_t* udp_connection)
 {
     event_bdc_signaled_ready = process_alloc_event();
+    event_bdc_manifest = process_alloc_event();
 
     lpsig_udp_connection = udp_connection;
 
+    mtk_bdcevq_reset(&lpsig_evq);
+    mtk_bdcevq_reset(&lpsig_manifest_evq);
+
     return 0;
 }
 
 int mtk_bdcsig_send(const mira_net_address_t* dst, uint16_t packet_id, uint8_t n_sub_packets)
 {
-    uint8_t packet_ready_message[sizeof(lpsig_header) + sizeof(packet_id) + sizeof(n_sub_packets)];
+    mtk_bdc_event_signaled_data_t info = {
+        .n_sub_packets = n_sub_packets,
+        .packet_id = packet_id,
+    };
+
+    return lpsig_send(lpsig_udp_connection, dst, MTK_BULK_DATA_COLLECTION_RX_UDP_PORT, &info);
+}
+
+int mtk_bdcsig_send_packet(const mira_net_address_t* dst,
+                           const mtk_bulk_data_collection_packet_t* packet)
+{
+    return mtk_bdcsig_send_packet_on(
+      lpsig_udp_connection, dst, MTK_BULK_DATA_COLLECTION_RX_UDP_PORT, packet);
+}
+
+int mtk_bdcsig_send_packet_on(mira_net_udp_connection_t* udp_connection,
+                              const mira_net_address_t* dst,
+                              uint16_t dst_port,
+                              const mtk_bulk_data_collection_packet_t* packet)
+{
+    mtk_bdc_event_signaled_data_t info = {
+        .n_sub_packets = packet->num_sub_packets,
+        .packet_id = packet->id,
+        .flags = packet->flags & LPSIG_FIELD_FLAGS,
+        .content_hash = packet->content_hash,
+        .original_len = packet->original_len,
+        .compressed_len = packet->compressed_len,
+        .len = packet->len,
+        .period_ms = packet->period_ms,
+    };
+
+    return lpsig_send(udp_connection, dst, dst_port, &info);
+}
+
+int mtk_bdcsig_send_manifest(const mira_net_address_t* dst,
+                             const mtk_bulk_data_collection_manifest_entry_t* entries,
+                             uint8_t n_entries)
+{
+    uint8_t manifest_message[LPSIG_MANIFEST_MAX_LEN];
+
+    if (n_entries == 0 || n_entries > MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES) {
+        return -1;
+    }
+
+    P_DEBUG("Sending manifest of %d packets\n", n_entries);
+
+    uint16_t len = lpsig_manifest_pack_buffer(manifest_message, entries, n_entries);
+
+    mira_status_t ret = mira_net_udp_send_to(lpsig_udp_connection,
+                                             dst,
+                                             MTK_BULK_DATA_COLLECTION_RX_UDP_PORT,
+                                             manifest_message,
+                                             len);
+    if (ret != MIRA_SUCCESS) {
+        P_ERR("[%d]: mira_net_udp_send_to\n", ret);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int lpsig_send(mira_net_udp_connection_t* udp_connection,
+                      const mira_net_address_t* dst,
+                      uint16_t dst_port,
+                      const mtk_bdc_event_signaled_data_t* info)
+{
+    uint8_t packet_ready_message[LPSIG_MAX_LEN];
 
 #if DEBUG_LEVEL > 0
     char addr_str_buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
 #endif
-    P_DEBUG("Sending lp signal to %s: id %d, %d sub-packets\n",
+    P_DEBUG("Sending lp signal to %s: id %d, %d sub-packets, flags 0x%02x\n",
             mira_net_toolkit_format_address(addr_str_buffer, dst),
-            packet_id,
-            n_sub_packets);
+            info->packet_id,
+            info->n_sub_packets,
+            info->flags);
 
-    lpsig_pack_buffer(packet_ready_message, packet_id, n_sub_packets);
+    uint8_t len = lpsig_pack_buffer(packet_ready_message, info);
 
     mira_status_t ret;
-    ret = mira_net_udp_send_to(lpsig_udp_connection,
-                               dst,
-                               MTK_BULK_DATA_COLLECTION_RX_UDP_PORT,
-                               packet_ready_message,
-                               sizeof(packet_ready_message));
+    ret = mira_net_udp_send_to(udp_connection, dst, dst_port, packet_ready_message, len);
 
     if (ret != MIRA_SUCCESS) {
         P_ERR("[%d]: mira_net_udp_send_to\n", ret);
@@ -95,6 +221,11 @@ void mtk_bdcsig_handle_data(const void* data,
         return;
     }
 
+    if (memcmp(data, lpsig_manifest_header, sizeof(lpsig_manifest_header)) == 0) {
+        lpsig_manifest_handle_data(data, data_len, metadata);
+        return;
+    }
+
     if (memcmp(data, lpsig_header, sizeof(lpsig_header)) != 0) {
         /* Not a signal packet */
         return;
@@ -104,74 +235,289 @@ void mtk_bdcsig_handle_data(const void* data,
     source (metadata->source_address). Failing to do so results in mixing up two
     messages with the same packet_id but from different sources. */
 
-    uint8_t n_sub_packets;
-    uint16_t packet_id;
-    if (lpsig_unpack_buffer(&n_sub_packets, &packet_id, data, data_len) < 0) {
+    /* Post event with data, held until delivered */
+    mtk_bdc_event_signaled_data_t* info = mtk_bdcevq_alloc(&lpsig_evq);
+    if (info == NULL) {
+        P_ERR("%s: no event slot, signal dropped\n", __func__);
+        return;
+    }
+
+    if (lpsig_unpack_buffer(info, data, data_len) < 0) {
         P_ERR("Invalid notification\n");
+        mtk_bdcevq_cancel(&lpsig_evq);
         return;
     }
 
-    P_DEBUG("Signal received for packet id %d with %d sub-packets\n", packet_id, n_sub_packets);
+    P_DEBUG("Signal received for packet id %d with %d sub-packets\n",
+            info->packet_id,
+            info->n_sub_packets);
 
-    /* Post event with data */
-    static mtk_bdc_event_signaled_data_t lpsig_event_data;
-    lpsig_event_data = (mtk_bdc_event_signaled_data_t){
-        .n_sub_packets = n_sub_packets,
-        .packet_id = packet_id,
-        .src_port = metadata->source_port,
-    };
-    memcpy(&lpsig_event_data.src, metadata->source_address, sizeof(mira_net_address_t));
+    info->src_port = metadata->source_port;
+    memcpy(&info->src, metadata->source_address, sizeof(mira_net_address_t));
 
-    if (process_post(PROCESS_BROADCAST, event_bdc_signaled_ready, &lpsig_event_data) !=
-        PROCESS_ERR_OK) {
-        P_ERR("%s: process_post\n", __func__);
+    if (mtk_bdcevq_post(&lpsig_evq, event_bdc_signaled_ready) < 0) {
+        P_ERR("%s: mtk_bdcevq_post\n", __func__);
         return;
     }
 }
 
+void mtk_bdcsig_event_stats_get(mtk_bdcevq_stats_t* signal_stats,
+                                mtk_bdcevq_stats_t* manifest_stats)
+{
+    mtk_bdcevq_stats_get(&lpsig_evq, signal_stats);
+    mtk_bdcevq_stats_get(&lpsig_manifest_evq, manifest_stats);
+}
+
 /* Large packet signal format:
  *
  *  +-------------------+----------------------+------------------------+
- *  | header  (16 bits) |  packet_id (16_bits) | n_sub_packets (8 bits) |
+ *  | header  (16 bits) |  packet_id (16_bits) | n_sub_packets (8 bits) | ...
  *  +-------------------+----------------------+------------------------+
  *
- * Little endian.
+ *  +----------------+-----------------------------------------------------+
+ *  | flags (8 bits) | content_hash (32 bits, if FLAG_CONTENT_HASH is set) | ...
+ *  +----------------+-----------------------------------------------------+
+ *
+ *  +------------------------------------------------------------------------+
+ *  | original_len, compressed_len (16 bits each, if FLAG_COMPRESSED is set) | ...
+ *  +------------------------------------------------------------------------+
+ *
+ *  +--------------------------------------+
+ *  | len (16 bits, if FLAG_LENGTH is set) | ...
+ *  +--------------------------------------+
+ *
+ *  +------------------------------------------------------------+
+ *  | period_ms (16 bits, if FLAG_PUSH or FLAG_MULTICAST is set) |
+ *  +------------------------------------------------------------+
+ *
+ * Little endian. flags and the fields following it are optional. A signal
+ * without flags has no flag set.
  */
 
-static void lpsig_pack_buffer(uint8_t* buffer, uint16_t packet_id, uint8_t n_sub_packets)
+static uint8_t lpsig_pack_buffer(uint8_t* buffer, const mtk_bdc_event_signaled_data_t* info)
 {
+    uint8_t* start = buffer;
+
     memcpy(buffer, lpsig_header, sizeof(lpsig_header));
     buffer += sizeof(lpsig_header);
 
-    LITTLE_ENDIAN_STORE(buffer, packet_id);
-    buffer += sizeof(packet_id);
+    LITTLE_ENDIAN_STORE(buffer, info->packet_id);
+    buffer += sizeof(info->packet_id);
+
+    LITTLE_ENDIAN_STORE(buffer, info->n_sub_packets);
+    buffer += sizeof(info->n_sub_packets);
+
+    /* Without flags, keep the original format understood by all receivers */
+    if (info->flags == 0) {
+        return buffer - start;
+    }
+
+    LITTLE_ENDIAN_STORE(buffer, info->flags);
+    buffer += sizeof(info->flags);
 
-    LITTLE_ENDIAN_STORE(buffer, n_sub_packets);
-    buffer += sizeof(n_sub_packets);
+    if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH) {
+        LITTLE_ENDIAN_STORE(buffer, info->content_hash);
+        buffer += sizeof(info->content_hash);
+    }
+
+    if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED) {
+        LITTLE_ENDIAN_STORE(buffer, info->original_len);
+        buffer += sizeof(info->original_len);
+
+        LITTLE_ENDIAN_STORE(buffer, info->compressed_len);
+        buffer += sizeof(info->compressed_len);
+    }
+
+    if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_LENGTH) {
+        LITTLE_ENDIAN_STORE(buffer, info->len);
+        buffer += sizeof(info->len);
+    }
+
+    if (info->flags & LPSIG_PERIOD_FLAGS) {
+        LITTLE_ENDIAN_STORE(buffer, info->period_ms);
+        buffer += sizeof(info->period_ms);
+    }
+
+    return buffer - start;
 }
 
-static int lpsig_unpack_buffer(uint8_t* n_sub_packets,
-                               uint16_t* packet_id,
+static int lpsig_unpack_buffer(mtk_bdc_event_signaled_data_t* info,
                                const uint8_t* buffer,
                                uint8_t len)
 {
-    if ((n_sub_packets == NULL) || (packet_id == NULL) || (buffer == NULL)) {
+    if ((info == NULL) || (buffer == NULL)) {
         P_ERR("%s: pointer error!\n", __func__);
         return -1;
     }
 
-    if (len != (sizeof(lpsig_header) + sizeof(*n_sub_packets) + sizeof(*packet_id))) {
+    uint8_t expected_len =
+      sizeof(lpsig_header) + sizeof(info->n_sub_packets) + sizeof(info->packet_id);
+
+    if (len < expected_len) {
         P_ERR("%s: wrong lp signal packet size (%d)!\n", __func__, len);
         return -1;
     }
 
+    memset(info, 0, sizeof(*info));
+
     buffer += sizeof(lpsig_header);
 
-    LITTLE_ENDIAN_LOAD(packet_id, buffer);
-    buffer += sizeof(*packet_id);
+    LITTLE_ENDIAN_LOAD(&info->packet_id, buffer);
+    buffer += sizeof(info->packet_id);
+
+    LITTLE_ENDIAN_LOAD(&info->n_sub_packets, buffer);
+    buffer += sizeof(info->n_sub_packets);
+
+    if (len > expected_len) {
+        LITTLE_ENDIAN_LOAD(&info->flags, buffer);
+        buffer += sizeof(info->flags);
+
+        expected_len += sizeof(info->flags);
+        if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH) {
+            expected_len += sizeof(info->content_hash);
+        }
+        if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED) {
+            expected_len += sizeof(info->original_len) + sizeof(info->compressed_len);
+        }
+        if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_LENGTH) {
+            expected_len += sizeof(info->len);
+        }
+        if (info->flags & LPSIG_PERIOD_FLAGS) {
+            expected_len += sizeof(info->period_ms);
+        }
+    }
+
+    if (len != expected_len) {
+        P_ERR("%s: wrong lp signal packet size (%d)!\n", __func__, len);
+        return -1;
+    }
 
-    LITTLE_ENDIAN_LOAD(n_sub_packets, buffer);
-    buffer += sizeof(*n_sub_packets);
+    if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH) {
+        LITTLE_ENDIAN_LOAD(&info->content_hash, buffer);
+        buffer += sizeof(info->content_hash);
+    }
+
+    if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED) {
+        LITTLE_ENDIAN_LOAD(&info->original_len, buffer);
+        buffer += sizeof(info->original_len);
+
+        LITTLE_ENDIAN_LOAD(&info->compressed_len, buffer);
+        buffer += sizeof(info->compressed_len);
+    }
+
+    if (info->flags & MTK_BULK_DATA_COLLECTION_FLAG_LENGTH) {
+        LITTLE_ENDIAN_LOAD(&info->len, buffer);
+        buffer += sizeof(info->len);
+    }
+
+    if (info->flags & LPSIG_PERIOD_FLAGS) {
+        LITTLE_ENDIAN_LOAD(&info->period_ms, buffer);
+        buffer += sizeof(info->period_ms);
+    }
+
+    return 0;
+}
+
+static void lpsig_manifest_handle_data(const void* data,
+                                       const uint16_t data_len,
+                                       const mira_net_udp_callback_metadata_t* metadata)
+{
+    mtk_bdc_event_manifest_data_t* manifest = mtk_bdcevq_alloc(&lpsig_manifest_evq);
+
+    if (manifest == NULL) {
+        P_ERR("%s: no event slot, manifest dropped\n", __func__);
+        return;
+    }
+
+    if (lpsig_manifest_unpack_buffer(manifest, data, data_len) < 0) {
+        P_ERR("Invalid manifest\n");
+        mtk_bdcevq_cancel(&lpsig_manifest_evq);
+        return;
+    }
+
+    P_DEBUG("Manifest received with %d packets\n", manifest->n_entries);
+
+    manifest->src_port = metadata->source_port;
+    memcpy(&manifest->src, metadata->source_address, sizeof(mira_net_address_t));
+
+    if (mtk_bdcevq_post(&lpsig_manifest_evq, event_bdc_manifest) < 0) {
+        P_ERR("%s: mtk_bdcevq_post\n", __func__);
+    }
+}
+
+/* Manifest signal format:
+ *
+ *  +-------------------+---------------------+
+ *  | header  (16 bits) | n_entries  (8 bits) | ...
+ *  +-------------------+---------------------+
+ *
+ *  +----------------------+------------------------+----------------+-------------------+
+ *  | packet_id  (16 bits) | n_sub_packets (8 bits) | len  (16 bits) | priority (8 bits) | ...
+ *  +----------------------+------------------------+----------------+-------------------+
+ *
+ * Little endian, with n_entries entries.
+ */
+
+static uint16_t lpsig_manifest_pack_buffer(uint8_t* buffer,
+                                           const mtk_bulk_data_collection_manifest_entry_t* entries,
+                                           uint8_t n_entries)
+{
+    uint8_t* start = buffer;
+
+    memcpy(buffer, lpsig_manifest_header, sizeof(lpsig_manifest_header));
+    buffer += sizeof(lpsig_manifest_header);
+
+    LITTLE_ENDIAN_STORE(buffer, n_entries);
+    buffer += sizeof(n_entries);
+
+    /* Through a pointer, LITTLE_ENDIAN_STORE() having its own index i */
+    for (uint8_t i = 0; i < n_entries; ++i) {
+        const mtk_bulk_data_collection_manifest_entry_t* entry = &entries[i];
+        LITTLE_ENDIAN_STORE(buffer, entry->packet_id);
+        buffer += sizeof(entry->packet_id);
+        LITTLE_ENDIAN_STORE(buffer, entry->n_sub_packets);
+        buffer += sizeof(entry->n_sub_packets);
+        LITTLE_ENDIAN_STORE(buffer, entry->len);
+        buffer += sizeof(entry->len);
+        LITTLE_ENDIAN_STORE(buffer, entry->priority);
+        buffer += sizeof(entry->priority);
+    }
+
+    return buffer - start;
+}
+
+static int lpsig_manifest_unpack_buffer(mtk_bdc_event_manifest_data_t* manifest,
+                                        const uint8_t* buffer,
+                                        uint16_t len)
+{
+    if (len < sizeof(lpsig_manifest_header) + sizeof(manifest->n_entries)) {
+        P_ERR("%s: wrong manifest size (%d)!\n", __func__, len);
+        return -1;
+    }
+
+    buffer += sizeof(lpsig_manifest_header);
+
+    LITTLE_ENDIAN_LOAD(&manifest->n_entries, buffer);
+    buffer += sizeof(manifest->n_entries);
+
+    if (manifest->n_entries > MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES ||
+        len != sizeof(lpsig_manifest_header) + sizeof(manifest->n_entries) +
+                 manifest->n_entries * LPSIG_MANIFEST_ENTRY_LEN) {
+        P_ERR("%s: wrong manifest size (%d)!\n", __func__, len);
+        return -1;
+    }
+
+    for (uint8_t i = 0; i < manifest->n_entries; ++i) {
+        mtk_bulk_data_collection_manifest_entry_t* entry = &manifest->entries[i];
+        LITTLE_ENDIAN_LOAD(&entry->packet_id, buffer);
+        buffer += sizeof(entry->packet_id);
+        LITTLE_ENDIAN_LOAD(&entry->n_sub_packets, buffer);
+        buffer += sizeof(entry->n_sub_packets);
+        LITTLE_ENDIAN_LOAD(&entry->len, buffer);
+        buffer += sizeof(entry->len);
+        LITTLE_ENDIAN_LOAD(&entry->priority, buffer);
+        buffer += sizeof(entry->priority);
+    }
 
     return 0;
 }
@@ -33,6 +33,18 @@
 #include <stdint.h>
 
 #include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_evq.h"
+
+/* Number of incoming signals held until their event is delivered. Further
+ * signals are dropped meanwhile. */
+#ifndef MTK_BULK_DATA_COLLECTION_SIGNAL_EVENT_SLOTS
+#define MTK_BULK_DATA_COLLECTION_SIGNAL_EVENT_SLOTS (4)
+#endif
+
+/* Same for manifests. Each costs the size of mtk_bdc_event_manifest_data_t. */
+#ifndef MTK_BULK_DATA_COLLECTION_MANIFEST_EVENT_SLOTS
+#define MTK_BULK_DATA_COLLECTION_MANIFEST_EVENT_SLOTS (1)
+#endif
 
 /* Initialize the module, with role as Receiver (root) or Sender. See
  * mtk_bulk_data_collection.h */
@@ -41,10 +53,32 @@ int mtk_bdcsig_init(mira_net_udp_connection_t* udp_connection);
 /* Signal to dst that there is a large packet ready for sending */
 int mtk_bdcsig_send(const mira_net_address_t* dst, uint16_t packet_id, uint8_t n_sub_packets);
 
+/* Signal to dst that packet is ready for sending, along with the optional
+ * information set in packet->flags. */
+int mtk_bdcsig_send_packet(const mira_net_address_t* dst,
+                           const mtk_bulk_data_collection_packet_t* packet);
+
+/* Same as mtk_bdcsig_send_packet(), sent on udp_connection to dst_port instead
+ * of to MTK_BULK_DATA_COLLECTION_RX_UDP_PORT. Used for multicast transfers. */
+int mtk_bdcsig_send_packet_on(mira_net_udp_connection_t* udp_connection,
+                              const mira_net_address_t* dst,
+                              uint16_t dst_port,
+                              const mtk_bulk_data_collection_packet_t* packet);
+
+/* Signal to dst that the packets listed in entries are ready for sending, in a
+ * single message. See event_bdc_manifest. */
+int mtk_bdcsig_send_manifest(const mira_net_address_t* dst,
+                             const mtk_bulk_data_collection_manifest_entry_t* entries,
+                             uint8_t n_entries);
+
 /* Handle incoming data, if relevant. This function first tests if the data is a
  * valid signal message. If it is, it acts by posting an event. */
 void mtk_bdcsig_handle_data(const void* data,
                             const uint16_t data_len,
                             const mira_net_udp_callback_metadata_t* metadata);
 
+/* Get statistics of the events posted for incoming signals and manifests. */
+void mtk_bdcsig_event_stats_get(mtk_bdcevq_stats_t* signal_stats,
+                                mtk_bdcevq_stats_t* manifest_stats);
+
 #endif
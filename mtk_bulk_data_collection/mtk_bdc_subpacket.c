@@ -31,6 +31,7 @@
 
 #include "mtk_bulk_data_collection.h"
 #include "mtk_bdc_events.h"
+#include "mtk_bdc_evq.h"
 #include "mtk_bdc_subpacket.h"
 
 #define DEBUG_LEVEL 0
@@ -40,20 +41,40 @@ process_event_t event_bdc_subpacket_received;
 
 static const uint8_t lpsp_header[MTK_BULK_DATA_COLLECTION_HEADER_SIZE] = { 0x1f, 0xb3 };
 
+/* Bytes in a sub-packet frame preceding the payload: header, packet_id,
+ * sub_packet_index, n_sub_packets and payload_len. */
+#define LPSP_FRAME_OVERHEAD                                                             \
+    (sizeof(lpsp_header) + sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint8_t) + \
+     sizeof(uint16_t))
+
 static mira_net_udp_connection_t* lpsp_udp_connection;
 
-static void lpsp_pack_buffer(uint8_t* buffer,
+static mtk_bdcsp_rx_handler_t lpsp_rx_handler;
+
+#if MTK_BULK_DATA_COLLECTION_SUBPACKET_EVENT_SLOTS > MTK_BDCEVQ_MAX_SLOTS
+#error "MTK_BULK_DATA_COLLECTION_SUBPACKET_EVENT_SLOTS must be at most MTK_BDCEVQ_MAX_SLOTS"
+#endif
+
+static mtk_bdc_event_subpacket_data_t
+  lpsp_event_slots[MTK_BULK_DATA_COLLECTION_SUBPACKET_EVENT_SLOTS];
+static mtk_bdcevq_t lpsp_evq = MTK_BDCEVQ_INIT(lpsp_event_slots);
+
+/* Outgoing frames are built here rather than on the stack, as they are up to
+ * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES large. Its payload area is also
+ * the scratch buffer of senders, see mtk_bdcsp_tx_payload_get(). */
+static uint8_t lpsp_tx_frame[LPSP_FRAME_OVERHEAD + MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES];
+
+static void lpsp_pack_header(uint8_t* buffer,
                              uint16_t packet_id,
                              uint8_t sub_packet_index,
                              uint8_t n_sub_packets,
-                             const uint8_t* payload,
                              uint16_t payload_len);
 
 static int lpsp_unpack_buffer(uint16_t* packet_id,
                               uint8_t* sub_packet_index,
                               uint8_t* n_sub_packets,
                               uint16_t* payload_len,
-                              uint8_t* payload,
+                              const uint8_t** payload,
                               const uint8_t* buffer,
                               uint16_t buf_len);
 
@@ -61,11 +82,23 @@ int mtk_bdcsp_init(mira_net_udp_connection_t* udp_connection)
 {
     lpsp_udp_connection = udp_connection;
 
+    mtk_bdcevq_reset(&lpsp_evq);
+
     event_bdc_subpacket_received = process_alloc_event();
 
     return 0;
 }
 
+void mtk_bdcsp_rx_handler_set(mtk_bdcsp_rx_handler_t handler)
+{
+    lpsp_rx_handler = handler;
+}
+
+uint8_t* mtk_bdcsp_tx_payload_get(void)
+{
+    return lpsp_tx_frame + LPSP_FRAME_OVERHEAD;
+}
+
 int mtk_bdcsp_send(const mira_net_address_t* dst,
                    uint16_t dst_port,
                    uint16_t packet_id,
@@ -74,14 +107,42 @@ int mtk_bdcsp_send(const mira_net_address_t* dst,
                    const uint8_t* data,
                    const uint16_t data_len)
 {
-    uint8_t sub_packet_frame[sizeof(lpsp_header) + sizeof(packet_id) + sizeof(sub_packet_index) +
-                             sizeof(n_sub_packets) + sizeof(data_len) + data_len];
+    return mtk_bdcsp_send_on(lpsp_udp_connection,
+                             dst,
+                             dst_port,
+                             packet_id,
+                             sub_packet_index,
+                             n_sub_packets,
+                             data,
+                             data_len);
+}
+
+int mtk_bdcsp_send_on(mira_net_udp_connection_t* udp_connection,
+                      const mira_net_address_t* dst,
+                      uint16_t dst_port,
+                      uint16_t packet_id,
+                      uint8_t sub_packet_index,
+                      uint8_t n_sub_packets,
+                      const uint8_t* data,
+                      const uint16_t data_len)
+{
+    if (data_len > MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) {
+        P_ERR("%s: sub-packet too large (%d)\n", __func__, data_len);
+        return -1;
+    }
 
-    lpsp_pack_buffer(sub_packet_frame, packet_id, sub_packet_index, n_sub_packets, data, data_len);
+    lpsp_pack_header(lpsp_tx_frame, packet_id, sub_packet_index, n_sub_packets, data_len);
+    if (data != mtk_bdcsp_tx_payload_get()) {
+        memcpy(lpsp_tx_frame + LPSP_FRAME_OVERHEAD, data, data_len);
+    }
 
     mira_status_t ret = mira_net_udp_send_to(
-      lpsp_udp_connection, dst, dst_port, sub_packet_frame, sizeof(sub_packet_frame));
+      udp_connection, dst, dst_port, lpsp_tx_frame, LPSP_FRAME_OVERHEAD + data_len);
 
+    if (ret == MIRA_ERROR_NO_MEMORY) {
+        P_DEBUG("%s: UDP queue full\n", __func__);
+        return MTK_BDCSP_QUEUE_FULL;
+    }
     if (ret != MIRA_SUCCESS) {
         P_ERR("%s: could not send on UDP\n", __func__);
         return -1;
@@ -110,53 +171,70 @@ void mtk_bdcsp_handle_data(const void* data,
     uint16_t packet_id;
     uint8_t sub_packet_index;
     uint8_t n_sub_packets;
-    static uint8_t payload[MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES];
     uint16_t payload_len;
+    const uint8_t* payload;
 
     if (lpsp_unpack_buffer(
-          &packet_id, &sub_packet_index, &n_sub_packets, &payload_len, payload, data, data_len) <
+          &packet_id, &sub_packet_index, &n_sub_packets, &payload_len, &payload, data, data_len) <
         0) {
         P_ERR("%s: invalid sub-packet\n", __func__);
         return;
     }
 
-    /* Post event with data */
-    static mtk_bdc_event_subpacket_data_t lpsp_event_data;
-    lpsp_event_data = (mtk_bdc_event_subpacket_data_t){
+    /* Post event with data, held until delivered. Taken before placing the
+     * payload, so that a sub-packet is never placed without its event. */
+    mtk_bdc_event_subpacket_data_t* event_data = mtk_bdcevq_alloc(&lpsp_evq);
+    if (event_data == NULL) {
+        P_ERR("%s: no event slot, sub-packet %d dropped\n", __func__, sub_packet_index);
+        return;
+    }
+
+    *event_data = (mtk_bdc_event_subpacket_data_t){
         .packet_id = packet_id,
         .sub_packet_index = sub_packet_index,
         .n_sub_packets = n_sub_packets,
         .payload_len = payload_len,
-        .payload = payload,
+        .payload = NULL,
         .src_port = metadata->source_port,
     };
-    memcpy(&lpsp_event_data.src, metadata->source_address, sizeof(mira_net_address_t));
+    memcpy(&event_data->src, metadata->source_address, sizeof(mira_net_address_t));
+
+    /* The payload is copied once, straight from the UDP buffer to where the
+     * receiver wants it. */
+    if (lpsp_rx_handler == NULL || lpsp_rx_handler(event_data, payload) < 0) {
+        P_DEBUG("%s: sub-packet %d discarded\n", __func__, sub_packet_index);
+        mtk_bdcevq_cancel(&lpsp_evq);
+        return;
+    }
 
-    if (process_post(PROCESS_BROADCAST, event_bdc_subpacket_received, &lpsp_event_data) !=
-        PROCESS_ERR_OK) {
-        P_ERR("%s: process_post\n", __func__);
+    if (mtk_bdcevq_post(&lpsp_evq, event_bdc_subpacket_received) < 0) {
+        P_ERR("%s: mtk_bdcevq_post\n", __func__);
         return;
     }
 }
 
+void mtk_bdcsp_event_stats_get(mtk_bdcevq_stats_t* stats)
+{
+    mtk_bdcevq_stats_get(&lpsp_evq, stats);
+}
+
 /* Sub-packet format:
  *
  *  +-------------------+----------------------+---------------------------+
  *  | header  (16 bits) |  packet_id (16_bits) | sub_packet_index (8 bits) | ...
  *  +-------------------+----------------------+------------------------+--+
  *
- *  +----------------------+----------------------+-----------------------------+
- *  n_sub_packets (8 bits) | payload_len (8 bits) | payload (payload_len bytes) |
- *  +----------------------+----------------------+-----------------------------+
+ *  +----------------------+-----------------------+-----------------------------+
+ *  n_sub_packets (8 bits) | payload_len (16 bits) | payload (payload_len bytes) |
+ *  +----------------------+-----------------------+-----------------------------+
  *
  * Little endian.
  */
 
-static void lpsp_pack_buffer(uint8_t* buffer,
+static void lpsp_pack_header(uint8_t* buffer,
                              uint16_t packet_id,
                              uint8_t sub_packet_index,
                              uint8_t n_sub_packets,
-                             const uint8_t* payload,
                              uint16_t payload_len)
 {
     memcpy(buffer, &lpsp_header, sizeof(lpsp_header));
@@ -173,16 +251,14 @@ static void lpsp_pack_buffer(uint8_t* buffer,
 
     LITTLE_ENDIAN_STORE(buffer, payload_len);
     buffer += sizeof(payload_len);
-
-    memcpy(buffer, payload, payload_len);
-    buffer += payload_len;
 }
 
+/* Validate the frame in place. On success, payload points into buffer. */
 static int lpsp_unpack_buffer(uint16_t* packet_id,
                               uint8_t* sub_packet_index,
                               uint8_t* n_sub_packets,
                               uint16_t* payload_len,
-                              uint8_t* payload,
+                              const uint8_t** payload,
                               const uint8_t* buffer,
                               uint16_t buf_len)
 {
@@ -192,6 +268,11 @@ static int lpsp_unpack_buffer(uint16_t* packet_id,
         return -1;
     }
 
+    if (buf_len < LPSP_FRAME_OVERHEAD) {
+        P_ERR("%s: sub-packet too short (%d)\n", __func__, buf_len);
+        return -1;
+    }
+
     /* Discard header, which the caller must check before unpacking. */
     buffer += sizeof(lpsp_header);
 
@@ -207,15 +288,14 @@ static int lpsp_unpack_buffer(uint16_t* packet_id,
     LITTLE_ENDIAN_LOAD(payload_len, buffer);
     buffer += sizeof(*payload_len);
 
-    if (buf_len != sizeof(lpsp_header) + sizeof(*packet_id) + sizeof(*sub_packet_index) +
-                     sizeof(*n_sub_packets) + sizeof(*payload_len) + *payload_len) {
+    if (buf_len != LPSP_FRAME_OVERHEAD + *payload_len ||
+        *payload_len > MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) {
         P_ERR(
           "%s: wrong sub-packet size (%d). Payload size: %d\n", __func__, buf_len, *payload_len);
         return -1;
     }
 
-    memcpy(payload, buffer, *payload_len);
-    buffer += *payload_len;
+    *payload = buffer;
 
     return 0;
 }
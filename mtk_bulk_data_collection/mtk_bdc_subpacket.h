@@ -31,10 +31,39 @@
 #include <mira.h>
 #include <stdint.h>
 
+#include "mtk_bdc_events.h"
+#include "mtk_bdc_evq.h"
+
+/* Number of incoming sub-packets of which the event is held until delivered,
+ * that is of sub-packets received back to back before the receiving process
+ * runs. Further sub-packets are dropped meanwhile. */
+#ifndef MTK_BULK_DATA_COLLECTION_SUBPACKET_EVENT_SLOTS
+#define MTK_BULK_DATA_COLLECTION_SUBPACKET_EVENT_SLOTS (8)
+#endif
+
+/* Called at reception of a valid sub-packet, from the UDP callback. The handler
+ * copies the payload, which is only valid during the call, to its final
+ * destination and updates sp->payload to point there. Return < 0 to discard the
+ * sub-packet, in which case no event is posted. */
+typedef int (*mtk_bdcsp_rx_handler_t)(mtk_bdc_event_subpacket_data_t* sp,
+                                      const uint8_t* payload);
+
 /* Initialize the module, with UDP setup to send messages. */
 int mtk_bdcsp_init(mira_net_udp_connection_t* udp_connection);
 
-/* Send sub-packet to dst */
+/* Set the handler placing incoming sub-packets. NULL discards all sub-packets. */
+void mtk_bdcsp_rx_handler_set(mtk_bdcsp_rx_handler_t handler);
+
+/* Payload area of the outgoing frame, MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES
+ * large. A sub-packet built there, such as a compressed one, is sent by
+ * mtk_bdcsp_send() without being copied. Overwritten by every send. */
+uint8_t* mtk_bdcsp_tx_payload_get(void);
+
+/* Returned by mtk_bdcsp_send() when the UDP queue is full. The sub-packet
+ * can be sent again later. */
+#define MTK_BDCSP_QUEUE_FULL (-2)
+
+/* Send sub-packet to dst. Returns 0, MTK_BDCSP_QUEUE_FULL or -1. */
 int mtk_bdcsp_send(const mira_net_address_t* dst,
                    uint16_t dst_port,
                    uint16_t packt_id,
@@ -43,10 +72,24 @@ int mtk_bdcsp_send(const mira_net_address_t* dst,
                    const uint8_t* data,
                    const uint16_t data_len);
 
+/* Same as mtk_bdcsp_send(), sent on udp_connection. Used for multicast
+ * transfers. */
+int mtk_bdcsp_send_on(mira_net_udp_connection_t* udp_connection,
+                      const mira_net_address_t* dst,
+                      uint16_t dst_port,
+                      uint16_t packet_id,
+                      uint8_t sub_packet_index,
+                      uint8_t n_sub_packets,
+                      const uint8_t* data,
+                      const uint16_t data_len);
+
 /* Handle incoming data, if relevant. This function first tests if the data is a
  * valid sub-packet message. If it is, it acts by posting an event. */
 void mtk_bdcsp_handle_data(const void* data,
                            const uint16_t data_len,
                            const mira_net_udp_callback_metadata_t* metadata);
 
+/* Get statistics of the events posted for incoming sub-packets. */
+void mtk_bdcsp_event_stats_get(mtk_bdcevq_stats_t* stats);
+
 #endif
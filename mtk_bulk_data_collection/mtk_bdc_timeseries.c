@@ -0,0 +1,290 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mtk_bdc_timeseries.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+/* Block format:
+ *
+ *  +----------------------+---------------------+---------------------+
+ *  | n_samples (16 bits)  | n_channels (8 bits) | timestamp (32 bits) | ...
+ *  +----------------------+---------------------+---------------------+
+ *
+ *  +----------------------------------+---------------------------------+
+ *  | channels (16 bits * n_channels)  | samples 1 to n_samples - 1 ...  |
+ *  +----------------------------------+---------------------------------+
+ *
+ * Little endian. The first sample is stored as is. Each following sample is
+ * the difference of its timestamp delta to the previous delta, then the
+ * difference of each channel to the previous sample. Differences wrap around,
+ * and are zig-zag and varint coded: 7 bits per byte, least significant first,
+ * with the top bit set on all but the last byte. The timestamp delta before the
+ * second sample counts as 0. Blocks may be followed by zero padding.
+ */
+
+#define BLOCK_HEADER_LEN(n_channels) (2 + 1 + 4 + 2 * (n_channels))
+
+/* Largest sample after the first: 5 bytes of timestamp, 3 per channel */
+#define SAMPLE_MAX_LEN (5 + 3 * MTK_BULK_DATA_COLLECTION_TS_MAX_CHANNELS)
+
+static uint8_t varint_put(uint8_t* dst, uint32_t v);
+
+static int varint_get(uint32_t* v, const uint8_t* src, uint16_t len);
+
+static uint32_t zigzag_encode(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t zigzag_decode(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+int mtk_bdcts_encode(uint8_t* dst,
+                     uint16_t dst_cap,
+                     uint16_t block_size,
+                     const mtk_bdcts_sample_t* samples,
+                     uint16_t n_samples,
+                     uint8_t n_channels)
+{
+    uint16_t out = 0;
+
+    while (n_samples > 0) {
+        uint16_t cap = dst_cap - out;
+        if (cap > block_size) {
+            cap = block_size;
+        }
+
+        uint16_t n_encoded;
+        int len =
+          mtk_bdcts_block_encode(dst + out, cap, samples, n_samples, n_channels, &n_encoded);
+        if (len < 0) {
+            return -1;
+        }
+
+        samples += n_encoded;
+        n_samples -= n_encoded;
+        if (n_samples == 0) {
+            return out + len;
+        }
+
+        if (cap < block_size) {
+            /* No room for the next block */
+            return -1;
+        }
+        memset(dst + out + len, 0, block_size - len);
+        out += block_size;
+    }
+
+    return out;
+}
+
+int mtk_bdcts_block_encode(uint8_t* block,
+                           uint16_t block_size,
+                           const mtk_bdcts_sample_t* samples,
+                           uint16_t n_samples,
+                           uint8_t n_channels,
+                           uint16_t* n_encoded)
+{
+    *n_encoded = 0;
+
+    if (n_channels > MTK_BULK_DATA_COLLECTION_TS_MAX_CHANNELS || n_samples == 0 ||
+        block_size < BLOCK_HEADER_LEN(n_channels)) {
+        P_ERR("%s: invalid arguments\n", __func__);
+        return -1;
+    }
+
+    uint8_t* p = block + sizeof(uint16_t);
+
+    LITTLE_ENDIAN_STORE(p, n_channels);
+    p += sizeof(n_channels);
+
+    LITTLE_ENDIAN_STORE(p, samples[0].timestamp);
+    p += sizeof(samples[0].timestamp);
+
+    for (uint8_t c = 0; c < n_channels; ++c) {
+        uint16_t value = samples[0].channels[c];
+        LITTLE_ENDIAN_STORE(p, value);
+        p += sizeof(value);
+    }
+
+    uint16_t out = p - block;
+    uint16_t n = 1;
+    uint32_t prev_delta = 0;
+
+    for (; n < n_samples && n < UINT16_MAX; ++n) {
+        uint8_t sample[SAMPLE_MAX_LEN];
+        uint8_t len = 0;
+
+        uint32_t delta = samples[n].timestamp - samples[n - 1].timestamp;
+        len += varint_put(sample + len, zigzag_encode((int32_t)(delta - prev_delta)));
+
+        for (uint8_t c = 0; c < n_channels; ++c) {
+            int16_t diff = (int16_t)(samples[n].channels[c] - samples[n - 1].channels[c]);
+            len += varint_put(sample + len, zigzag_encode(diff));
+        }
+
+        if (out + len > block_size) {
+            break;
+        }
+        memcpy(block + out, sample, len);
+        out += len;
+        prev_delta = delta;
+    }
+
+    LITTLE_ENDIAN_STORE(block, n);
+
+    *n_encoded = n;
+    return out;
+}
+
+int mtk_bdcts_decode(mtk_bdcts_sample_t* samples,
+                     uint16_t max_samples,
+                     uint16_t block_size,
+                     const uint8_t* data,
+                     uint16_t len)
+{
+    uint16_t n_samples = 0;
+
+    while (len > 0) {
+        uint16_t block_len = (len > block_size) ? block_size : len;
+
+        int n = mtk_bdcts_block_decode(
+          samples + n_samples, max_samples - n_samples, data, block_len);
+        if (n < 0) {
+            return -1;
+        }
+
+        n_samples += n;
+        data += block_len;
+        len -= block_len;
+    }
+
+    return n_samples;
+}
+
+int mtk_bdcts_block_decode(mtk_bdcts_sample_t* samples,
+                           uint16_t max_samples,
+                           const uint8_t* block,
+                           uint16_t block_len)
+{
+    uint16_t n_samples;
+    uint8_t n_channels;
+
+    if (block_len < BLOCK_HEADER_LEN(0)) {
+        return -1;
+    }
+
+    LITTLE_ENDIAN_LOAD(&n_samples, block);
+    block += sizeof(n_samples);
+
+    LITTLE_ENDIAN_LOAD(&n_channels, block);
+    block += sizeof(n_channels);
+
+    if (n_samples == 0 || n_samples > max_samples ||
+        n_channels > MTK_BULK_DATA_COLLECTION_TS_MAX_CHANNELS ||
+        block_len < BLOCK_HEADER_LEN(n_channels)) {
+        P_ERR("%s: invalid block\n", __func__);
+        return -1;
+    }
+
+    memset(&samples[0], 0, sizeof(samples[0]));
+
+    LITTLE_ENDIAN_LOAD(&samples[0].timestamp, block);
+    block += sizeof(samples[0].timestamp);
+
+    for (uint8_t c = 0; c < n_channels; ++c) {
+        uint16_t value;
+        LITTLE_ENDIAN_LOAD(&value, block);
+        block += sizeof(value);
+        samples[0].channels[c] = (int16_t)value;
+    }
+
+    uint16_t len = block_len - BLOCK_HEADER_LEN(n_channels);
+    uint32_t prev_delta = 0;
+
+    for (uint16_t n = 1; n < n_samples; ++n) {
+        uint32_t v;
+        int used = varint_get(&v, block, len);
+        if (used < 0) {
+            return -1;
+        }
+        block += used;
+        len -= used;
+
+        uint32_t delta = prev_delta + (uint32_t)zigzag_decode(v);
+        memset(&samples[n], 0, sizeof(samples[n]));
+        samples[n].timestamp = samples[n - 1].timestamp + delta;
+        prev_delta = delta;
+
+        for (uint8_t c = 0; c < n_channels; ++c) {
+            used = varint_get(&v, block, len);
+            if (used < 0) {
+                return -1;
+            }
+            block += used;
+            len -= used;
+
+            samples[n].channels[c] = (int16_t)(samples[n - 1].channels[c] + zigzag_decode(v));
+        }
+    }
+
+    return n_samples;
+}
+
+static uint8_t varint_put(uint8_t* dst, uint32_t v)
+{
+    uint8_t len = 0;
+
+    while (v >= 0x80) {
+        dst[len++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    dst[len++] = v;
+
+    return len;
+}
+
+static int varint_get(uint32_t* v, const uint8_t* src, uint16_t len)
+{
+    *v = 0;
+
+    for (uint8_t i = 0; i < 5 && i < len; ++i) {
+        *v |= (uint32_t)(src[i] & 0x7f) << (7 * i);
+        if (!(src[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,84 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_TIMESERIES_H
+#define MTK_BDC_TIMESERIES_H
+
+/* Function identifier prefix: mtk_bdcts_ */
+
+#include <stdint.h>
+
+/* Max number of channels per sample */
+#ifndef MTK_BULK_DATA_COLLECTION_TS_MAX_CHANNELS
+#define MTK_BULK_DATA_COLLECTION_TS_MAX_CHANNELS (4)
+#endif
+
+/* Sample of a time series: a timestamp, in any unit, and n_channels values. */
+typedef struct
+{
+    uint32_t timestamp;
+    int16_t channels[MTK_BULK_DATA_COLLECTION_TS_MAX_CHANNELS];
+} mtk_bdcts_sample_t;
+
+/* Encode samples into dst, in blocks of block_size bytes that are decoded on
+ * their own. Use MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES as block_size to
+ * have one block per sub-packet. Blocks are padded to block_size, except the
+ * last one. Returns the encoded length, or -1 if it doesn't fit in dst_cap. */
+int mtk_bdcts_encode(uint8_t* dst,
+                     uint16_t dst_cap,
+                     uint16_t block_size,
+                     const mtk_bdcts_sample_t* samples,
+                     uint16_t n_samples,
+                     uint8_t n_channels);
+
+/* Encode as many samples as fit into a single block of at most block_size
+ * bytes. Sets n_encoded to the number of samples encoded. Returns the block
+ * length, or -1 on error. */
+int mtk_bdcts_block_encode(uint8_t* block,
+                           uint16_t block_size,
+                           const mtk_bdcts_sample_t* samples,
+                           uint16_t n_samples,
+                           uint8_t n_channels,
+                           uint16_t* n_encoded);
+
+/* Decode data of len bytes, encoded by mtk_bdcts_encode() with the same
+ * block_size, into at most max_samples samples. Returns the number of samples,
+ * or -1 if the data is malformed or has more samples. */
+int mtk_bdcts_decode(mtk_bdcts_sample_t* samples,
+                     uint16_t max_samples,
+                     uint16_t block_size,
+                     const uint8_t* data,
+                     uint16_t len);
+
+/* Decode a single block, such as one sub-packet, into at most max_samples
+ * samples. Returns the number of samples, or -1 on error. */
+int mtk_bdcts_block_decode(mtk_bdcts_sample_t* samples,
+                           uint16_t max_samples,
+                           const uint8_t* block,
+                           uint16_t block_len);
+
+#endif
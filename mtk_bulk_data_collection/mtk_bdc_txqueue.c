@@ -0,0 +1,595 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <mira.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_events.h"
+#include "mtk_bdc_txqueue.h"
+
+#define DEBUG_LEVEL 0
+#include "mtk_bdc_utils.h"
+
+#define MS_TO_TICKS(ms) ((clock_time_t)(ms) * CLOCK_SECOND / 1000)
+
+/* Time between attempts to send a requested packet while another one is being
+ * sent, in ms. */
+#define TXQ_RETRY_MS (100)
+
+typedef enum
+{
+    ENTRY_FREE,
+    ENTRY_WAITING,
+    ENTRY_SIGNALED,
+    /* Requested, or preempted, and waiting for the sending process, with the
+     * sub-packets to send in the packet's mask */
+    ENTRY_REQUESTED,
+    /* Chained after a requested packet, for a batch request, and sent along
+     * with it */
+    ENTRY_CHAINED,
+    ENTRY_SENDING,
+} entry_state_t;
+
+/* Times are kept as start and duration rather than deadlines, so that
+ * comparisons of ages hold across wrap-around. */
+typedef struct
+{
+    entry_state_t state;
+    mtk_bulk_data_collection_packet_t* packet;
+    mira_net_address_t dst;
+    clock_time_t enqueue_time;
+    /* Given up once elapsed since enqueue_time, unless 0 */
+    clock_time_t deadline;
+    clock_time_t signal_time;
+    uint8_t n_signals;
+    /* Acknowledged by the receiver while being sent */
+    bool acked;
+} entry_t;
+
+PROCESS(mtk_bdctxq_proc, "Bulk data collection send queue");
+
+static entry_t entries[MTK_BULK_DATA_COLLECTION_TXQ_SIZE];
+
+static mtk_bdctxq_stats_t txq_stats;
+
+/* Packets of the batch chained by the queue, the first one requested, until
+ * all of them are released. The sending process follows the links until then.
+ */
+static mtk_bulk_data_collection_packet_t* chain[1 + MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS];
+static uint8_t chain_len;
+static uint64_t chain_released_mask;
+
+static clock_time_t schedule(void);
+
+static void request_handle(const mtk_bdc_event_requested_data_t* request);
+
+static int request_apply(mtk_bulk_data_collection_packet_t* packet,
+                         const mtk_bdc_event_requested_data_t* request,
+                         bool batched);
+
+static void chain_build(entry_t* first, const mtk_bdc_event_requested_data_t* request);
+
+static void chain_sent(void);
+
+static void chain_released(const mtk_bulk_data_collection_packet_t* packet);
+
+static void chain_dissolve(void);
+
+static void chain_unlink(void);
+
+static void entry_end(entry_t* entry, uint32_t* counter);
+
+static entry_t* entry_find(const mira_net_address_t* addr, uint16_t packet_id);
+
+static entry_t* entry_best(entry_state_t state, bool urgent, clock_time_t now);
+
+static bool entry_ranks_before(const entry_t* a, const entry_t* b, clock_time_t now);
+
+static void wait_min(clock_time_t* next_wait, clock_time_t wait);
+
+int mtk_bdctxq_start(void)
+{
+    chain_unlink();
+    memset(entries, 0, sizeof(entries));
+    memset(&txq_stats, 0, sizeof(txq_stats));
+
+    /* Kill possibly running queue before starting anew. */
+    process_exit(&mtk_bdctxq_proc);
+    process_start(&mtk_bdctxq_proc, NULL);
+
+    return 0;
+}
+
+int mtk_bdctxq_enqueue(mtk_bulk_data_collection_packet_t* packet,
+                       const mira_net_address_t* dst,
+                       uint8_t priority,
+                       uint32_t deadline_ms)
+{
+    clock_time_t now = clock_time();
+    entry_t* entry = NULL;
+
+    if (packet->num_sub_packets == 0) {
+        /* Not registered */
+        return -1;
+    }
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        if (entries[i].state != ENTRY_FREE && entries[i].packet == packet) {
+            /* Queued again, keeping its place in the queue */
+            packet->priority = priority;
+            entries[i].deadline = MS_TO_TICKS(deadline_ms);
+            process_poll(&mtk_bdctxq_proc);
+            return 0;
+        }
+    }
+
+    entry_t new_entry = {
+        .state = ENTRY_WAITING,
+        .packet = packet,
+        .enqueue_time = now,
+        .deadline = MS_TO_TICKS(deadline_ms),
+    };
+    memcpy(&new_entry.dst, dst, sizeof(mira_net_address_t));
+
+    for (int i = 0; entry == NULL && i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        if (entries[i].state == ENTRY_FREE) {
+            entry = &entries[i];
+        }
+    }
+
+    packet->priority = priority;
+
+    if (entry == NULL) {
+        /* Full: replace the lowest ranked waiting packet, if it ranks lower */
+        entry_t* victim = NULL;
+        for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+            if (entries[i].state == ENTRY_WAITING &&
+                (victim == NULL || entry_ranks_before(victim, &entries[i], now))) {
+                victim = &entries[i];
+            }
+        }
+        if (victim == NULL || !entry_ranks_before(&new_entry, victim, now)) {
+            P_DEBUG("%s: queue full, packet %d dropped\n", __func__, packet->id);
+            txq_stats.dropped++;
+            return -1;
+        }
+        P_DEBUG("%s: queue full, packet %d dropped\n", __func__, victim->packet->id);
+        entry_end(victim, &txq_stats.dropped);
+        entry = victim;
+    }
+
+    *entry = new_entry;
+
+    process_poll(&mtk_bdctxq_proc);
+
+    return 0;
+}
+
+void mtk_bdctxq_stats_get(mtk_bdctxq_stats_t* stats)
+{
+    *stats = txq_stats;
+    stats->queue_depth = 0;
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        if (entries[i].state != ENTRY_FREE) {
+            stats->queue_depth++;
+        }
+    }
+}
+
+PROCESS_THREAD(mtk_bdctxq_proc, ev, data)
+{
+    static struct etimer timer;
+
+    PROCESS_BEGIN();
+
+    while (1) {
+        PROCESS_WAIT_EVENT();
+
+        if (ev == event_bdc_requested) {
+            request_handle((const mtk_bdc_event_requested_data_t*)data);
+        } else if (ev == event_bdc_acked || ev == event_bdc_rejected) {
+            const mtk_bdc_event_requested_data_t* answer =
+              (const mtk_bdc_event_requested_data_t*)data;
+            entry_t* entry = entry_find(&answer->src, answer->packet_id);
+            if (entry == NULL) {
+                continue;
+            }
+            if (ev == event_bdc_rejected) {
+                /* A pushed packet is requested later on, as a signaled one */
+                if (entry->state == ENTRY_SENDING) {
+                    entry->state = ENTRY_SIGNALED;
+                    entry->signal_time = clock_time();
+                    entry->n_signals = 1;
+                }
+            } else if (entry->state == ENTRY_SENDING) {
+                /* Released by the sending process, which gets the same event */
+                entry->acked = true;
+            } else if (entry->state != ENTRY_CHAINED) {
+                /* Held by the receiver already. Chained packets are sent along
+                 * with the first one. */
+                entry_end(entry, &txq_stats.completed);
+            }
+        } else if (ev == event_bdc_released) {
+            for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+                if (entries[i].state == ENTRY_SENDING && entries[i].packet == data) {
+                    /* Already posted, the packet being done. Without an
+                     * acknowledgement, the transfer stalled or was given up. */
+                    entries[i].state = ENTRY_FREE;
+                    if (entries[i].acked) {
+                        txq_stats.completed++;
+                    } else {
+                        P_DEBUG("packet %d not acknowledged\n", entries[i].packet->id);
+                        txq_stats.failed++;
+                    }
+                }
+            }
+            chain_released((const mtk_bulk_data_collection_packet_t*)data);
+        } else if (ev != PROCESS_EVENT_POLL && !(ev == PROCESS_EVENT_TIMER && data == &timer)) {
+            continue;
+        }
+
+        clock_time_t wait = schedule();
+        if (wait > 0) {
+            etimer_set(&timer, wait);
+        } else {
+            etimer_stop(&timer);
+        }
+    }
+
+    PROCESS_END();
+}
+
+/* Give up packets past their deadline, push urgent packets, send requested
+ * packets and signal the next one. Returns the time until the next deadline,
+ * signal timeout or retry, or 0. */
+static clock_time_t schedule(void)
+{
+    clock_time_t now = clock_time();
+    clock_time_t next_wait = 0;
+    entry_t* sending = NULL;
+    bool signaled = false;
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        entry_t* entry = &entries[i];
+
+        if (entry->state == ENTRY_FREE) {
+            continue;
+        }
+        if (entry->state == ENTRY_SENDING) {
+            if (sending == NULL || sending->packet->priority < entry->packet->priority) {
+                sending = entry;
+            }
+            continue;
+        }
+        if (entry->state == ENTRY_CHAINED) {
+            /* Given up along with the first packet of the chain */
+            continue;
+        }
+
+        if (entry->deadline != 0) {
+            if (now - entry->enqueue_time >= entry->deadline) {
+                P_DEBUG("%s: packet %d expired\n", __func__, entry->packet->id);
+                if (chain_len > 0 && chain[0] == entry->packet) {
+                    /* Not sent yet: the other packets are sent on their own */
+                    chain_dissolve();
+                }
+                entry_end(entry, &txq_stats.expired);
+                continue;
+            }
+            wait_min(&next_wait, entry->deadline - (now - entry->enqueue_time));
+        }
+
+        if (entry->state == ENTRY_SIGNALED) {
+            clock_time_t timeout = MS_TO_TICKS(MTK_BULK_DATA_COLLECTION_TXQ_SIGNAL_TIMEOUT_MS);
+            if (now - entry->signal_time < timeout) {
+                wait_min(&next_wait, timeout - (now - entry->signal_time));
+                signaled = true;
+            } else if (entry->n_signals >= MTK_BULK_DATA_COLLECTION_TXQ_MAX_SIGNALS) {
+                P_DEBUG("%s: packet %d never requested\n", __func__, entry->packet->id);
+                entry_end(entry, &txq_stats.dropped);
+            } else {
+                entry->state = ENTRY_WAITING;
+            }
+        }
+    }
+
+    /* Urgent packets preempt transfers of lower priority */
+    entry_t* urgent = entry_best(ENTRY_WAITING, true, now);
+    if (urgent != NULL &&
+        (sending == NULL || sending->packet->priority < urgent->packet->priority)) {
+        /* Stopping fails if the packet is only kept for late requests, in
+         * which case pushing releases it */
+        if (sending != NULL && mtk_bulk_data_collection_stop() == 0) {
+            P_DEBUG("%s: packet %d preempted\n", __func__, sending->packet->id);
+            sending->state = ENTRY_REQUESTED;
+            /* The rest of a batch goes on, each packet on its own */
+            chain_dissolve();
+            txq_stats.preempted++;
+        }
+        if (mtk_bulk_data_collection_push(urgent->packet, &urgent->dst) == 0) {
+            urgent->state = ENTRY_SENDING;
+            urgent->acked = false;
+            sending = urgent;
+        } else {
+            wait_min(&next_wait, MS_TO_TICKS(TXQ_RETRY_MS));
+        }
+    }
+
+    /* Requested packets, sent one after the other. Sending fails while another
+     * one is being sent. */
+    entry_t* requested = entry_best(ENTRY_REQUESTED, false, now);
+    if (requested != NULL) {
+        if (mtk_bulk_data_collection_send(requested->packet) == 0) {
+            requested->state = ENTRY_SENDING;
+            requested->acked = false;
+            if (chain_len > 0 && chain[0] == requested->packet) {
+                chain_sent();
+            }
+        } else {
+            wait_min(&next_wait, MS_TO_TICKS(TXQ_RETRY_MS));
+        }
+    }
+
+    /* Signal the next packet once the previous one is requested */
+    entry_t* next = entry_best(ENTRY_WAITING, false, now);
+    if (!signaled && next != NULL) {
+        if (mtk_bulk_data_collection_signal(next->packet, &next->dst) == 0) {
+            next->state = ENTRY_SIGNALED;
+            next->signal_time = now;
+            next->n_signals++;
+            wait_min(&next_wait, MS_TO_TICKS(MTK_BULK_DATA_COLLECTION_TXQ_SIGNAL_TIMEOUT_MS));
+        } else {
+            wait_min(&next_wait, MS_TO_TICKS(TXQ_RETRY_MS));
+        }
+    }
+
+    return next_wait;
+}
+
+static void request_handle(const mtk_bdc_event_requested_data_t* request)
+{
+    entry_t* entry = entry_find(&request->src, request->packet_id);
+
+    if (entry == NULL) {
+        return;
+    }
+
+    mtk_bulk_data_collection_packet_t* packet = entry->packet;
+
+    if (entry->state == ENTRY_SENDING) {
+        /* Sub-packets lost, added to the running transfer, or sent anew if the
+         * packet is only kept for late requests */
+        uint64_t whole_mask;
+        if (request->sub_packet_size == packet->sub_packet_size &&
+            mtk_bulk_data_collection_send_whole_mask_get(&whole_mask, packet->num_sub_packets) ==
+              0) {
+            packet->mask |= request->mask & whole_mask;
+            (void)mtk_bulk_data_collection_send(packet);
+        }
+        return;
+    }
+
+    if (entry->state == ENTRY_CHAINED) {
+        /* Requested on its own before the chain is sent */
+        chain_dissolve();
+    }
+
+    if (request_apply(packet, request, false) < 0) {
+        P_ERR("%s: could not apply request of packet %d\n", __func__, packet->id);
+        return;
+    }
+
+    entry->state = ENTRY_REQUESTED;
+
+    if (request->n_batch > 0) {
+        chain_build(entry, request);
+    }
+}
+
+/* Set up the packet to send as requested, as the application would otherwise
+ * do. The further packets of a batch request are sent whole, of the default
+ * sub-packet size. */
+static int request_apply(mtk_bulk_data_collection_packet_t* packet,
+                         const mtk_bdc_event_requested_data_t* request,
+                         bool batched)
+{
+    uint64_t whole_mask;
+
+    if (mtk_bulk_data_collection_sub_packet_size_set(
+          packet, batched ? 0 : request->sub_packet_size, packet->len) < 0 ||
+        mtk_bulk_data_collection_send_whole_mask_get(&whole_mask, packet->num_sub_packets) < 0) {
+        return -1;
+    }
+
+    memcpy(&packet->node_addr, &request->src, sizeof(mira_net_address_t));
+    packet->node_port = request->src_port;
+    packet->period_ms = request->period_ms;
+    packet->mask = batched ? whole_mask : (request->mask & whole_mask);
+    packet->next = NULL;
+
+    if (batched) {
+        return 0;
+    }
+    return mtk_bulk_data_collection_delta_apply(packet, request->n_hashes, request->hashes);
+}
+
+/* Chain the queued packets of a batch request after the first one, in order,
+ * for them to be sent back to back. Packets not queued, or already requested,
+ * are left out, and requested again on their own by the receiver. */
+static void chain_build(entry_t* first, const mtk_bdc_event_requested_data_t* request)
+{
+    mtk_bulk_data_collection_packet_t* last = first->packet;
+
+    if (chain_len > 0) {
+        P_DEBUG("%s: previous batch still sending, packet %d sent alone\n", __func__,
+                first->packet->id);
+        return;
+    }
+
+    chain[0] = first->packet;
+    chain_len = 1;
+    chain_released_mask = 0;
+
+    for (uint8_t i = 0; i < request->n_batch; ++i) {
+        entry_t* entry = entry_find(&request->src, request->batch_ids[i]);
+        if (entry == NULL ||
+            (entry->state != ENTRY_WAITING && entry->state != ENTRY_SIGNALED) ||
+            request_apply(entry->packet, request, true) < 0) {
+            P_DEBUG("%s: batch packet %d left out\n", __func__, request->batch_ids[i]);
+            continue;
+        }
+        entry->state = ENTRY_CHAINED;
+        last->next = entry->packet;
+        last = entry->packet;
+        chain[chain_len++] = entry->packet;
+    }
+
+    if (chain_len == 1) {
+        chain_len = 0;
+    }
+}
+
+/* The first packet of the chain being sent, so are the others. */
+static void chain_sent(void)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        if (entries[i].state == ENTRY_CHAINED) {
+            entries[i].state = ENTRY_SENDING;
+            entries[i].acked = false;
+        }
+    }
+}
+
+/* Clear the links once all packets of the chain are released, the sending
+ * process being done with them. */
+static void chain_released(const mtk_bulk_data_collection_packet_t* packet)
+{
+    for (uint8_t i = 0; i < chain_len; ++i) {
+        if (chain[i] == packet) {
+            chain_released_mask |= ((uint64_t)1) << i;
+        }
+    }
+
+    if (chain_len > 0 && chain_released_mask == (((uint64_t)1) << chain_len) - 1) {
+        chain_unlink();
+    }
+}
+
+/* Break the chain while not being sent, for its packets to be sent on their
+ * own, with the sub-packets left in their mask. */
+static void chain_dissolve(void)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        for (uint8_t j = 0; j < chain_len; ++j) {
+            if (entries[i].packet == chain[j] &&
+                (entries[i].state == ENTRY_CHAINED || entries[i].state == ENTRY_SENDING)) {
+                entries[i].state = ENTRY_REQUESTED;
+            }
+        }
+    }
+
+    chain_unlink();
+}
+
+static void chain_unlink(void)
+{
+    for (uint8_t i = 0; i < chain_len; ++i) {
+        chain[i]->next = NULL;
+    }
+    chain_len = 0;
+    chain_released_mask = 0;
+}
+
+/* Free the entry of a packet that isn't being sent, releasing the packet. */
+static void entry_end(entry_t* entry, uint32_t* counter)
+{
+    (*counter)++;
+    entry->state = ENTRY_FREE;
+
+    if (process_post(PROCESS_BROADCAST, event_bdc_released, entry->packet) != PROCESS_ERR_OK) {
+        P_ERR("%s: process_post event_bdc_released\n", __func__);
+    }
+}
+
+static entry_t* entry_find(const mira_net_address_t* addr, uint16_t packet_id)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        if (entries[i].state != ENTRY_FREE && entries[i].packet->id == packet_id &&
+            memcmp(&entries[i].dst, addr, sizeof(mira_net_address_t)) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* Best ranked entry in state, only among urgent packets if urgent. */
+static entry_t* entry_best(entry_state_t state, bool urgent, clock_time_t now)
+{
+    entry_t* best = NULL;
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_TXQ_SIZE; ++i) {
+        entry_t* entry = &entries[i];
+        if (entry->state != state ||
+            (urgent &&
+             entry->packet->priority < MTK_BULK_DATA_COLLECTION_TXQ_URGENT_PRIORITY)) {
+            continue;
+        }
+        if (best == NULL || entry_ranks_before(entry, best, now)) {
+            best = entry;
+        }
+    }
+
+    return best;
+}
+
+static bool entry_ranks_before(const entry_t* a, const entry_t* b, clock_time_t now)
+{
+    if (a->packet->priority != b->packet->priority) {
+        return a->packet->priority > b->packet->priority;
+    }
+    if ((a->deadline != 0) != (b->deadline != 0)) {
+        return a->deadline != 0;
+    }
+
+    clock_time_t age_a = now - a->enqueue_time;
+    clock_time_t age_b = now - b->enqueue_time;
+
+    if (a->deadline != 0 && a->deadline - age_a != b->deadline - age_b) {
+        return a->deadline - age_a < b->deadline - age_b;
+    }
+    return age_a > age_b;
+}
+
+static void wait_min(clock_time_t* next_wait, clock_time_t wait)
+{
+    if (wait > 0 && (*next_wait == 0 || wait < *next_wait)) {
+        *next_wait = wait;
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 LumenRadio AB
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef MTK_BDC_TXQUEUE_H
+#define MTK_BDC_TXQUEUE_H
+
+/* Function identifier prefix: mtk_bdctxq_ */
+
+#include <mira.h>
+#include <stdint.h>
+
+#include "mtk_bulk_data_collection.h"
+
+/* Number of packets queued for sending, including the one being sent. When
+ * full, a new packet replaces the lowest ranked waiting packet if it ranks
+ * higher, and is dropped otherwise. */
+#ifndef MTK_BULK_DATA_COLLECTION_TXQ_SIZE
+#define MTK_BULK_DATA_COLLECTION_TXQ_SIZE (8)
+#endif
+
+/* Packets of at least this priority are urgent: pushed rather than signaled,
+ * preempting a transfer of lower priority between two sub-packets. */
+#ifndef MTK_BULK_DATA_COLLECTION_TXQ_URGENT_PRIORITY
+#define MTK_BULK_DATA_COLLECTION_TXQ_URGENT_PRIORITY (192)
+#endif
+
+/* Time from a signal to the next one of the same packet, in ms, if it is not
+ * requested meanwhile. */
+#ifndef MTK_BULK_DATA_COLLECTION_TXQ_SIGNAL_TIMEOUT_MS
+#define MTK_BULK_DATA_COLLECTION_TXQ_SIGNAL_TIMEOUT_MS (5000)
+#endif
+
+/* Number of signals of a packet without a request before giving it up. */
+#ifndef MTK_BULK_DATA_COLLECTION_TXQ_MAX_SIGNALS
+#define MTK_BULK_DATA_COLLECTION_TXQ_MAX_SIGNALS (3)
+#endif
+
+typedef struct
+{
+    /* Packets queued, including the one being sent */
+    uint8_t queue_depth;
+    /* Counters since mtk_bdctxq_start(). Packets sent are completed once
+     * acknowledged by the receiver, and failed if released without. */
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t preempted;
+    uint32_t expired;
+    uint32_t dropped;
+} mtk_bdctxq_stats_t;
+
+/* Start the queue, empty. The bulk data collection module must be initialized
+ * as sender, or dual. */
+int mtk_bdctxq_start(void);
+
+/* Queue a registered packet for sending to dst. Packets are signaled one at a
+ * time, by decreasing priority, then by increasing time left to their
+ * deadline, then in queue order, and sent upon request of the receiver. Urgent
+ * packets, see MTK_BULK_DATA_COLLECTION_TXQ_URGENT_PRIORITY, are pushed, see
+ * mtk_bulk_data_collection_push(). Batch requests are served by chaining the
+ * packets listed that are still queued. A packet not sent within deadline_ms, 0
+ * for none, is given up. Each packet ends with event_bdc_released, sent or not,
+ * after which its buffer may be reused. A packet already queued is updated. */
+int mtk_bdctxq_enqueue(mtk_bulk_data_collection_packet_t* packet,
+                       const mira_net_address_t* dst,
+                       uint8_t priority,
+                       uint32_t deadline_ms);
+
+void mtk_bdctxq_stats_get(mtk_bdctxq_stats_t* stats);
+
+PROCESS_NAME(mtk_bdctxq_proc);
+
+#endif
@@ -33,7 +33,15 @@
 #include <inttypes.h>
 
 #include "mtk_bulk_data_collection.h"
+#include "mtk_bdc_compress.h"
+#include "mtk_bdc_crc.h"
+#include "mtk_bdc_dedup.h"
 #include "mtk_bdc_events.h"
+#include "mtk_bdc_estimator.h"
+#include "mtk_bdc_evq.h"
+#include "mtk_bdc_fountain.h"
+#include "mtk_bdc_multicast.h"
+#include "mtk_bdc_pool.h"
 #include "mtk_bdc_request.h"
 #include "mtk_bdc_signal.h"
 #include "mtk_bdc_subpacket.h"
@@ -42,6 +50,8 @@
 #include "mtk_bdc_utils.h"
 
 process_event_t event_bdc_received;
+process_event_t event_bdc_receive_failed;
+process_event_t event_bdc_released;
 
 typedef struct
 {
@@ -50,9 +60,26 @@ typedef struct
     uint8_t const* payload;
 } sub_packet_t;
 
-/* Max number of times to request re-transmission of missing sub-packets. */
+/* Max number of times to request re-transmission of missing sub-packets, until
+ * the loss towards the sender is estimated. */
 #define LP_MAX_NUM_RETRANSMISSION_REQUESTS (4)
 
+/* Receive timeout until latency towards the sender is estimated, in sub-packet
+ * periods. */
+#define LP_DEFAULT_TIMEOUT_PERIODS (10)
+
+/* A missing sub-packet is NACKed once this many sub-packets with a higher index
+ * are received. 0 disables NACKs, leaving repairs to the receive timeout. */
+#ifndef MTK_BULK_DATA_COLLECTION_NACK_GAP_THRESHOLD
+#define MTK_BULK_DATA_COLLECTION_NACK_GAP_THRESHOLD (2)
+#endif
+
+/* Minimum time between two NACKs, in sub-packet periods. Holes found in the
+ * meantime are batched in the next NACK. */
+#ifndef MTK_BULK_DATA_COLLECTION_NACK_INTERVAL_PERIODS
+#define MTK_BULK_DATA_COLLECTION_NACK_INTERVAL_PERIODS (4)
+#endif
+
 /* Inject faults for testing re-transmissions */
 #ifndef FAULT_RATE_PERCENT
 #define FAULT_RATE_PERCENT (0)
@@ -61,10 +88,51 @@ typedef struct
 static mira_net_udp_connection_t* large_packet_udp_connection;
 static bool large_packet_currently_sending = false;
 
+/* Set while sending a pushed packet not yet confirmed by the receiver, which
+ * may be sent tx_push_left more sub-packets until then. */
+static bool tx_push;
+static uint8_t tx_push_left;
+
+/* Packets sent, chained from tx_chain, that are kept until acknowledged: bit i
+ * for the i-th packet of the chain. */
+#if MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS > 31
+#error "MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS must be at most 31"
+#endif
+static mtk_bulk_data_collection_packet_t* tx_chain;
+static uint32_t tx_kept_mask;
+
+/* Packets of a chain, one per bit of tx_kept_mask */
+#define TX_CHAIN_MAX_PACKETS (32)
+
+/* Set while sending a pipeline, see mtk_bulk_data_collection_pipeline(), of
+ * which the packets are chained from tx_chain. Released packets are unlinked,
+ * so that all packets of the chain are kept. */
+#if MTK_BULK_DATA_COLLECTION_PIPELINE_DEPTH > 32
+#error "MTK_BULK_DATA_COLLECTION_PIPELINE_DEPTH must be at most 32"
+#endif
+static bool tx_pipeline;
+
+/* Set while sending a multicast packet, with tx_mc_rounds_left repair rounds
+ * left. NACKs of the receivers are merged in tx_mc_nack_mask until the next
+ * round, along with the largest number of sub-packets coded by symbols that a
+ * receiver misses. */
+static bool tx_multicast;
+static uint8_t tx_mc_rounds_left;
+static uint64_t tx_mc_nack_mask;
+static uint8_t tx_mc_nack_max;
+
+/* Fountain coding: sub-packets coded by the symbols of the round, next symbol,
+ * and number of symbols left to send. */
+static uint64_t tx_mc_code_mask;
+static uint16_t tx_mc_next_symbol;
+static uint8_t tx_mc_symbols_left;
+
 PROCESS(mtk_bulk_data_collection_send_proc, "Sending of large packets");
 PROCESS(mtk_bulk_data_collection_receive_proc, "Receive sub-packets for large packet");
 
-static void request_for_missing_subpackets(const mtk_bulk_data_collection_packet_t* lp);
+typedef struct rx_session rx_session_t;
+
+static void request_for_missing_subpackets(const rx_session_t* s);
 
 static void large_packet_udp_listen_callback(mira_net_udp_connection_t* connection,
                                              const void* data,
@@ -74,10 +142,213 @@ static void large_packet_udp_listen_callback(mira_net_udp_connection_t* connecti
 
 static int next_sub_packet_send(mtk_bulk_data_collection_packet_t* large_packet);
 
+static int tx_burst_send(mtk_bulk_data_collection_packet_t* large_packet);
+
 static sub_packet_t pick_next_to_send(const mtk_bulk_data_collection_packet_t* lp);
 
 static bool lp_fault_injected(void);
 
+#if MTK_BULK_DATA_COLLECTION_TX_STREAM
+static const uint8_t* tx_stream_fetch(const mtk_bulk_data_collection_packet_t* lp,
+                                      uint8_t index);
+
+static void tx_stream_read_ahead(const mtk_bulk_data_collection_packet_t* lp);
+
+typedef struct tx_stream_buffer tx_stream_buffer_t;
+
+static int tx_stream_read(const mtk_bulk_data_collection_packet_t* lp,
+                          tx_stream_buffer_t* buf,
+                          uint8_t index);
+#endif
+
+static uint16_t sub_packet_len_get(const mtk_bulk_data_collection_packet_t* lp, uint8_t index);
+
+static uint16_t sub_packet_size_get(const mtk_bulk_data_collection_packet_t* lp);
+
+static sub_packet_t sub_packet_compress(sub_packet_t sp);
+
+static const uint8_t* sub_packet_data_get(const mtk_bulk_data_collection_packet_t* lp,
+                                          uint8_t index);
+
+static uint32_t sub_packet_hash(const uint8_t* data, uint16_t len);
+
+static int register_tx_common(mtk_bulk_data_collection_packet_t* large_packet,
+                              const uint16_t packet_id,
+                              const uint16_t len);
+
+static int sub_packet_place(mtk_bdc_event_subpacket_data_t* sp, const uint8_t* payload);
+
+static rx_session_t* rx_session_find(const mira_net_address_t* addr, uint16_t packet_id);
+
+static rx_session_t* rx_session_alloc(mtk_bulk_data_collection_packet_t* lp);
+
+static void rx_session_start(rx_session_t* s, clock_time_t delay);
+
+static void rx_session_timer_set(rx_session_t* s, clock_time_t delay);
+
+static void rx_session_timeout(rx_session_t* s);
+
+static void rx_session_suspend(rx_session_t* s);
+
+static void rx_session_resume(rx_session_t* s);
+
+static void rx_session_subpacket(const mtk_bdc_event_subpacket_data_t* ed);
+
+static void rx_session_unchanged(const mtk_bdc_event_requested_data_t* notice);
+
+static const uint32_t* rx_delta_hashes_get(const rx_session_t* s);
+
+static void rx_session_done(rx_session_t* s);
+
+static void rx_session_abort(rx_session_t* s);
+
+static uint8_t rx_session_count(void);
+
+static int rx_sink_deliver(rx_session_t* s);
+
+static void rx_gap_nack(rx_session_t* s, uint8_t index);
+
+static uint64_t rx_missing_mask_get(const mtk_bulk_data_collection_packet_t* lp);
+
+static uint8_t mask_count(uint64_t mask);
+
+static uint64_t rx_written_mask_get(const rx_session_t* s);
+
+static void rx_checkpoint(rx_session_t* s, bool force);
+
+static int rx_integrity_check(const rx_session_t* s);
+
+static void tx_nack_merge(mtk_bulk_data_collection_packet_t* large_packet,
+                          const mtk_bdc_event_requested_data_t* nack);
+
+static bool tx_request_matches(const mtk_bulk_data_collection_packet_t* large_packet,
+                               const mtk_bdc_event_requested_data_t* request);
+
+static void tx_acked(const mtk_bdc_event_requested_data_t* ack);
+
+static void tx_release(const mtk_bulk_data_collection_packet_t* keep);
+
+static bool tx_pending(const mtk_bulk_data_collection_packet_t* large_packet);
+
+static mtk_bulk_data_collection_packet_t* tx_pipeline_next(void);
+
+static void tx_pipeline_merge(const mtk_bdc_event_requested_data_t* request);
+
+static void tx_pipeline_unlink(mtk_bulk_data_collection_packet_t* lp);
+
+static void tx_pipeline_links_clear(void);
+
+static bool tx_chain_holds(const mtk_bulk_data_collection_packet_t* lp);
+
+static int tx_symbol_send(const mtk_bulk_data_collection_packet_t* large_packet);
+
+static int tx_mc_repair_start(mtk_bulk_data_collection_packet_t* large_packet);
+
+static void tx_mc_nack_merge(const mtk_bdcmc_nack_t* nack);
+
+static void rx_mc_nack_heard(const mtk_bdcmc_nack_t* nack);
+
+static void rx_mc_nack(rx_session_t* s);
+
+static clock_time_t rx_mc_backoff_get(void);
+
+static int rx_symbol_place(rx_session_t* s,
+                           mtk_bdc_event_subpacket_data_t* sp,
+                           const uint8_t* payload);
+
+static void rx_symbols_peel(rx_session_t* s);
+
+static void mc_nack_handle(const mtk_bdcmc_nack_t* nack);
+
+static uint64_t symbol_code_mask_get(const mtk_bulk_data_collection_packet_t* lp, uint64_t mask);
+
+static uint8_t mask_lowest(uint64_t mask);
+
+static bool net_joined(void);
+
+#if MTK_BULK_DATA_COLLECTION_TX_STREAM
+/* Sub-packets of a streamed packet: the one being sent, and those read ahead. */
+#define TX_STREAM_NUM_BUFFERS (1 + MTK_BULK_DATA_COLLECTION_TX_READ_AHEAD)
+
+struct tx_stream_buffer
+{
+    bool valid;
+    uint8_t index;
+    uint8_t data[MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES];
+};
+
+static tx_stream_buffer_t tx_stream_buffers[TX_STREAM_NUM_BUFFERS];
+#endif
+
+/* Reception of a packet. Sub-packets are placed in the UDP callback by
+ * sub_packet_place(), and accounted for in mtk_bulk_data_collection_receive_proc,
+ * both finding the session by sender address and packet id. */
+struct rx_session
+{
+    /* Packet being received, NULL if the session is free */
+    mtk_bulk_data_collection_packet_t* packet;
+    struct etimer timeout_timer;
+    int re_tx_requests_left;
+
+    /* Set while the node is not joined, see rx_session_suspend(). The timeout
+     * timer then checks the network state instead. */
+    bool suspended;
+
+    /* Reorder window when receiving to a write callback. Sub-packet i is held
+     * in slot i % MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW until all before
+     * it are written. Slots are blocks of the receive buffer pool, owned by the
+     * session, taken as needed and freed once the reception ends. */
+    uint16_t window_len[MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW];
+    uint8_t next_in_order;
+    uint16_t delivered_len;
+    /* CRC-32 of the data written, if written from the start */
+    uint32_t delivered_crc;
+    bool delivered_crc_valid;
+
+    /* Gap detection: number of sub-packets up to the highest one received
+     * since the last request, sub-packets already NACKed, and time of the last
+     * NACK. */
+    uint8_t n_seen;
+    uint64_t nacked_mask;
+    clock_time_t last_nack_time;
+
+    /* Sub-packets requested in the current round, for the loss estimate. */
+    uint64_t round_mask;
+
+    /* Sub-packets written at the previous checkpoint */
+    uint64_t checkpoint_mask;
+
+    /* Delta reception: number of sub-packets of the previous version, held in
+     * the payload, and its length. See rx_delta_hashes_get(). */
+    bool delta;
+    uint8_t delta_n_hashes;
+    uint16_t delta_previous_len;
+
+    /* Multicast reception: missing sub-packets are NACKed when the timer
+     * expires, unless suppressed meanwhile. */
+    bool mc_nack_pending;
+
+    /* Fountain coding: symbols of the current repair round, coding the
+     * sub-packets of mc_repair_mask. Symbols of more than one unknown
+     * sub-packet are held in slots of the reorder window, unused when
+     * receiving to payload, symbol_mask telling their unknown sub-packets, 0
+     * for free slots. */
+    uint64_t mc_repair_mask;
+    uint8_t mc_first_symbol;
+    uint8_t mc_n_symbols;
+    uint64_t symbol_mask[MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW];
+};
+
+static rx_session_t rx_sessions[MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS];
+
+/* Hashes of the previous version of a delta reception, computed for each of
+ * its requests. */
+static uint32_t rx_delta_hashes[MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS];
+
+static mtk_bulk_data_collection_checkpoint_callback_t rx_checkpoint_callback;
+static uint8_t rx_checkpoint_interval;
+static void* rx_checkpoint_storage;
+
 int mtk_bulk_data_collection_init(mtk_bulk_data_collection_role_t role)
 {
     if (large_packet_udp_connection != NULL) {
@@ -86,7 +357,10 @@ int mtk_bulk_data_collection_init(mtk_bulk_data_collection_role_t role)
         (void)mira_net_udp_close(large_packet_udp_connection);
     }
 
-    if (role == MTK_BULK_DATA_COLLECTION_RECEIVER) {
+    /* Requests and sub-packets are sent to the port of the signal they answer,
+     * so that a dual node sends from the port it listens on, and both roles
+     * share the connection. */
+    if (role == MTK_BULK_DATA_COLLECTION_RECEIVER || role == MTK_BULK_DATA_COLLECTION_DUAL) {
         large_packet_udp_connection = mira_net_udp_listen(
           MTK_BULK_DATA_COLLECTION_RX_UDP_PORT, large_packet_udp_listen_callback, NULL);
     } else {
@@ -102,6 +376,10 @@ int mtk_bulk_data_collection_init(mtk_bulk_data_collection_role_t role)
         return -1;
     }
 
+    if (mtk_bdcevq_init() < 0) {
+        P_ERR("%s: mtk_bdcevq_init\n", __func__);
+        return -1;
+    }
     if (mtk_bdcsig_init(large_packet_udp_connection) < 0) {
         P_ERR("%s: mtk_bdcsig_init\n", __func__);
         return -1;
@@ -114,10 +392,13 @@ int mtk_bulk_data_collection_init(mtk_bulk_data_collection_role_t role)
         P_ERR("%s: mtk_bdcsp_init\n", __func__);
         return -1;
     }
+    mtk_bdcmc_nack_handler_set(mc_nack_handle);
 
     large_packet_currently_sending = false;
 
     event_bdc_received = process_alloc_event();
+    event_bdc_receive_failed = process_alloc_event();
+    event_bdc_released = process_alloc_event();
 
     return 0;
 }
@@ -145,26 +426,56 @@ uint8_t mtk_bulk_data_collection_n_sub_packets_get(const uint16_t n_bytes)
     return d.quot + ((d.rem > 0) ? 1 : 0);
 }
 
+int mtk_bulk_data_collection_sub_packet_size_set(mtk_bulk_data_collection_packet_t* lp,
+                                                 const uint16_t size,
+                                                 const uint16_t len)
+{
+    uint16_t actual_size = (size != 0) ? size : MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+
+    if (actual_size > MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES || len == 0) {
+        return -1;
+    }
+
+    uint32_t n_sub_packets = ((uint32_t)len + actual_size - 1) / actual_size;
+    if (n_sub_packets > MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS) {
+        P_ERR("%s: sub-packets of %d bytes too small for %d bytes\n", __func__, size, len);
+        return -1;
+    }
+
+    lp->sub_packet_size = (actual_size != MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) ? size : 0;
+    lp->num_sub_packets = n_sub_packets;
+
+    return 0;
+}
+
+uint16_t mtk_bulk_data_collection_sub_packet_size_choose(const mira_net_address_t* src,
+                                                         const uint16_t len)
+{
+    if (!mtk_bdcest_lossy(src)) {
+        return 0;
+    }
+
+    /* As small as the number of sub-packets allows */
+    uint16_t size = MTK_BULK_DATA_COLLECTION_SUBPACKET_SMALL_BYTES;
+    uint16_t min_size = ((uint32_t)len + MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS - 1) /
+                        MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS;
+    if (size < min_size) {
+        size = min_size;
+    }
+
+    return (size < MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) ? size : 0;
+}
+
 int mtk_bulk_data_collection_register_tx(mtk_bulk_data_collection_packet_t* large_packet,
                                          const uint16_t packet_id,
                                          const uint8_t* payload,
                                          const uint16_t len)
 {
-    if (payload == NULL || len == 0) {
-        return -1;
-    }
-    if (len > (MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES *
-               MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS)) {
-        P_ERR("%s: ! packet too large\n", __func__);
+    if (payload == NULL || register_tx_common(large_packet, packet_id, len) < 0) {
         return -1;
     }
 
     large_packet->payload = (uint8_t*)payload;
-    large_packet->len = len;
-    large_packet->id = packet_id;
-
-    div_t d = div(len, MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES);
-    large_packet->num_sub_packets = d.quot + ((d.rem != 0) ? 1 : 0);
 
     /* Assuming chars, and more than 10 of them */
     P_DEBUG("Registered for transmission: packet %d, len %d, num_sub_packets %d. Content start: "
@@ -177,236 +488,2260 @@ int mtk_bulk_data_collection_register_tx(mtk_bulk_data_collection_packet_t* larg
     return 0;
 }
 
-int mtk_bulk_data_collection_send(mtk_bulk_data_collection_packet_t* large_packet)
+int mtk_bulk_data_collection_register_tx_stream(
+  mtk_bulk_data_collection_packet_t* large_packet,
+  const uint16_t packet_id,
+  mtk_bulk_data_collection_read_callback_t read_callback,
+  const uint16_t len,
+  void* storage)
 {
-    if (large_packet_currently_sending) {
-        P_DEBUG("Large packet sending requested while not available\n");
+#if !MTK_BULK_DATA_COLLECTION_TX_STREAM
+    P_ERR("%s: MTK_BULK_DATA_COLLECTION_TX_STREAM not set\n", __func__);
+    return -1;
+#endif
+    if (read_callback == NULL || register_tx_common(large_packet, packet_id, len) < 0) {
         return -1;
     }
 
-    /* Kill possibly running sending before starting anew. */
-    process_exit(&mtk_bulk_data_collection_send_proc);
-    process_start(&mtk_bulk_data_collection_send_proc, large_packet);
+    large_packet->payload = NULL;
+    large_packet->read_callback = read_callback;
+    large_packet->storage = storage;
+
+    P_DEBUG("Registered for streamed transmission: packet %d, len %d, num_sub_packets %d\n",
+            packet_id,
+            len,
+            large_packet->num_sub_packets);
 
     return 0;
 }
 
-PROCESS_THREAD(mtk_bulk_data_collection_receive_proc, ev, data)
+int mtk_bulk_data_collection_register_rx_sink(
+  mtk_bulk_data_collection_packet_t* large_packet,
+  mtk_bulk_data_collection_write_callback_t write_callback,
+  void* storage)
 {
-    PROCESS_BEGIN();
+    if (write_callback == NULL) {
+        return -1;
+    }
 
-    static struct etimer timeout_timer;
-    static mtk_bulk_data_collection_packet_t* lp;
-    static bool rx_done;
-    static int re_tx_requests_left;
+    large_packet->payload = NULL;
+    large_packet->write_callback = write_callback;
+    large_packet->storage = storage;
+    large_packet->pooled = false;
 
-    lp = (mtk_bulk_data_collection_packet_t*)data;
-    re_tx_requests_left = LP_MAX_NUM_RETRANSMISSION_REQUESTS;
+    return 0;
+}
 
-    rx_done = false;
+int mtk_bulk_data_collection_register_rx_pool(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    if (mtk_bdcpool_held(large_packet)) {
+        P_DEBUG("%s: packet %d not released\n", __func__, large_packet->id);
+        return -1;
+    }
 
-    while (!rx_done) {
-        uint32_t timeout_ticks = 10 * lp->period_ms * CLOCK_SECOND / 1000;
-        etimer_set(&timeout_timer, timeout_ticks);
+    large_packet->payload = NULL;
+    large_packet->write_callback = NULL;
+    large_packet->pooled = true;
 
-        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timeout_timer) ||
-                                 ev == event_bdc_subpacket_received);
+    return 0;
+}
 
-        if (etimer_expired(&timeout_timer)) {
-            P_DEBUG("%s: timed out while receiving sub-packets\n", __func__);
-            if (re_tx_requests_left > 0) {
-                request_for_missing_subpackets(lp);
-                re_tx_requests_left--;
-            } else {
-                P_DEBUG("%s: max number of re-transmission requests reached (%d). Abort.\n",
-                        __func__,
-                        LP_MAX_NUM_RETRANSMISSION_REQUESTS);
-                PROCESS_EXIT();
-            }
-        } else if (ev == event_bdc_subpacket_received) {
-            mtk_bdc_event_subpacket_data_t* ed = (mtk_bdc_event_subpacket_data_t*)data;
+const uint8_t* mtk_bulk_data_collection_pooled_get(
+  const mtk_bulk_data_collection_packet_t* large_packet,
+  const uint8_t index,
+  uint16_t* len)
+{
+    if (!large_packet->pooled || index >= large_packet->num_sub_packets) {
+        return NULL;
+    }
 
-            if (lp_fault_injected()) {
-                P_DEBUG("%s: simulate packet loss by discarding sub-packet %d\n",
-                        __func__,
-                        ed->sub_packet_index);
-                continue;
-            }
+    *len = sub_packet_len_get(large_packet, index);
 
-            if (ed->packet_id != lp->id) {
-                P_DEBUG("%s: received sub-packet with id %d, expected %d\n",
-                        __func__,
-                        ed->packet_id,
-                        lp->id);
-                printf("Got wrong subpacket\n");
-                PROCESS_EXIT();
-            }
+    return mtk_bdcpool_get(large_packet, index);
+}
+
+void mtk_bulk_data_collection_pooled_hold(const mtk_bulk_data_collection_packet_t* large_packet)
+{
+    mtk_bdcpool_ref(large_packet);
+}
 
-            /* Add checking of address and port here, especially if
-             * implementing multiple parallel transactions.  */
+void mtk_bulk_data_collection_pooled_release(
+  const mtk_bulk_data_collection_packet_t* large_packet)
+{
+    mtk_bdcpool_unref(large_packet);
+}
 
-            uint64_t sub_packet_received_mask_bit = ((uint64_t)1) << ed->sub_packet_index;
+int mtk_bulk_data_collection_content_hash_compute(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    uint32_t crc = 0;
 
-            if (lp->mask & sub_packet_received_mask_bit) {
-                P_DEBUG("Duplicate sub-packet received\n");
-                continue;
-            }
+    for (uint8_t i = 0; i < large_packet->num_sub_packets; ++i) {
+        const uint8_t* data = sub_packet_data_get(large_packet, i);
+        if (data == NULL) {
+            return -1;
+        }
+        crc = mtk_bdccrc_crc32(crc, data, sub_packet_len_get(large_packet, i));
+    }
 
-            lp->mask |= sub_packet_received_mask_bit;
+    large_packet->content_hash = crc;
+    large_packet->flags |=
+      MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH | MTK_BULK_DATA_COLLECTION_FLAG_LENGTH;
 
-            uint16_t offset_in_dst_payload =
-              ed->sub_packet_index * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+    return 0;
+}
 
-            memcpy(lp->payload + offset_in_dst_payload, ed->payload, ed->payload_len);
-            lp->len += ed->payload_len;
+int mtk_bulk_data_collection_compression_enable(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    uint32_t compressed_len = 0;
 
-            uint64_t all_done_mask =
-              (ed->n_sub_packets == 64) ? UINT64_MAX : (((uint64_t)1) << ed->n_sub_packets) - 1;
-            rx_done = lp->mask == all_done_mask;
-        }
+    if (large_packet->flags & MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN) {
+        return -1;
     }
 
-    if (process_post(PROCESS_BROADCAST, event_bdc_received, NULL) != PROCESS_ERR_OK) {
-        P_ERR("%s: process_post event_bdc_received\n", __func__);
+    for (uint8_t i = 0; i < large_packet->num_sub_packets; ++i) {
+        sub_packet_t sp = {
+            .index = i,
+            .len = sub_packet_len_get(large_packet, i),
+            .payload = sub_packet_data_get(large_packet, i),
+        };
+        if (sp.payload == NULL) {
+            return -1;
+        }
+        compressed_len += sub_packet_compress(sp).len;
     }
 
-    PROCESS_END();
+    large_packet->original_len = large_packet->len;
+    large_packet->compressed_len = compressed_len;
+    large_packet->flags |= MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED;
+
+    P_DEBUG("Packet %d compressed from %d to %d bytes\n",
+            large_packet->id,
+            large_packet->original_len,
+            large_packet->compressed_len);
+
+    return 0;
 }
 
-PROCESS_THREAD(mtk_bulk_data_collection_send_proc, ev, data)
+int mtk_bulk_data_collection_fountain_enable(mtk_bulk_data_collection_packet_t* large_packet)
 {
-    static struct etimer timer;
-    static int sub_packet_send_status;
-    static mtk_bulk_data_collection_packet_t* large_packet;
+    if (large_packet->payload == NULL || large_packet->read_callback != NULL ||
+        (large_packet->flags & MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED)) {
+        return -1;
+    }
 
-    PROCESS_BEGIN();
+    large_packet->flags |= MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN;
 
-    large_packet = (mtk_bulk_data_collection_packet_t*)data;
+    return 0;
+}
+
+int mtk_bulk_data_collection_delta_apply(mtk_bulk_data_collection_packet_t* large_packet,
+                                         const uint8_t n_hashes,
+                                         const uint32_t* hashes)
+{
+    uint64_t unchanged_mask = 0;
 
-    large_packet_currently_sending = true;
-    sub_packet_send_status = 0; /* >= 0 means OK */
+    for (uint8_t i = 0; i < n_hashes && i < large_packet->num_sub_packets; ++i) {
+        uint64_t bit = ((uint64_t)1) << i;
+        if (!(large_packet->mask & bit)) {
+            continue;
+        }
 
-    P_DEBUG("Start of large packet transmission (@%d ms), mask 0x%08" PRIu32 "%08" PRIu32 "\n",
-            large_packet->period_ms,
-            (uint32_t)(large_packet->mask >> 32),
-            (uint32_t)(large_packet->mask & (UINT32_MAX)));
+        const uint8_t* data = sub_packet_data_get(large_packet, i);
+        if (data == NULL) {
+            return -1;
+        }
+        if (sub_packet_hash(data, sub_packet_len_get(large_packet, i)) == hashes[i]) {
+            unchanged_mask |= bit;
+        }
+    }
 
-    while (large_packet->mask != 0 && sub_packet_send_status >= 0) {
-        sub_packet_send_status = next_sub_packet_send(large_packet);
-        etimer_set(&timer, large_packet->period_ms * CLOCK_SECOND / 1000);
-        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+    if (unchanged_mask == 0) {
+        return 0;
     }
 
-    P_DEBUG("Large packet sent: %s\n", (sub_packet_send_status >= 0) ? "OK" : "Failed");
+    P_DEBUG("Packet %d: unchanged sub-packets 0x%08" PRIu32 "%08" PRIu32 "\n",
+            large_packet->id,
+            (uint32_t)(unchanged_mask >> 32),
+            (uint32_t)(unchanged_mask & UINT32_MAX));
 
-    large_packet_currently_sending = false;
+    large_packet->mask &= ~unchanged_mask;
 
-    PROCESS_END();
+    return mtk_bdcreq_send_unchanged(
+      &large_packet->node_addr, large_packet->node_port, large_packet->id, unchanged_mask);
 }
 
-static void request_for_missing_subpackets(const mtk_bulk_data_collection_packet_t* lp)
+int mtk_bulk_data_collection_signal(const mtk_bulk_data_collection_packet_t* large_packet,
+                                    const mira_net_address_t* dst)
 {
-    uint64_t received_mask = lp->mask;
+    return mtk_bdcsig_send_packet(dst, large_packet);
+}
+
+int mtk_bulk_data_collection_signal_manifest(
+  const mtk_bulk_data_collection_packet_t* const* packets,
+  const uint8_t n_packets,
+  const mira_net_address_t* dst)
+{
+    mtk_bulk_data_collection_manifest_entry_t
+      entries[MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES];
 
-    uint64_t new_request_mask = received_mask ^ UINT64_MAX;
+    if (n_packets > MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES) {
+        return -1;
+    }
 
-    if (lp->num_sub_packets < 64) {
-        new_request_mask &= (((uint64_t)1) << lp->num_sub_packets) - 1;
+    for (uint8_t i = 0; i < n_packets; ++i) {
+        entries[i] = (mtk_bulk_data_collection_manifest_entry_t){
+            .packet_id = packets[i]->id,
+            .n_sub_packets = packets[i]->num_sub_packets,
+            .len = packets[i]->len,
+            .priority = packets[i]->priority,
+        };
     }
 
-    RUN_CHECK(
-      mtk_bdcreq_send(&lp->node_addr, lp->node_port, lp->id, new_request_mask, lp->period_ms));
+    return mtk_bdcsig_send_manifest(dst, entries, n_packets);
 }
 
-static int next_sub_packet_send(mtk_bulk_data_collection_packet_t* large_packet)
+int mtk_bulk_data_collection_checkpoint_register(
+  mtk_bulk_data_collection_checkpoint_callback_t callback,
+  uint8_t interval,
+  void* storage)
 {
-    if (large_packet_udp_connection == NULL) {
-        P_ERR("%s: no UDP connection!\n", __func__);
-        return -1;
-    }
+    rx_checkpoint_callback = callback;
+    rx_checkpoint_interval = (interval > 0) ? interval : 1;
+    rx_checkpoint_storage = storage;
 
-    sub_packet_t sub_packet = pick_next_to_send(large_packet);
+    return 0;
+}
 
-    if (sub_packet.len > MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) {
-        P_ERR("%s: sub-packet too large! (%d > %d)\n",
-              __func__,
-              sub_packet.len,
-              MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES);
-        return -1;
+bool mtk_bulk_data_collection_dedup(const mtk_bulk_data_collection_packet_t* lp,
+                                    const uint16_t len)
+{
+    if (!(lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH) ||
+        !mtk_bdcdup_contains(lp->content_hash, len)) {
+        return false;
     }
 
-    int ret = mtk_bdcsp_send(&large_packet->node_addr,
-                             large_packet->node_port,
-                             large_packet->id,
-                             sub_packet.index,
-                             large_packet->num_sub_packets,
-                             sub_packet.payload,
-                             sub_packet.len);
+    P_DEBUG("%s: packet %d already received\n", __func__, lp->id);
 
-    if (ret >= 0) {
-        large_packet->mask &= ~(((uint64_t)1) << sub_packet.index);
-    } else {
-        P_ERR("%s: could not send sub-packet\n", __func__);
+    if (mtk_bdcreq_send_ack(&lp->node_addr, lp->node_port, lp->id) < 0) {
+        P_ERR("%s: mtk_bdcreq_send_ack\n", __func__);
+        return false;
     }
 
-    return ret;
+    return true;
 }
 
-static sub_packet_t pick_next_to_send(const mtk_bulk_data_collection_packet_t* lp)
+int mtk_bulk_data_collection_delta_request(mtk_bulk_data_collection_packet_t* lp,
+                                           const uint16_t previous_len)
 {
-    sub_packet_t sp = {
-        .payload = NULL,
-    };
+    if (lp->payload == NULL || lp->write_callback != NULL || lp->sub_packet_size != 0) {
+        /* The previous version must be at hand in payload, hashed by
+         * sub-packets of the default size */
+        return -1;
+    }
 
-    for (int i = 0; sp.payload == NULL && i < MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS &&
-                    i < lp->num_sub_packets;
-         ++i) {
-        if ((((uint64_t)1) << i) & lp->mask) {
-            sp.index = i;
-            sp.payload = lp->payload + i * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
-
-            if (i == (lp->num_sub_packets - 1)) {
-                /* last sub-packet might be smaller than max */
-                sp.len = lp->len % MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
-                if (sp.len == 0) {
-                    /* but if last sub-packet is MAX_BYTES long, modulo gives
-                     * 0. Set correct length (full length) instead. */
-                    sp.len = MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
-                }
-            } else {
-                sp.len = MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
-            }
-        }
+    uint64_t request_mask;
+    if (mtk_bulk_data_collection_send_whole_mask_get(&request_mask, lp->num_sub_packets) < 0) {
+        return -1;
     }
 
-    return sp;
+    rx_session_t* s = rx_session_alloc(lp);
+    if (s == NULL) {
+        return -1;
+    }
+
+    /* Sub-packets that the previous version has */
+    s->delta_n_hashes = mtk_bulk_data_collection_n_sub_packets_get(previous_len);
+    if (s->delta_n_hashes > lp->num_sub_packets) {
+        s->delta_n_hashes = lp->num_sub_packets;
+    }
+    s->delta_previous_len = previous_len;
+    s->delta = true;
+
+    lp->mask = 0;
+    lp->len = 0;
+
+    if (mtk_bdcreq_send_delta(&lp->node_addr,
+                              lp->node_port,
+                              lp->id,
+                              request_mask,
+                              lp->period_ms,
+                              s->delta_n_hashes,
+                              rx_delta_hashes_get(s)) < 0) {
+        P_ERR("%s: mtk_bdcreq_send_delta\n", __func__);
+        s->packet = NULL;
+        return -1;
+    }
+
+    rx_session_start(s, 0);
+
+    return 0;
 }
 
-static void large_packet_udp_listen_callback(mira_net_udp_connection_t* connection,
-                                             const void* data,
-                                             uint16_t data_len,
-                                             const mira_net_udp_callback_metadata_t* metadata,
-                                             void* storage)
+int mtk_bulk_data_collection_resume(mtk_bulk_data_collection_packet_t* lp,
+                                    const mtk_bulk_data_collection_checkpoint_t* checkpoint)
 {
-#if DEBUG > 0
-    char buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
-#endif
-    P_DEBUG("Received UDP packet from [%s]:%u, len %d\n",
-            mira_net_toolkit_format_address(buffer, metadata->source_address),
-            metadata->source_port,
-            data_len);
+    /* The pool doesn't outlive a reboot */
+    if (lp->pooled) {
+        return -1;
+    }
 
-    if (data_len < MTK_BULK_DATA_COLLECTION_HEADER_SIZE) {
-        P_ERR("%s: UDP packet too short\n", __func__);
-        return;
+    if (checkpoint->id != lp->id || checkpoint->num_sub_packets != lp->num_sub_packets ||
+        !(lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH) ||
+        checkpoint->content_hash != lp->content_hash ||
+        memcmp(&checkpoint->node_addr, &lp->node_addr, sizeof(mira_net_address_t)) != 0) {
+        P_DEBUG("%s: checkpoint doesn't match packet %d\n", __func__, lp->id);
+        return -1;
     }
 
-    mtk_bdcsig_handle_data(data, data_len, metadata);
-    mtk_bdcreq_handle_data(data, data_len, metadata);
-    mtk_bdcsp_handle_data(data, data_len, metadata);
+    lp->mask = checkpoint->mask;
+    lp->len = checkpoint->len;
+    lp->sub_packet_size = checkpoint->sub_packet_size;
+
+    return mtk_bulk_data_collection_collect(lp);
 }
 
-static bool lp_fault_injected(void)
+int mtk_bulk_data_collection_receive_start(mtk_bulk_data_collection_packet_t* lp)
 {
-    return mira_random_generate() < (FAULT_RATE_PERCENT * UINT16_MAX / 100);
+    /* Symbols are decoded in payload */
+    if ((lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN) &&
+        (lp->write_callback != NULL || lp->pooled)) {
+        return -1;
+    }
+
+    rx_session_t* s = rx_session_alloc(lp);
+
+    if (s == NULL) {
+        return -1;
+    }
+
+    /* Confirm a pushed transfer, with an empty NACK, for it to go on */
+    if ((lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_PUSH) &&
+        mtk_bdcreq_send_nack(&lp->node_addr, lp->node_port, lp->id, 0, lp->period_ms) < 0) {
+        P_ERR("%s: mtk_bdcreq_send_nack\n", __func__);
+    }
+
+    rx_session_start(s, 0);
+
+    return 0;
+}
+
+int mtk_bulk_data_collection_collect(mtk_bulk_data_collection_packet_t* lp)
+{
+    rx_session_t* s = rx_session_alloc(lp);
+
+    if (s == NULL) {
+        return -1;
+    }
+
+    uint64_t missing_mask = rx_missing_mask_get(lp);
+    if (missing_mask != 0 && mtk_bdcreq_send_sized(&lp->node_addr,
+                                                   lp->node_port,
+                                                   lp->id,
+                                                   missing_mask,
+                                                   lp->period_ms,
+                                                   lp->sub_packet_size) < 0) {
+        P_ERR("%s: mtk_bdcreq_send_sized\n", __func__);
+        s->packet = NULL;
+        return -1;
+    }
+
+    rx_session_start(s, 0);
+
+    return 0;
+}
+
+int mtk_bulk_data_collection_collect_batch(mtk_bulk_data_collection_packet_t* const* packets,
+                                           const uint8_t n_packets)
+{
+    rx_session_t* sessions[1 + MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS];
+    uint16_t batch_ids[MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS];
+    uint8_t n_allocated = 0;
+
+    if (n_packets == 0 || n_packets > 1 + MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS) {
+        return -1;
+    }
+
+    const mtk_bulk_data_collection_packet_t* first = packets[0];
+
+    for (uint8_t i = 0; i < n_packets; ++i) {
+        if (packets[i]->sub_packet_size != 0) {
+            /* Not sent along in batch requests */
+            return -1;
+        }
+    }
+
+    for (uint8_t i = 0; i < n_packets; ++i) {
+        if (memcmp(&packets[i]->node_addr, &first->node_addr, sizeof(mira_net_address_t)) != 0 ||
+            (sessions[i] = rx_session_alloc(packets[i])) == NULL) {
+            break;
+        }
+        n_allocated++;
+        if (i > 0) {
+            /* Sent whole */
+            packets[i]->mask = 0;
+            packets[i]->len = 0;
+            batch_ids[i - 1] = packets[i]->id;
+        }
+    }
+
+    if (n_allocated < n_packets ||
+        mtk_bdcreq_send_batch(&first->node_addr,
+                              first->node_port,
+                              first->id,
+                              rx_missing_mask_get(first),
+                              first->period_ms,
+                              n_packets - 1,
+                              batch_ids) < 0) {
+        P_ERR("%s: could not request %d packets\n", __func__, n_packets);
+        for (uint8_t i = 0; i < n_allocated; ++i) {
+            sessions[i]->packet = NULL;
+        }
+        return -1;
+    }
+
+    /* The first sub-packet of each packet is due after those of the packets
+     * before it. */
+    clock_time_t delay = 0;
+    for (uint8_t i = 0; i < n_packets; ++i) {
+        uint8_t n_sent = mask_count(rx_missing_mask_get(packets[i]));
+        rx_session_start(sessions[i], delay);
+        delay += n_sent * first->period_ms * CLOCK_SECOND / 1000;
+    }
+
+    return 0;
+}
+
+int mtk_bulk_data_collection_send(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    /* Requested again, which the pipeline serves */
+    if (tx_pipeline && tx_chain_holds(large_packet)) {
+        return 0;
+    }
+
+    if (large_packet_currently_sending) {
+        P_DEBUG("Large packet sending requested while not available\n");
+        return -1;
+    }
+
+    uint8_t n_chained = 0;
+    for (const mtk_bulk_data_collection_packet_t* lp = large_packet; lp != NULL; lp = lp->next) {
+        if (++n_chained > TX_CHAIN_MAX_PACKETS) {
+            P_ERR("%s: more than %d packets chained\n", __func__, TX_CHAIN_MAX_PACKETS);
+            return -1;
+        }
+    }
+
+    tx_release(large_packet);
+
+    tx_push = false;
+    tx_multicast = false;
+    tx_pipeline = false;
+
+    /* Kill possibly running sending before starting anew. */
+    process_exit(&mtk_bulk_data_collection_send_proc);
+    process_start(&mtk_bulk_data_collection_send_proc, large_packet);
+
+    return 0;
+}
+
+int mtk_bulk_data_collection_push(mtk_bulk_data_collection_packet_t* large_packet,
+                                  const mira_net_address_t* dst)
+{
+    if (large_packet_currently_sending) {
+        P_DEBUG("Large packet push requested while not available\n");
+        return -1;
+    }
+
+    if (mtk_bulk_data_collection_send_whole_mask_get(&large_packet->mask,
+                                                     large_packet->num_sub_packets) < 0) {
+        return -1;
+    }
+    memcpy(&large_packet->node_addr, dst, sizeof(mira_net_address_t));
+    large_packet->node_port = MTK_BULK_DATA_COLLECTION_RX_UDP_PORT;
+    if (large_packet->period_ms == 0) {
+        large_packet->period_ms = MTK_BULK_DATA_COLLECTION_PUSH_PERIOD_MS;
+    }
+
+    /* Only the signal tells that the transfer is pushed */
+    large_packet->flags |= MTK_BULK_DATA_COLLECTION_FLAG_PUSH;
+    int ret = mtk_bdcsig_send_packet(dst, large_packet);
+    large_packet->flags &= ~MTK_BULK_DATA_COLLECTION_FLAG_PUSH;
+    if (ret < 0) {
+        return -1;
+    }
+
+    tx_release(large_packet);
+
+    tx_push = true;
+    tx_push_left = MTK_BULK_DATA_COLLECTION_PUSH_WINDOW;
+    tx_multicast = false;
+    tx_pipeline = false;
+
+    process_exit(&mtk_bulk_data_collection_send_proc);
+    process_start(&mtk_bulk_data_collection_send_proc, large_packet);
+
+    return 0;
+}
+
+int mtk_bulk_data_collection_pipeline(mtk_bulk_data_collection_packet_t* large_packet,
+                                      const mira_net_address_t* dst)
+{
+    /* Appended to the running pipeline to dst, if any, the process being
+     * either sending or keeping its packets */
+    bool append = tx_pipeline && tx_chain != NULL &&
+                  process_is_running(&mtk_bulk_data_collection_send_proc) &&
+                  memcmp(&tx_chain->node_addr, dst, sizeof(mira_net_address_t)) == 0;
+
+    if (!append && large_packet_currently_sending) {
+        P_DEBUG("Large packet pipeline requested while not available\n");
+        return -1;
+    }
+
+    uint8_t depth = 0;
+    mtk_bulk_data_collection_packet_t* tail = NULL;
+    for (mtk_bulk_data_collection_packet_t* lp = (append ? tx_chain : NULL); lp != NULL;
+         lp = lp->next) {
+        if (lp == large_packet) {
+            return -1;
+        }
+        tail = lp;
+        depth++;
+    }
+    if (depth >= MTK_BULK_DATA_COLLECTION_PIPELINE_DEPTH) {
+        P_DEBUG("Pipeline full, packet %d not sent\n", large_packet->id);
+        return -1;
+    }
+
+    if (large_packet->next != NULL ||
+        mtk_bulk_data_collection_send_whole_mask_get(&large_packet->mask,
+                                                     large_packet->num_sub_packets) < 0) {
+        return -1;
+    }
+    memcpy(&large_packet->node_addr, dst, sizeof(mira_net_address_t));
+    large_packet->node_port = MTK_BULK_DATA_COLLECTION_RX_UDP_PORT;
+    if (large_packet->period_ms == 0) {
+        large_packet->period_ms = MTK_BULK_DATA_COLLECTION_PUSH_PERIOD_MS;
+    }
+
+    /* Signaled right away, while the packets before it are being sent */
+    large_packet->flags |= MTK_BULK_DATA_COLLECTION_FLAG_PUSH;
+    int ret = mtk_bdcsig_send_packet(dst, large_packet);
+    large_packet->flags &= ~MTK_BULK_DATA_COLLECTION_FLAG_PUSH;
+    if (ret < 0) {
+        return -1;
+    }
+
+    if (append) {
+        tail->next = large_packet;
+        tx_kept_mask |= ((uint32_t)1) << depth;
+        /* Wake the process if it is only keeping packets */
+        process_poll(&mtk_bulk_data_collection_send_proc);
+        return 0;
+    }
+
+    tx_release(large_packet);
+
+    tx_push = false;
+    tx_multicast = false;
+    tx_pipeline = true;
+
+    process_exit(&mtk_bulk_data_collection_send_proc);
+    process_start(&mtk_bulk_data_collection_send_proc, large_packet);
+
+    return 0;
+}
+
+int mtk_bulk_data_collection_multicast(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    if (large_packet_currently_sending) {
+        P_DEBUG("Large packet multicast requested while not available\n");
+        return -1;
+    }
+
+    if (large_packet->next != NULL ||
+        mtk_bulk_data_collection_send_whole_mask_get(&large_packet->mask,
+                                                     large_packet->num_sub_packets) < 0) {
+        return -1;
+    }
+    if (large_packet->period_ms == 0) {
+        large_packet->period_ms = MTK_BULK_DATA_COLLECTION_PUSH_PERIOD_MS;
+    }
+
+    /* Only the signal tells that the transfer is multicast */
+    large_packet->flags |= MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST;
+    int ret = mtk_bdcmc_signal(large_packet);
+    large_packet->flags &= ~MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST;
+    if (ret < 0) {
+        return -1;
+    }
+
+    tx_release(large_packet);
+
+    tx_push = false;
+    tx_multicast = true;
+    tx_pipeline = false;
+    tx_mc_rounds_left = MTK_BULK_DATA_COLLECTION_MULTICAST_MAX_ROUNDS;
+    tx_mc_nack_mask = 0;
+    tx_mc_nack_max = 0;
+    tx_mc_code_mask = 0;
+    tx_mc_next_symbol = large_packet->num_sub_packets;
+    tx_mc_symbols_left = 0;
+
+    process_exit(&mtk_bulk_data_collection_send_proc);
+    process_start(&mtk_bulk_data_collection_send_proc, large_packet);
+
+    return 0;
+}
+
+int mtk_bulk_data_collection_stop(void)
+{
+    if (!large_packet_currently_sending) {
+        return -1;
+    }
+
+    /* The process only runs between sub-packets */
+    process_exit(&mtk_bulk_data_collection_send_proc);
+    large_packet_currently_sending = false;
+
+    /* Kept by the caller, without being released */
+    if (tx_pipeline) {
+        tx_pipeline_links_clear();
+    }
+    tx_chain = NULL;
+    tx_kept_mask = 0;
+    tx_push = false;
+    tx_multicast = false;
+    tx_pipeline = false;
+    tx_mc_code_mask = 0;
+    tx_mc_symbols_left = 0;
+
+    return 0;
+}
+
+PROCESS_THREAD(mtk_bulk_data_collection_receive_proc, ev, data)
+{
+    PROCESS_BEGIN();
+
+    /* Started with a packet, rather than by mtk_bulk_data_collection_receive_start() */
+    if (data != NULL) {
+        RUN_CHECK(mtk_bulk_data_collection_receive_start((mtk_bulk_data_collection_packet_t*)data));
+    }
+
+    while (rx_session_count() > 0) {
+        PROCESS_WAIT_EVENT();
+
+        if (ev == event_bdc_subpacket_received) {
+            rx_session_subpacket((const mtk_bdc_event_subpacket_data_t*)data);
+        } else if (ev == event_bdc_unchanged) {
+            rx_session_unchanged((const mtk_bdc_event_requested_data_t*)data);
+        }
+
+        for (int i = 0; i < MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS; ++i) {
+            rx_session_t* s = &rx_sessions[i];
+            if (s->packet == NULL || !etimer_expired(&s->timeout_timer)) {
+                continue;
+            }
+            if (!net_joined()) {
+                rx_session_suspend(s);
+            } else if (s->suspended) {
+                rx_session_resume(s);
+            } else {
+                rx_session_timeout(s);
+            }
+        }
+    }
+
+    PROCESS_END();
+}
+
+static rx_session_t* rx_session_find(const mira_net_address_t* addr, uint16_t packet_id)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS; ++i) {
+        rx_session_t* s = &rx_sessions[i];
+        if (s->packet != NULL && s->packet->id == packet_id &&
+            memcmp(&s->packet->node_addr, addr, sizeof(mira_net_address_t)) == 0) {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+/* Get a session for a packet. A reception of the same packet, or of the same
+ * packet id from the same sender, is replaced. */
+static rx_session_t* rx_session_alloc(mtk_bulk_data_collection_packet_t* lp)
+{
+    rx_session_t* session = rx_session_find(&lp->node_addr, lp->id);
+
+    for (int i = 0; session == NULL && i < MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS; ++i) {
+        if (rx_sessions[i].packet == lp) {
+            session = &rx_sessions[i];
+        }
+    }
+
+    if (session != NULL) {
+        P_DEBUG("%s: replacing reception of packet %d\n", __func__, session->packet->id);
+        etimer_stop(&session->timeout_timer);
+        /* The same packet keeps the sub-packets it holds. Another one ends as
+         * a failed reception, for its owner to release what it set up. */
+        if (session->packet != lp) {
+            if (session->packet->pooled) {
+                mtk_bdcpool_unref(session->packet);
+            }
+            if (process_post(PROCESS_BROADCAST, event_bdc_receive_failed, session->packet) !=
+                PROCESS_ERR_OK) {
+                P_ERR("%s: process_post event_bdc_receive_failed\n", __func__);
+            }
+        }
+    }
+
+    for (int i = 0; session == NULL && i < MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS; ++i) {
+        if (rx_sessions[i].packet == NULL) {
+            session = &rx_sessions[i];
+        }
+    }
+
+    if (session == NULL) {
+        P_DEBUG("%s: no free session for packet %d\n", __func__, lp->id);
+        return NULL;
+    }
+
+    /* Slots of a previous reception, left if set up again for the same packet,
+     * which keeps the sub-packets it holds */
+    if (session->packet != lp) {
+        mtk_bdcpool_unref(session);
+    }
+
+    session->packet = lp;
+    session->delta = false;
+
+    return session;
+}
+
+/* Set up a reception, with the sub-packets already held in the packet's mask,
+ * right after the request is sent. delay is added to the first timeout, for
+ * packets sent after others. */
+static void rx_session_start(rx_session_t* s, clock_time_t delay)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    s->re_tx_requests_left =
+      mtk_bdcest_retry_budget_get(&lp->node_addr, LP_MAX_NUM_RETRANSMISSION_REQUESTS);
+
+    mtk_bdcest_request_sent(&lp->node_addr);
+    s->round_mask = rx_missing_mask_get(lp);
+
+    /* Resumed receptions start with the sub-packets of their checkpoint. */
+    s->next_in_order = 0;
+    while (s->next_in_order < lp->num_sub_packets &&
+           ((((uint64_t)1) << s->next_in_order) & lp->mask)) {
+        s->next_in_order++;
+    }
+    s->delivered_len = lp->len;
+    s->delivered_crc = 0;
+    s->delivered_crc_valid = s->delivered_len == 0;
+    s->checkpoint_mask = rx_written_mask_get(s);
+
+    s->n_seen = 0;
+    s->nacked_mask = 0;
+    s->last_nack_time = clock_time();
+    s->suspended = false;
+
+    s->mc_nack_pending = false;
+    s->mc_repair_mask = 0;
+    s->mc_n_symbols = 0;
+    memset(s->symbol_mask, 0, sizeof(s->symbol_mask));
+
+    mtk_bdcsp_rx_handler_set(sub_packet_place);
+
+    if (rx_missing_mask_get(lp) == 0) {
+        rx_session_done(s);
+        return;
+    }
+
+    /* The timer belongs to the process waiting for it */
+    PROCESS_CONTEXT_BEGIN(&mtk_bulk_data_collection_receive_proc);
+    rx_session_timer_set(s, delay);
+    PROCESS_CONTEXT_END(&mtk_bulk_data_collection_receive_proc);
+
+    if (!process_is_running(&mtk_bulk_data_collection_receive_proc)) {
+        process_start(&mtk_bulk_data_collection_receive_proc, NULL);
+    }
+}
+
+static void rx_session_timer_set(rx_session_t* s, clock_time_t delay)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    clock_time_t timeout_ticks = mtk_bdcest_timeout_get(
+      &lp->node_addr, LP_DEFAULT_TIMEOUT_PERIODS * lp->period_ms * CLOCK_SECOND / 1000);
+    etimer_set(&s->timeout_timer, timeout_ticks + delay);
+}
+
+static void rx_session_timeout(rx_session_t* s)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    if (s->mc_nack_pending) {
+        rx_mc_nack(s);
+        return;
+    }
+
+    P_DEBUG("%s: timed out while receiving packet %d\n", __func__, lp->id);
+    mtk_bdcest_round_done(
+      &lp->node_addr, mask_count(s->round_mask), mask_count(s->round_mask & lp->mask));
+
+    if (s->re_tx_requests_left <= 0) {
+        P_DEBUG("%s: max number of re-transmission requests reached. Abort.\n", __func__);
+        rx_session_abort(s);
+        return;
+    }
+
+    if (lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST) {
+        /* NACKed after a random delay, unless suppressed meanwhile, see
+         * rx_mc_nack_heard() */
+        s->mc_nack_pending = true;
+        etimer_set(&s->timeout_timer, rx_mc_backoff_get());
+        return;
+    }
+
+    request_for_missing_subpackets(s);
+    s->re_tx_requests_left--;
+    s->round_mask = rx_missing_mask_get(lp);
+    /* The sender starts over from the lowest missing sub-packet */
+    s->n_seen = 0;
+    s->nacked_mask = 0;
+
+    rx_session_timer_set(s, 0);
+}
+
+/* Freeze a reception while the node is not joined: requests would fail, using
+ * up the retry budget, and lost sub-packets would count as loss towards the
+ * sender. Masks and retries are kept as they are, and the network state is
+ * checked every MTK_BULK_DATA_COLLECTION_NET_POLL_MS. */
+static void rx_session_suspend(rx_session_t* s)
+{
+    if (!s->suspended) {
+        P_DEBUG("%s: not joined, reception of packet %d suspended\n", __func__, s->packet->id);
+        s->suspended = true;
+    }
+    etimer_set(&s->timeout_timer, MTK_BULK_DATA_COLLECTION_NET_POLL_MS * CLOCK_SECOND / 1000);
+}
+
+/* Go on with a suspended reception, requesting the missing sub-packets at once
+ * rather than waiting for a timeout. The request doesn't count as a retry. */
+static void rx_session_resume(rx_session_t* s)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    P_DEBUG("%s: joined, reception of packet %d resumed\n", __func__, lp->id);
+    s->suspended = false;
+
+    if (lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST) {
+        /* NACKed to the group, as after a timeout */
+        s->mc_nack_pending = true;
+        etimer_set(&s->timeout_timer, rx_mc_backoff_get());
+        return;
+    }
+
+    request_for_missing_subpackets(s);
+    s->round_mask = rx_missing_mask_get(lp);
+    s->n_seen = 0;
+    s->nacked_mask = 0;
+
+    rx_session_timer_set(s, 0);
+}
+
+static void rx_session_subpacket(const mtk_bdc_event_subpacket_data_t* ed)
+{
+    rx_session_t* s = rx_session_find(&ed->src, ed->packet_id);
+
+    if (s == NULL) {
+        P_DEBUG("%s: no reception of packet %d\n", __func__, ed->packet_id);
+        return;
+    }
+
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+    uint64_t sub_packet_received_mask_bit = ((uint64_t)1) << ed->sub_packet_index;
+
+    if (lp->mask & sub_packet_received_mask_bit) {
+        P_DEBUG("Duplicate sub-packet received\n");
+        return;
+    }
+
+    /* Payload already placed by sub_packet_place() */
+    lp->mask |= sub_packet_received_mask_bit;
+    lp->len += ed->payload_len;
+
+    mtk_bdcest_subpacket_received(&lp->node_addr);
+
+    rx_gap_nack(s, ed->sub_packet_index);
+
+    /* A round is running, after which the missing sub-packets are NACKed anew */
+    s->mc_nack_pending = false;
+
+    if (lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN) {
+        rx_symbols_peel(s);
+    }
+
+    rx_checkpoint(s, false);
+
+    if (lp->write_callback != NULL && rx_sink_deliver(s) < 0) {
+        P_ERR("%s: could not write received data. Abort.\n", __func__);
+        rx_session_abort(s);
+        return;
+    }
+
+    if (rx_missing_mask_get(lp) == 0) {
+        rx_session_done(s);
+        return;
+    }
+
+    rx_session_timer_set(s, 0);
+}
+
+/* Take sub-packets that the sender found unchanged from the previous version,
+ * already in place in the payload. */
+static void rx_session_unchanged(const mtk_bdc_event_requested_data_t* notice)
+{
+    rx_session_t* s = rx_session_find(&notice->src, notice->packet_id);
+
+    if (s == NULL || !s->delta) {
+        return;
+    }
+
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    for (uint8_t i = 0; i < s->delta_n_hashes; ++i) {
+        uint64_t bit = ((uint64_t)1) << i;
+        if (!(notice->mask & bit) || (lp->mask & bit)) {
+            continue;
+        }
+
+        uint16_t len = s->delta_previous_len - i * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+        if (len > MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) {
+            len = MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+        }
+
+        lp->mask |= bit;
+        lp->len += len;
+        /* Not expected anymore, which isn't a loss */
+        s->round_mask &= ~bit;
+    }
+
+    rx_checkpoint(s, false);
+
+    if (rx_missing_mask_get(lp) == 0) {
+        rx_session_done(s);
+    }
+}
+
+static void rx_session_done(rx_session_t* s)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+    process_event_t ev = event_bdc_received;
+
+    mtk_bdcest_round_done(
+      &lp->node_addr, mask_count(s->round_mask), mask_count(s->round_mask & lp->mask));
+
+    if (rx_integrity_check(s) < 0) {
+        P_ERR("%s: content hash mismatch for packet %d\n", __func__, lp->id);
+        ev = event_bdc_receive_failed;
+        if (lp->pooled) {
+            mtk_bdcpool_unref(lp);
+        }
+    } else {
+        if (lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH) {
+            mtk_bdcdup_add(lp->content_hash, lp->len);
+        }
+        /* Let the sender release the packet, but a multicast sender, which
+         * doesn't track receivers */
+        if (!(lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST) &&
+            mtk_bdcreq_send_ack(&lp->node_addr, lp->node_port, lp->id) < 0) {
+            P_ERR("%s: mtk_bdcreq_send_ack\n", __func__);
+        }
+    }
+
+    etimer_stop(&s->timeout_timer);
+    mtk_bdcpool_unref(s);
+    s->packet = NULL;
+
+    if (process_post(PROCESS_BROADCAST, ev, lp) != PROCESS_ERR_OK) {
+        P_ERR("%s: process_post\n", __func__);
+    }
+}
+
+/* Give up the reception, saving its progress. */
+static void rx_session_abort(rx_session_t* s)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    rx_checkpoint(s, true);
+
+    if (lp->pooled) {
+        mtk_bdcpool_unref(lp);
+    }
+
+    etimer_stop(&s->timeout_timer);
+    mtk_bdcpool_unref(s);
+    s->packet = NULL;
+
+    if (process_post(PROCESS_BROADCAST, event_bdc_receive_failed, lp) != PROCESS_ERR_OK) {
+        P_ERR("%s: process_post event_bdc_receive_failed\n", __func__);
+    }
+}
+
+static uint8_t rx_session_count(void)
+{
+    uint8_t n = 0;
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS; ++i) {
+        if (rx_sessions[i].packet != NULL) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+PROCESS_THREAD(mtk_bulk_data_collection_send_proc, ev, data)
+{
+    static struct etimer timer;
+    static int sub_packet_send_status;
+    static mtk_bulk_data_collection_packet_t* large_packet;
+    static uint8_t n_stalls;
+
+    PROCESS_BEGIN();
+
+    large_packet = (mtk_bulk_data_collection_packet_t*)data;
+
+    /* Symbols left by a repair round that didn't end are not sent for another
+     * packet */
+    tx_mc_code_mask = 0;
+    tx_mc_symbols_left = 0;
+
+    tx_chain = large_packet;
+    tx_kept_mask = 0;
+    for (mtk_bulk_data_collection_packet_t* lp = tx_chain; lp != NULL; lp = lp->next) {
+        tx_kept_mask = (tx_kept_mask << 1) | 1;
+    }
+
+    /* A pipeline goes back to sending for packets appended, or requested
+     * again, while kept */
+    do {
+        large_packet_currently_sending = true;
+
+        /* Packets chained by next are sent back to back, for batch requests */
+        while (large_packet != NULL) {
+            sub_packet_send_status = 0; /* >= 0 means OK */
+
+#if MTK_BULK_DATA_COLLECTION_TX_STREAM
+            /* Content read for a previous transmission may be stale. */
+            for (int i = 0; i < TX_STREAM_NUM_BUFFERS; ++i) {
+                tx_stream_buffers[i].valid = false;
+            }
+#endif
+
+            P_DEBUG("Start of large packet transmission (@%d ms, window %d), mask 0x%08" PRIu32
+                    "%08" PRIu32 "\n",
+                    large_packet->period_ms,
+                    large_packet->tx_window,
+                    (uint32_t)(large_packet->mask >> 32),
+                    (uint32_t)(large_packet->mask & (UINT32_MAX)));
+
+            n_stalls = 0;
+            while (tx_pending(large_packet) && sub_packet_send_status >= 0) {
+                /* Sending would fail while not joined. The receiver requests
+                 * the missing sub-packets once joined again. */
+                if (!net_joined()) {
+                    P_DEBUG("Not joined, transmission suspended\n");
+                    do {
+                        etimer_set(&timer,
+                                   MTK_BULK_DATA_COLLECTION_NET_POLL_MS * CLOCK_SECOND / 1000);
+                        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+                    } while (!net_joined());
+                    n_stalls = 0;
+                }
+                if (tx_push && tx_push_left == 0) {
+                    P_DEBUG("Pushed packet not confirmed, waiting for requests\n");
+                    sub_packet_send_status = -1;
+                    break;
+                }
+                sub_packet_send_status = tx_burst_send(large_packet);
+                clock_time_t wait = large_packet->period_ms * CLOCK_SECOND / 1000;
+                if (sub_packet_send_status == MTK_BDCSP_QUEUE_FULL) {
+                    /* Nothing sent, wait for the queue to drain */
+                    n_stalls++;
+                    sub_packet_send_status =
+                      (n_stalls > MTK_BULK_DATA_COLLECTION_TX_BURST_MAX_STALLS) ? -1 : 0;
+                    wait = (wait > 0) ? wait : 1;
+                } else {
+                    n_stalls = 0;
+                }
+#if MTK_BULK_DATA_COLLECTION_TX_STREAM
+                if (sub_packet_send_status >= 0 && large_packet->read_callback != NULL) {
+                    tx_stream_read_ahead(large_packet);
+                }
+#endif
+                etimer_set(&timer, wait);
+                do {
+                    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer) || ev == event_bdc_nacked ||
+                                             ev == event_bdc_rejected || ev == event_bdc_acked ||
+                                             (tx_pipeline && ev == event_bdc_requested));
+                    if (ev == event_bdc_nacked && !tx_pipeline) {
+                        tx_nack_merge(large_packet, (const mtk_bdc_event_requested_data_t*)data);
+                    } else if ((ev == event_bdc_nacked || ev == event_bdc_requested) &&
+                               tx_pipeline) {
+                        tx_pipeline_merge((const mtk_bdc_event_requested_data_t*)data);
+                    } else if (ev == event_bdc_acked ||
+                               (ev == event_bdc_rejected && tx_pipeline)) {
+                        /* A packet rejected from a pipeline is released alike */
+                        tx_acked((const mtk_bdc_event_requested_data_t*)data);
+                    } else if (ev == event_bdc_rejected &&
+                               tx_request_matches(large_packet,
+                                                  (const mtk_bdc_event_requested_data_t*)data)) {
+                        P_DEBUG("Packet %d rejected\n", large_packet->id);
+                        large_packet->mask = 0;
+                        sub_packet_send_status = -1;
+                    }
+                } while (!etimer_expired(&timer));
+
+                /* Multicast: once a round is sent, repair the sub-packets NACKed
+                 * by the receivers, if any NACKs within
+                 * MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WAIT_MS */
+                if (tx_multicast && sub_packet_send_status >= 0 && !tx_pending(large_packet)) {
+                    etimer_set(&timer,
+                               MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WAIT_MS * CLOCK_SECOND /
+                                 1000);
+                    PROCESS_WAIT_UNTIL(etimer_expired(&timer) || tx_mc_nack_mask != 0);
+                    if (tx_mc_nack_mask != 0) {
+                        /* Gather the NACKs of the other receivers */
+                        etimer_set(&timer,
+                                   MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WINDOW_MS *
+                                     CLOCK_SECOND / 1000);
+                        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+                        sub_packet_send_status = tx_mc_repair_start(large_packet);
+                    }
+                    etimer_stop(&timer);
+                }
+
+                /* Pipeline: sub-packets of packets before this one, NACKed or
+                 * requested again, go first. The packet may be released
+                 * meanwhile. */
+                if (tx_pipeline && tx_pipeline_next() != large_packet) {
+                    break;
+                }
+            }
+
+            P_DEBUG("Large packet sent: %s\n", (sub_packet_send_status >= 0) ? "OK" : "Failed");
+
+            if (sub_packet_send_status < 0) {
+                large_packet = NULL;
+            } else {
+                large_packet = tx_pipeline ? tx_pipeline_next() : large_packet->next;
+            }
+        }
+
+        large_packet_currently_sending = false;
+
+        /* Keep the packets for late requests until acknowledged. Sending anew
+         * meanwhile ends this process. */
+        etimer_set(&timer, MTK_BULK_DATA_COLLECTION_TX_LINGER_MS * CLOCK_SECOND / 1000);
+        while (tx_kept_mask != 0 && !tx_multicast && !etimer_expired(&timer) &&
+               large_packet == NULL) {
+            PROCESS_WAIT_EVENT_UNTIL(
+              etimer_expired(&timer) || ev == event_bdc_acked ||
+              (tx_pipeline && (ev == event_bdc_requested || ev == event_bdc_nacked ||
+                               ev == event_bdc_rejected || ev == PROCESS_EVENT_POLL)));
+            if (ev == event_bdc_acked || (ev == event_bdc_rejected && tx_pipeline)) {
+                tx_acked((const mtk_bdc_event_requested_data_t*)data);
+            } else if ((ev == event_bdc_requested || ev == event_bdc_nacked) && tx_pipeline) {
+                tx_pipeline_merge((const mtk_bdc_event_requested_data_t*)data);
+            }
+            if (etimer_expired(&timer) && !net_joined()) {
+                /* Kept for the request of the receiver once joined again */
+                etimer_restart(&timer);
+            }
+            if (tx_pipeline) {
+                large_packet = tx_pipeline_next();
+            }
+        }
+        etimer_stop(&timer);
+    } while (large_packet != NULL);
+
+    tx_release(NULL);
+
+    PROCESS_END();
+}
+
+/* Hash the sub-packets of the previous version of a delta reception. Those
+ * still missing are unchanged in the payload, and only those are requested,
+ * so the hashes of the others don't matter. */
+static const uint32_t* rx_delta_hashes_get(const rx_session_t* s)
+{
+    const mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    for (uint8_t i = 0; i < s->delta_n_hashes; ++i) {
+        uint16_t offset = i * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+        uint16_t len = s->delta_previous_len - offset;
+        if (len > MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) {
+            len = MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+        }
+        rx_delta_hashes[i] = sub_packet_hash(lp->payload + offset, len);
+    }
+
+    return rx_delta_hashes;
+}
+
+static void request_for_missing_subpackets(const rx_session_t* s)
+{
+    const mtk_bulk_data_collection_packet_t* lp = s->packet;
+    uint64_t new_request_mask = rx_missing_mask_get(lp);
+
+    mtk_bdcest_request_sent(&lp->node_addr);
+
+    if (s->delta) {
+        RUN_CHECK(mtk_bdcreq_send_delta(&lp->node_addr,
+                                        lp->node_port,
+                                        lp->id,
+                                        new_request_mask,
+                                        lp->period_ms,
+                                        s->delta_n_hashes,
+                                        rx_delta_hashes_get(s)));
+        return;
+    }
+
+    RUN_CHECK(mtk_bdcreq_send_sized(&lp->node_addr,
+                                    lp->node_port,
+                                    lp->id,
+                                    new_request_mask,
+                                    lp->period_ms,
+                                    lp->sub_packet_size));
+}
+
+/* Check the received data against the content hash, if the packet has one.
+ * Data written to a write callback is checked only if written from the start,
+ * not after resuming. */
+static int rx_integrity_check(const rx_session_t* s)
+{
+    const mtk_bulk_data_collection_packet_t* lp = s->packet;
+    uint32_t crc;
+
+    if (!(lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH)) {
+        return 0;
+    }
+
+    if (lp->write_callback != NULL) {
+        if (!s->delivered_crc_valid) {
+            return 0;
+        }
+        crc = s->delivered_crc;
+    } else if (lp->pooled) {
+        crc = 0;
+        for (uint8_t i = 0; i < lp->num_sub_packets; ++i) {
+            const uint8_t* block = mtk_bdcpool_get(lp, i);
+            if (block == NULL) {
+                return -1;
+            }
+            crc = mtk_bdccrc_crc32(crc, block, sub_packet_len_get(lp, i));
+        }
+    } else {
+        crc = mtk_bdccrc_crc32(0, lp->payload, lp->len);
+    }
+
+    return (crc == lp->content_hash) ? 0 : -1;
+}
+
+static uint64_t rx_missing_mask_get(const mtk_bulk_data_collection_packet_t* lp)
+{
+    uint64_t received_mask = lp->mask;
+
+    uint64_t missing_mask = received_mask ^ UINT64_MAX;
+
+    if (lp->num_sub_packets < 64) {
+        missing_mask &= (((uint64_t)1) << lp->num_sub_packets) - 1;
+    }
+
+    return missing_mask;
+}
+
+/* Sub-packets written to their destination. When receiving to a write callback,
+ * sub-packets held in the reorder window are not yet written. */
+static uint64_t rx_written_mask_get(const rx_session_t* s)
+{
+    if (s->packet->write_callback == NULL) {
+        return s->packet->mask;
+    }
+    return (s->next_in_order == 64) ? UINT64_MAX : (((uint64_t)1) << s->next_in_order) - 1;
+}
+
+static void rx_checkpoint(rx_session_t* s, bool force)
+{
+    const mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    if (rx_checkpoint_callback == NULL) {
+        return;
+    }
+
+    uint64_t written_mask = rx_written_mask_get(s);
+    uint64_t new_mask = written_mask & ~s->checkpoint_mask;
+
+    if (new_mask == 0 || (!force && mask_count(new_mask) < rx_checkpoint_interval)) {
+        return;
+    }
+
+    mtk_bulk_data_collection_checkpoint_t checkpoint = {
+        .id = lp->id,
+        .content_hash = lp->content_hash,
+        .mask = written_mask,
+        .len = (lp->write_callback != NULL) ? s->delivered_len : lp->len,
+        .num_sub_packets = lp->num_sub_packets,
+        .sub_packet_size = lp->sub_packet_size,
+    };
+    memcpy(&checkpoint.node_addr, &lp->node_addr, sizeof(mira_net_address_t));
+
+    rx_checkpoint_callback(&checkpoint, new_mask, lp, rx_checkpoint_storage);
+
+    s->checkpoint_mask = written_mask;
+}
+
+static uint8_t mask_count(uint64_t mask)
+{
+    uint8_t n = 0;
+    while (mask != 0) {
+        mask &= mask - 1;
+        n++;
+    }
+    return n;
+}
+
+/* Request sub-packets missing below the highest one received, before the
+ * transfer goes quiet. Rate limited, and each hole is NACKed once per round. */
+static void rx_gap_nack(rx_session_t* s, uint8_t index)
+{
+    const mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    /* Multicast receptions NACK once a round is over, for the sender to merge
+     * the NACKs of all receivers */
+    if (MTK_BULK_DATA_COLLECTION_NACK_GAP_THRESHOLD == 0 ||
+        (lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST)) {
+        return;
+    }
+
+    if (index >= s->n_seen) {
+        s->n_seen = index + 1;
+    }
+    if (s->n_seen <= MTK_BULK_DATA_COLLECTION_NACK_GAP_THRESHOLD) {
+        return;
+    }
+
+    uint8_t n_below = s->n_seen - MTK_BULK_DATA_COLLECTION_NACK_GAP_THRESHOLD;
+    uint64_t holes = (n_below == 64) ? UINT64_MAX : (((uint64_t)1) << n_below) - 1;
+    holes &= ~(lp->mask | s->nacked_mask);
+    if (holes == 0) {
+        return;
+    }
+
+    clock_time_t interval = MTK_BULK_DATA_COLLECTION_NACK_INTERVAL_PERIODS * lp->period_ms *
+                            CLOCK_SECOND / 1000;
+    if (clock_time() - s->last_nack_time < interval) {
+        return;
+    }
+
+    if (mtk_bdcreq_send_nack(&lp->node_addr, lp->node_port, lp->id, holes, lp->period_ms) < 0) {
+        P_ERR("%s: mtk_bdcreq_send_nack\n", __func__);
+        return;
+    }
+
+    s->nacked_mask |= holes;
+    s->last_nack_time = clock_time();
+}
+
+/* NACK the sub-packets still missing of a multicast reception to the group. */
+static void rx_mc_nack(rx_session_t* s)
+{
+    const mtk_bulk_data_collection_packet_t* lp = s->packet;
+    uint64_t missing_mask = rx_missing_mask_get(lp);
+
+    s->mc_nack_pending = false;
+
+    mtk_bdcest_request_sent(&lp->node_addr);
+    if (mtk_bdcmc_send_nack(lp->id, missing_mask) < 0) {
+        P_ERR("%s: mtk_bdcmc_send_nack\n", __func__);
+    }
+    s->re_tx_requests_left--;
+    s->round_mask = missing_mask;
+
+    /* The sender repairs once it has gathered the NACKs */
+    rx_session_timer_set(
+      s, MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WINDOW_MS * CLOCK_SECOND / 1000);
+}
+
+/* Cancel the pending NACK of multicast receptions that a NACK of another
+ * receiver, or a repair round, covers. Receptions are told by packet id only,
+ * the group having a single sender at a time. Runs in the UDP callback. */
+static void rx_mc_nack_heard(const mtk_bdcmc_nack_t* nack)
+{
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS; ++i) {
+        rx_session_t* s = &rx_sessions[i];
+        const mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+        if (lp == NULL || !(lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST) ||
+            lp->id != nack->packet_id) {
+            continue;
+        }
+
+        if (nack->repair) {
+            if (memcmp(&lp->node_addr, &nack->src, sizeof(mira_net_address_t)) != 0) {
+                continue;
+            }
+            s->mc_repair_mask = nack->mask;
+            s->mc_first_symbol = nack->first_symbol;
+            s->mc_n_symbols = nack->n_symbols;
+        }
+
+        if (!s->mc_nack_pending || (rx_missing_mask_get(lp) & ~nack->mask) != 0) {
+            continue;
+        }
+
+        P_DEBUG("%s: NACK of packet %d suppressed\n", __func__, lp->id);
+        s->mc_nack_pending = false;
+
+        PROCESS_CONTEXT_BEGIN(&mtk_bulk_data_collection_receive_proc);
+        rx_session_timer_set(
+          s, MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_WINDOW_MS * CLOCK_SECOND / 1000);
+        PROCESS_CONTEXT_END(&mtk_bulk_data_collection_receive_proc);
+    }
+}
+
+static clock_time_t rx_mc_backoff_get(void)
+{
+    uint32_t delay_ms =
+      mira_random_generate() % (MTK_BULK_DATA_COLLECTION_MULTICAST_NACK_BACKOFF_MS + 1);
+
+    return delay_ms * CLOCK_SECOND / 1000;
+}
+
+/* Splice sub-packets NACKed by the receiver into the running transmission. */
+static void tx_nack_merge(mtk_bulk_data_collection_packet_t* large_packet,
+                          const mtk_bdc_event_requested_data_t* nack)
+{
+    if (!tx_request_matches(large_packet, nack)) {
+        return;
+    }
+
+    /* Any NACK, empty or not, confirms a pushed transfer */
+    tx_push = false;
+
+    uint64_t whole_mask;
+    if (mtk_bulk_data_collection_send_whole_mask_get(&whole_mask, large_packet->num_sub_packets) <
+        0) {
+        return;
+    }
+
+    P_DEBUG("NACK for packet %d, mask 0x%08" PRIu32 "%08" PRIu32 "\n",
+            nack->packet_id,
+            (uint32_t)(nack->mask >> 32),
+            (uint32_t)(nack->mask & UINT32_MAX));
+
+    large_packet->mask |= nack->mask & whole_mask;
+}
+
+static bool tx_request_matches(const mtk_bulk_data_collection_packet_t* large_packet,
+                               const mtk_bdc_event_requested_data_t* request)
+{
+    return request->packet_id == large_packet->id && request->src_port == large_packet->node_port &&
+           memcmp(&request->src, &large_packet->node_addr, sizeof(mira_net_address_t)) == 0;
+}
+
+/* Release the acknowledged packet, no longer sending it. */
+static void tx_acked(const mtk_bdc_event_requested_data_t* ack)
+{
+    uint32_t bit = 1;
+
+    for (mtk_bulk_data_collection_packet_t* lp = tx_chain; lp != NULL; lp = lp->next, bit <<= 1) {
+        if ((tx_kept_mask & bit) && tx_request_matches(lp, ack)) {
+            P_DEBUG("Packet %d acknowledged\n", lp->id);
+            lp->mask = 0;
+            tx_kept_mask &= ~bit;
+            if (tx_pipeline) {
+                tx_pipeline_unlink(lp);
+            }
+            if (process_post(PROCESS_BROADCAST, event_bdc_released, lp) != PROCESS_ERR_OK) {
+                P_ERR("%s: process_post event_bdc_released\n", __func__);
+            }
+            return;
+        }
+    }
+}
+
+/* Release the packets still kept, but those chained from keep. */
+static void tx_release(const mtk_bulk_data_collection_packet_t* keep)
+{
+    uint32_t bit = 1;
+
+    for (mtk_bulk_data_collection_packet_t* lp = tx_chain; lp != NULL; lp = lp->next, bit <<= 1) {
+        bool kept = false;
+        for (const mtk_bulk_data_collection_packet_t* k = keep; k != NULL; k = k->next) {
+            kept = kept || (k == lp);
+        }
+        if ((tx_kept_mask & bit) && !kept &&
+            process_post(PROCESS_BROADCAST, event_bdc_released, lp) != PROCESS_ERR_OK) {
+            P_ERR("%s: process_post event_bdc_released\n", __func__);
+        }
+    }
+
+    /* Called before the flags of the next transmission are set */
+    if (tx_pipeline) {
+        tx_pipeline_links_clear();
+    }
+
+    tx_chain = NULL;
+    tx_kept_mask = 0;
+}
+
+static bool tx_pending(const mtk_bulk_data_collection_packet_t* large_packet)
+{
+    return large_packet->mask != 0 || (tx_multicast && tx_mc_symbols_left > 0);
+}
+
+/* First packet of the pipeline with sub-packets to send, so that the repairs
+ * of a packet go before the packets after it. */
+static mtk_bulk_data_collection_packet_t* tx_pipeline_next(void)
+{
+    for (mtk_bulk_data_collection_packet_t* lp = tx_chain; lp != NULL; lp = lp->next) {
+        if (lp->mask != 0) {
+            return lp;
+        }
+    }
+    return NULL;
+}
+
+/* Add the sub-packets of a NACK, or of a request sent again by the receiver,
+ * to the packet of the pipeline with its packet id. */
+static void tx_pipeline_merge(const mtk_bdc_event_requested_data_t* request)
+{
+    for (mtk_bulk_data_collection_packet_t* lp = tx_chain; lp != NULL; lp = lp->next) {
+        if (tx_request_matches(lp, request)) {
+            tx_nack_merge(lp, request);
+            return;
+        }
+    }
+}
+
+/* Unlink a released packet from the pipeline, for the application to reuse it
+ * at once. */
+static void tx_pipeline_unlink(mtk_bulk_data_collection_packet_t* lp)
+{
+    uint32_t low_mask = 0;
+
+    for (mtk_bulk_data_collection_packet_t** link = &tx_chain; *link != NULL;
+         link = &(*link)->next) {
+        if (*link == lp) {
+            *link = lp->next;
+            lp->next = NULL;
+            /* Bits of the packets after it move down */
+            tx_kept_mask = (tx_kept_mask & low_mask) | ((tx_kept_mask >> 1) & ~low_mask);
+            return;
+        }
+        low_mask = (low_mask << 1) | 1;
+    }
+}
+
+/* Unlink the packets of a pipeline, linked here rather than by the
+ * application, for them to be sent anew. */
+static void tx_pipeline_links_clear(void)
+{
+    mtk_bulk_data_collection_packet_t* lp = tx_chain;
+
+    while (lp != NULL) {
+        mtk_bulk_data_collection_packet_t* next = lp->next;
+        lp->next = NULL;
+        lp = next;
+    }
+}
+
+static bool tx_chain_holds(const mtk_bulk_data_collection_packet_t* lp)
+{
+    for (const mtk_bulk_data_collection_packet_t* k = tx_chain; k != NULL; k = k->next) {
+        if (k == lp) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Set up the repair round of the sub-packets NACKed since the previous round,
+ * and announce it to the group. With fountain coding, the sub-packets coded by
+ * symbols are repaired with as many symbols as the receiver missing most of
+ * them needs, plus MTK_BULK_DATA_COLLECTION_FOUNTAIN_OVERHEAD. Returns -1 once
+ * out of rounds. */
+static int tx_mc_repair_start(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    uint64_t repair_mask = tx_mc_nack_mask;
+    uint8_t n_symbols = 0;
+
+    tx_mc_nack_mask = 0;
+
+    if (tx_mc_rounds_left == 0) {
+        P_DEBUG("Packet %d: no repair round left\n", large_packet->id);
+        return -1;
+    }
+    tx_mc_rounds_left--;
+
+    tx_mc_code_mask = 0;
+    if (large_packet->flags & MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN) {
+        uint64_t code_mask = symbol_code_mask_get(large_packet, repair_mask);
+        uint16_t n = tx_mc_nack_max + MTK_BULK_DATA_COLLECTION_FOUNTAIN_OVERHEAD;
+        /* Symbol indices follow those of sub-packets, up to 255. Plain
+         * sub-packets are sent once they run out. */
+        if (code_mask != 0 && tx_mc_next_symbol + n <= UINT8_MAX + 1) {
+            tx_mc_code_mask = code_mask;
+            n_symbols = n;
+        }
+    }
+    tx_mc_nack_max = 0;
+
+    large_packet->mask = repair_mask & ~tx_mc_code_mask;
+    tx_mc_symbols_left = n_symbols;
+
+    P_DEBUG("Packet %d: repair round of 0x%08" PRIu32 "%08" PRIu32 ", %d symbols\n",
+            large_packet->id,
+            (uint32_t)(repair_mask >> 32),
+            (uint32_t)(repair_mask & UINT32_MAX),
+            n_symbols);
+
+    /* Receivers missing the notice still take the plain sub-packets */
+    if (mtk_bdcmc_send_repair(large_packet->id, repair_mask, tx_mc_next_symbol, n_symbols) < 0) {
+        P_ERR("%s: mtk_bdcmc_send_repair\n", __func__);
+    }
+
+    return 0;
+}
+
+/* Merge a NACK of a receiver of the packet being multicast, for the next
+ * repair round. Runs in the UDP callback. */
+static void tx_mc_nack_merge(const mtk_bdcmc_nack_t* nack)
+{
+    const mtk_bulk_data_collection_packet_t* lp = tx_chain;
+    uint64_t whole_mask;
+
+    if (!tx_multicast || !large_packet_currently_sending || lp == NULL || nack->repair ||
+        nack->packet_id != lp->id ||
+        mtk_bulk_data_collection_send_whole_mask_get(&whole_mask, lp->num_sub_packets) < 0) {
+        return;
+    }
+
+    uint64_t mask = nack->mask & whole_mask;
+    uint8_t n_coded = mask_count(symbol_code_mask_get(lp, mask));
+
+    tx_mc_nack_mask |= mask;
+    if (n_coded > tx_mc_nack_max) {
+        tx_mc_nack_max = n_coded;
+    }
+
+    /* Wake the sending process waiting for NACKs */
+    process_poll(&mtk_bulk_data_collection_send_proc);
+}
+
+/* Send the next repair symbol of the round: the XOR of sub-packets coded by
+ * the round, chosen by the symbol index. */
+static int tx_symbol_send(const mtk_bulk_data_collection_packet_t* large_packet)
+{
+    uint16_t size = sub_packet_size_get(large_packet);
+    uint8_t index = tx_mc_next_symbol;
+
+    /* Encoded straight into the outgoing frame */
+    uint8_t* symbol = mtk_bdcsp_tx_payload_get();
+
+    mtk_bdcfnt_encode(symbol,
+                      large_packet->payload,
+                      size,
+                      mtk_bdcfnt_neighbors_get(large_packet->id, index, tx_mc_code_mask));
+
+    int ret =
+      mtk_bdcmc_send(large_packet->id, index, large_packet->num_sub_packets, symbol, size);
+
+    if (ret >= 0) {
+        tx_mc_next_symbol++;
+        tx_mc_symbols_left--;
+    } else if (ret != MTK_BDCSP_QUEUE_FULL) {
+        P_ERR("%s: could not send symbol\n", __func__);
+    }
+
+    return ret;
+}
+
+/* Send up to tx_window sub-packets back to back, fewer if the UDP queue gets
+ * full or a pushed packet has sent all it may before being confirmed. Returns
+ * the number of sub-packets sent, MTK_BDCSP_QUEUE_FULL if the queue was full
+ * at once, or -1 on error. */
+static int tx_burst_send(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    uint8_t window = (large_packet->tx_window > 1) ? large_packet->tx_window : 1;
+    int n_sent = 0;
+
+    while (n_sent < window && tx_pending(large_packet) && !(tx_push && tx_push_left == 0)) {
+        int ret = next_sub_packet_send(large_packet);
+        if (ret < 0) {
+            /* A full queue only ends a burst, sending one at a time fails as before */
+            if (ret == MTK_BDCSP_QUEUE_FULL && window > 1) {
+                return (n_sent > 0) ? n_sent : MTK_BDCSP_QUEUE_FULL;
+            }
+            return -1;
+        }
+        n_sent++;
+        if (tx_push) {
+            tx_push_left--;
+        }
+    }
+
+    return n_sent;
+}
+
+static int next_sub_packet_send(mtk_bulk_data_collection_packet_t* large_packet)
+{
+    if (large_packet_udp_connection == NULL) {
+        P_ERR("%s: no UDP connection!\n", __func__);
+        return -1;
+    }
+
+    if (tx_multicast && large_packet->mask == 0 && tx_mc_symbols_left > 0) {
+        return tx_symbol_send(large_packet);
+    }
+
+    sub_packet_t sub_packet = pick_next_to_send(large_packet);
+
+    if (sub_packet.payload == NULL) {
+        P_ERR("%s: no sub-packet to send\n", __func__);
+        return -1;
+    }
+
+    if (sub_packet.len > MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES) {
+        P_ERR("%s: sub-packet too large! (%d > %d)\n",
+              __func__,
+              sub_packet.len,
+              MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES);
+        return -1;
+    }
+
+    if (large_packet->flags & MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED) {
+        sub_packet = sub_packet_compress(sub_packet);
+    }
+
+    int ret;
+    if (tx_multicast) {
+        ret = mtk_bdcmc_send(large_packet->id,
+                             sub_packet.index,
+                             large_packet->num_sub_packets,
+                             sub_packet.payload,
+                             sub_packet.len);
+    } else {
+        ret = mtk_bdcsp_send(&large_packet->node_addr,
+                             large_packet->node_port,
+                             large_packet->id,
+                             sub_packet.index,
+                             large_packet->num_sub_packets,
+                             sub_packet.payload,
+                             sub_packet.len);
+    }
+
+    if (ret >= 0) {
+        large_packet->mask &= ~(((uint64_t)1) << sub_packet.index);
+    } else if (ret != MTK_BDCSP_QUEUE_FULL) {
+        P_ERR("%s: could not send sub-packet\n", __func__);
+    }
+
+    return ret;
+}
+
+static sub_packet_t pick_next_to_send(const mtk_bulk_data_collection_packet_t* lp)
+{
+    sub_packet_t sp = {
+        .payload = NULL,
+    };
+
+    for (int i = 0; i < MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS &&
+                    i < lp->num_sub_packets;
+         ++i) {
+        if ((((uint64_t)1) << i) & lp->mask) {
+            sp.index = i;
+            sp.len = sub_packet_len_get(lp, i);
+#if MTK_BULK_DATA_COLLECTION_TX_STREAM
+            if (lp->read_callback != NULL) {
+                sp.payload = tx_stream_fetch(lp, i);
+                break;
+            }
+#endif
+            sp.payload = lp->payload + i * sub_packet_size_get(lp);
+            break;
+        }
+    }
+
+    return sp;
+}
+
+static uint16_t sub_packet_len_get(const mtk_bulk_data_collection_packet_t* lp, uint8_t index)
+{
+    uint16_t size = sub_packet_size_get(lp);
+
+    if (index == (lp->num_sub_packets - 1)) {
+        /* last sub-packet might be smaller than the others */
+        uint16_t len = lp->len % size;
+        if (len == 0) {
+            /* but if last sub-packet is full size, modulo gives 0. Set
+             * correct length (full length) instead. */
+            len = size;
+        }
+        return len;
+    }
+    return size;
+}
+
+static uint16_t sub_packet_size_get(const mtk_bulk_data_collection_packet_t* lp)
+{
+    return (lp->sub_packet_size != 0) ? lp->sub_packet_size
+                                      : MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES;
+}
+
+/* Data of a registered sub-packet, read into the first stream buffer when
+ * streaming. Not while sending a streamed packet, which uses the buffers. */
+static const uint8_t* sub_packet_data_get(const mtk_bulk_data_collection_packet_t* lp,
+                                          uint8_t index)
+{
+#if MTK_BULK_DATA_COLLECTION_TX_STREAM
+    if (lp->read_callback != NULL) {
+        if (large_packet_currently_sending) {
+            P_ERR("%s: can't read while sending\n", __func__);
+            return NULL;
+        }
+        if (tx_stream_read(lp, &tx_stream_buffers[0], index) < 0) {
+            return NULL;
+        }
+        return tx_stream_buffers[0].data;
+    }
+#endif
+
+    if (lp->payload == NULL) {
+        return NULL;
+    }
+    return lp->payload + index * sub_packet_size_get(lp);
+}
+
+/* Hash of a sub-packet for delta transfers: CRC-32 of the data followed by its
+ * length, so that the last sub-packet of a version of another length differs. */
+static uint32_t sub_packet_hash(const uint8_t* data, uint16_t len)
+{
+    uint8_t len_buffer[sizeof(len)];
+    LITTLE_ENDIAN_STORE(len_buffer, len);
+
+    return mtk_bdccrc_crc32(mtk_bdccrc_crc32(0, data, len), len_buffer, sizeof(len_buffer));
+}
+
+/* Compress a sub-packet into the outgoing frame, sent from there without a
+ * copy. Sub-packets that don't get smaller are left as is, which the receiver
+ * tells from their length. */
+static sub_packet_t sub_packet_compress(sub_packet_t sp)
+{
+    uint8_t* compressed = mtk_bdcsp_tx_payload_get();
+    int len = mtk_bdccmp_compress(compressed, sp.len - 1, sp.payload, sp.len);
+
+    if (len > 0) {
+        sp.payload = compressed;
+        sp.len = len;
+    }
+
+    return sp;
+}
+
+#if MTK_BULK_DATA_COLLECTION_TX_STREAM
+static int tx_stream_read(const mtk_bulk_data_collection_packet_t* lp,
+                          tx_stream_buffer_t* buf,
+                          uint8_t index)
+{
+    uint16_t len = sub_packet_len_get(lp, index);
+    int ret = lp->read_callback(buf->data, index * sub_packet_size_get(lp), len, lp->storage);
+
+    if (ret != len) {
+        P_ERR("%s: read of sub-packet %d failed (%d)\n", __func__, index, ret);
+        buf->valid = false;
+        return -1;
+    }
+
+    buf->valid = true;
+    buf->index = index;
+    return 0;
+}
+
+static tx_stream_buffer_t* tx_stream_buffer_find(uint8_t index)
+{
+    for (int i = 0; i < TX_STREAM_NUM_BUFFERS; ++i) {
+        if (tx_stream_buffers[i].valid && tx_stream_buffers[i].index == index) {
+            return &tx_stream_buffers[i];
+        }
+    }
+    return NULL;
+}
+
+/* Find a buffer that is not holding a sub-packet still to be sent. */
+static tx_stream_buffer_t* tx_stream_free_buffer_get(const mtk_bulk_data_collection_packet_t* lp)
+{
+    for (int i = 0; i < TX_STREAM_NUM_BUFFERS; ++i) {
+        tx_stream_buffer_t* buf = &tx_stream_buffers[i];
+        if (!buf->valid || !((((uint64_t)1) << buf->index) & lp->mask)) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t* tx_stream_fetch(const mtk_bulk_data_collection_packet_t* lp,
+                                      uint8_t index)
+{
+    tx_stream_buffer_t* buf = tx_stream_buffer_find(index);
+    if (buf != NULL) {
+        return buf->data;
+    }
+
+    /* Not read ahead. All buffers may hold pending sub-packets if the mask was
+     * changed since, in which case one of them is read again later. */
+    buf = tx_stream_free_buffer_get(lp);
+    if (buf == NULL) {
+        buf = &tx_stream_buffers[0];
+    }
+
+    if (tx_stream_read(lp, buf, index) < 0) {
+        return NULL;
+    }
+    return buf->data;
+}
+
+/* Read the next sub-packets to send into free buffers, while waiting for the
+ * pacing timer. */
+static void tx_stream_read_ahead(const mtk_bulk_data_collection_packet_t* lp)
+{
+    int n_read_ahead = 0;
+
+    for (int i = 0; n_read_ahead < MTK_BULK_DATA_COLLECTION_TX_READ_AHEAD &&
+                    i < MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS &&
+                    i < lp->num_sub_packets;
+         ++i) {
+        if (!((((uint64_t)1) << i) & lp->mask)) {
+            continue;
+        }
+        n_read_ahead++;
+
+        if (tx_stream_buffer_find(i) != NULL) {
+            continue;
+        }
+
+        tx_stream_buffer_t* buf = tx_stream_free_buffer_get(lp);
+        if (buf == NULL || tx_stream_read(lp, buf, i) < 0) {
+            /* Read again on demand when the sub-packet is sent */
+            return;
+        }
+    }
+}
+#endif
+
+static int register_tx_common(mtk_bulk_data_collection_packet_t* large_packet,
+                              const uint16_t packet_id,
+                              const uint16_t len)
+{
+    if (len == 0) {
+        return -1;
+    }
+    if (len > (MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES *
+               MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS)) {
+        P_ERR("%s: ! packet too large\n", __func__);
+        return -1;
+    }
+
+    large_packet->len = len;
+    large_packet->id = packet_id;
+    large_packet->read_callback = NULL;
+    large_packet->storage = NULL;
+    large_packet->flags = 0;
+    large_packet->content_hash = 0;
+    large_packet->original_len = 0;
+    large_packet->compressed_len = 0;
+    large_packet->sub_packet_size = 0;
+
+    div_t d = div(len, MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES);
+    large_packet->num_sub_packets = d.quot + ((d.rem != 0) ? 1 : 0);
+
+    return 0;
+}
+
+static void large_packet_udp_listen_callback(mira_net_udp_connection_t* connection,
+                                             const void* data,
+                                             uint16_t data_len,
+                                             const mira_net_udp_callback_metadata_t* metadata,
+                                             void* storage)
+{
+#if DEBUG_LEVEL > 0
+    char buffer[MIRA_NET_MAX_ADDRESS_STR_LEN];
+#endif
+    P_DEBUG("Received UDP packet from [%s]:%u, len %d\n",
+            mira_net_toolkit_format_address(buffer, metadata->source_address),
+            metadata->source_port,
+            data_len);
+
+    if (data_len < MTK_BULK_DATA_COLLECTION_HEADER_SIZE) {
+        P_ERR("%s: UDP packet too short\n", __func__);
+        return;
+    }
+
+    mtk_bdcsig_handle_data(data, data_len, metadata);
+    mtk_bdcreq_handle_data(data, data_len, metadata);
+    mtk_bdcsp_handle_data(data, data_len, metadata);
+}
+
+static void mc_nack_handle(const mtk_bdcmc_nack_t* nack)
+{
+    tx_mc_nack_merge(nack);
+    rx_mc_nack_heard(nack);
+}
+
+static bool lp_fault_injected(void)
+{
+    return mira_random_generate() < (FAULT_RATE_PERCENT * UINT16_MAX / 100);
+}
+
+/* Write an incoming sub-packet directly at its offset in the packet being
+ * received, decompressing it if needed. Runs in the UDP callback, before the
+ * event is posted. */
+static int sub_packet_place(mtk_bdc_event_subpacket_data_t* sp, const uint8_t* payload)
+{
+    rx_session_t* s = rx_session_find(&sp->src, sp->packet_id);
+
+    if (s == NULL) {
+        return -1;
+    }
+
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    if ((lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN) &&
+        sp->sub_packet_index >= lp->num_sub_packets) {
+        return lp_fault_injected() ? -1 : rx_symbol_place(s, sp, payload);
+    }
+
+    if (sp->sub_packet_index >= lp->num_sub_packets ||
+        sp->sub_packet_index >= MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS) {
+        P_ERR("%s: sub-packet index out of range (%d)\n", __func__, sp->sub_packet_index);
+        return -1;
+    }
+
+    /* From a sender splitting the packet otherwise than requested */
+    if (sp->n_sub_packets != lp->num_sub_packets || sp->payload_len > sub_packet_size_get(lp)) {
+        P_ERR("%s: sub-packet %d of another size\n", __func__, sp->sub_packet_index);
+        return -1;
+    }
+
+    if (lp_fault_injected()) {
+        P_DEBUG("%s: simulate packet loss by discarding sub-packet %d\n",
+                __func__,
+                sp->sub_packet_index);
+        return -1;
+    }
+
+    uint8_t slot = 0;
+    uint8_t* dst;
+
+    if (lp->write_callback != NULL) {
+        if (sp->sub_packet_index < s->next_in_order) {
+            /* Already written */
+            return -1;
+        }
+        if (sp->sub_packet_index >=
+            s->next_in_order + MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW) {
+            P_DEBUG("%s: sub-packet %d beyond reorder window\n", __func__, sp->sub_packet_index);
+            return -1;
+        }
+        slot = sp->sub_packet_index % MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW;
+        dst = mtk_bdcpool_alloc(s, slot);
+        if (dst == NULL) {
+            /* Requested again */
+            return -1;
+        }
+    } else if (lp->pooled) {
+        /* Kept if the sub-packet doesn't decompress, for the next copy of it */
+        dst = mtk_bdcpool_alloc(lp, sp->sub_packet_index);
+        if (dst == NULL) {
+            return -1;
+        }
+    } else if (lp->payload != NULL) {
+        dst = lp->payload + sp->sub_packet_index * sub_packet_size_get(lp);
+    } else {
+        return -1;
+    }
+
+    /* Length of the sub-packet before compression. Sub-packets sent as is have
+     * that length, others are compressed. */
+    uint16_t original_len = sp->payload_len;
+    if (lp->flags & MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED) {
+        uint32_t offset = sp->sub_packet_index * sub_packet_size_get(lp);
+        if (lp->original_len <= offset) {
+            P_ERR("%s: sub-packet %d beyond original length\n", __func__, sp->sub_packet_index);
+            return -1;
+        }
+        original_len = lp->original_len - offset;
+        if (original_len > sub_packet_size_get(lp)) {
+            original_len = sub_packet_size_get(lp);
+        }
+    }
+
+    if (sp->payload_len != original_len) {
+        if (mtk_bdccmp_decompress(dst, original_len, payload, sp->payload_len) < 0) {
+            P_ERR("%s: could not decompress sub-packet %d\n", __func__, sp->sub_packet_index);
+            return -1;
+        }
+        sp->payload_len = original_len;
+    } else {
+        memcpy(dst, payload, sp->payload_len);
+    }
+    sp->payload = dst;
+
+    if (lp->write_callback != NULL) {
+        s->window_len[slot] = sp->payload_len;
+    }
+
+    return 0;
+}
+
+/* Write the received sub-packets, starting at the next one in order, to the
+ * write callback. Slots being blocks apart, each is written on its own. */
+static int rx_sink_deliver(rx_session_t* s)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+
+    while (s->next_in_order < lp->num_sub_packets &&
+           ((((uint64_t)1) << s->next_in_order) & lp->mask)) {
+        uint8_t slot = s->next_in_order % MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW;
+        uint8_t* block = mtk_bdcpool_get(s, slot);
+        uint16_t len = s->window_len[slot];
+
+        uint16_t offset = s->next_in_order * sub_packet_size_get(lp);
+        if (block == NULL || lp->write_callback(block, offset, len, lp->storage) < 0) {
+            return -1;
+        }
+
+        s->next_in_order++;
+        s->delivered_len += len;
+        s->delivered_crc = mtk_bdccrc_crc32(s->delivered_crc, block, len);
+    }
+
+    return 0;
+}
+
+/* Take a repair symbol of a fountain coded packet, reduced by the sub-packets
+ * already received. A symbol reduced to a single sub-packet is placed as that
+ * sub-packet, others are held in a free slot of the reorder window, for
+ * rx_symbols_peel(). Runs in the UDP callback. */
+static int rx_symbol_place(rx_session_t* s,
+                           mtk_bdc_event_subpacket_data_t* sp,
+                           const uint8_t* payload)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+    uint16_t size = sub_packet_size_get(lp);
+
+    if (lp->payload == NULL || sp->n_sub_packets != lp->num_sub_packets ||
+        sp->payload_len != size || sp->sub_packet_index < s->mc_first_symbol ||
+        sp->sub_packet_index - s->mc_first_symbol >= s->mc_n_symbols) {
+        P_DEBUG("%s: symbol %d not of the announced round\n", __func__, sp->sub_packet_index);
+        return -1;
+    }
+
+    uint8_t slot = 0;
+    while (slot < MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW && s->symbol_mask[slot] != 0) {
+        slot++;
+    }
+    if (slot == MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW) {
+        P_DEBUG("%s: no slot for symbol %d\n", __func__, sp->sub_packet_index);
+        return -1;
+    }
+
+    uint8_t* symbol = mtk_bdcpool_alloc(s, slot);
+    if (symbol == NULL) {
+        return -1;
+    }
+
+    uint64_t unknown = mtk_bdcfnt_neighbors_get(
+      lp->id, sp->sub_packet_index, symbol_code_mask_get(lp, s->mc_repair_mask));
+
+    memcpy(symbol, payload, size);
+    mtk_bdcfnt_reduce(symbol, &unknown, lp->payload, size, lp->mask);
+
+    if (mask_count(unknown) != 1) {
+        /* Held, or of no use if nothing is left */
+        s->symbol_mask[slot] = unknown;
+        return -1;
+    }
+
+    uint8_t index = mask_lowest(unknown);
+    uint8_t* dst = lp->payload + index * size;
+    memcpy(dst, symbol, size);
+
+    sp->sub_packet_index = index;
+    sp->payload = dst;
+
+    return 0;
+}
+
+/* Reduce the symbols held by the sub-packets received since, taking each
+ * sub-packet a symbol is reduced to, until none is found. */
+static void rx_symbols_peel(rx_session_t* s)
+{
+    mtk_bulk_data_collection_packet_t* lp = s->packet;
+    uint16_t size = sub_packet_size_get(lp);
+    bool found = true;
+
+    while (found) {
+        found = false;
+        for (int i = 0; i < MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW; ++i) {
+            if (s->symbol_mask[i] == 0) {
+                continue;
+            }
+
+            uint8_t* symbol = mtk_bdcpool_get(s, i);
+            mtk_bdcfnt_reduce(symbol, &s->symbol_mask[i], lp->payload, size, lp->mask);
+            if (mask_count(s->symbol_mask[i]) != 1) {
+                continue;
+            }
+
+            uint8_t index = mask_lowest(s->symbol_mask[i]);
+            P_DEBUG("%s: sub-packet %d decoded\n", __func__, index);
+
+            memcpy(lp->payload + index * size, symbol, size);
+            lp->mask |= s->symbol_mask[i];
+            lp->len += size;
+            s->symbol_mask[i] = 0;
+            found = true;
+        }
+    }
+}
+
+/* Sub-packets of mask that symbols code: all but the last one, of which
+ * receivers don't know the length. */
+static uint64_t symbol_code_mask_get(const mtk_bulk_data_collection_packet_t* lp, uint64_t mask)
+{
+    return mask & ~(((uint64_t)1) << (lp->num_sub_packets - 1));
+}
+
+static uint8_t mask_lowest(uint64_t mask)
+{
+    uint8_t i = 0;
+    while (i < 63 && !(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/* Other nodes are reachable only once joined, or as root */
+static bool net_joined(void)
+{
+    mira_net_state_t state = mira_net_get_state();
+
+    return state == MIRA_NET_STATE_JOINED || state == MIRA_NET_STATE_IS_COORDINATOR;
 }
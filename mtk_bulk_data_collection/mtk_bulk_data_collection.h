@@ -43,6 +43,13 @@
  * re-transmissions. */
 #define MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES (330)
 
+/* Sub-packet size used on lossy paths, see
+ * mtk_bulk_data_collection_sub_packet_size_choose(). Fits in a single radio
+ * frame, so that a lost frame loses only that sub-packet. */
+#ifndef MTK_BULK_DATA_COLLECTION_SUBPACKET_SMALL_BYTES
+#define MTK_BULK_DATA_COLLECTION_SUBPACKET_SMALL_BYTES (80)
+#endif
+
 /* Max number of messages into which a large packet may be split */
 /* The bit mask sent in requests must be large enough to accommodate for this
  * number of sub-packets. */
@@ -51,27 +58,205 @@
 /* Byte size of headers, which determines the type of message. */
 #define MTK_BULK_DATA_COLLECTION_HEADER_SIZE (2)
 
-/* Only one of two roles currently supported */
+/* Set to 1 to send packets from a read callback, see
+ * mtk_bulk_data_collection_register_tx_stream(). Costs
+ * 1 + MTK_BULK_DATA_COLLECTION_TX_READ_AHEAD buffers of
+ * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES of RAM. */
+#ifndef MTK_BULK_DATA_COLLECTION_TX_STREAM
+#define MTK_BULK_DATA_COLLECTION_TX_STREAM (0)
+#endif
+
+/* Number of sub-packets read ahead of time when sending from a read callback,
+ * so that reading overlaps the pacing interval. Each costs
+ * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES of RAM. */
+#ifndef MTK_BULK_DATA_COLLECTION_TX_READ_AHEAD
+#define MTK_BULK_DATA_COLLECTION_TX_READ_AHEAD (0)
+#endif
+
+/* Bursts in a row finding the UDP queue full before a transmission fails, see
+ * tx_window of mtk_bulk_data_collection_packet_t. */
+#ifndef MTK_BULK_DATA_COLLECTION_TX_BURST_MAX_STALLS
+#define MTK_BULK_DATA_COLLECTION_TX_BURST_MAX_STALLS (10)
+#endif
+
+/* Time a sent packet is kept by the sending process for a completion ACK from
+ * the receiver, in ms, before it is released. See event_bdc_released. */
+#ifndef MTK_BULK_DATA_COLLECTION_TX_LINGER_MS
+#define MTK_BULK_DATA_COLLECTION_TX_LINGER_MS (10000)
+#endif
+
+/* Number of sub-packets held while waiting for a missing one, when receiving to
+ * a write callback. Sub-packets further ahead are discarded and requested
+ * again. Each is held in a block of the receive buffer pool, see
+ * MTK_BULK_DATA_COLLECTION_POOL_BLOCKS, taken as needed. */
+#ifndef MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW
+#define MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW (4)
+#endif
+
+/* Number of packets received at a time, from different senders or with
+ * different packet ids. Each reception has its own reorder window, of pool
+ * blocks. */
+#ifndef MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS
+#define MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS (1)
+#endif
+
+/* Number of packets listed in a manifest signal, see
+ * mtk_bulk_data_collection_signal_manifest(). */
+#ifndef MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES
+#define MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES (16)
+#endif
+
+/* Number of packets sent after the first one, for a batch request, see
+ * mtk_bulk_data_collection_collect_batch(). */
+#ifndef MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS
+#define MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS (7)
+#endif
+
+/* Flags of a packet, telling which optional information it carries. They are
+ * sent along in signals, see mtk_bulk_data_collection_signal(). */
+/* content_hash is set, see mtk_bulk_data_collection_content_hash_compute() */
+#define MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH (0x01)
+/* Sub-packets are compressed, see
+ * mtk_bulk_data_collection_compression_enable() */
+#define MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED (0x02)
+/* The total length is sent, see mtk_bulk_data_collection_content_hash_compute()
+ */
+#define MTK_BULK_DATA_COLLECTION_FLAG_LENGTH (0x04)
+/* The signal starts the transfer, see mtk_bulk_data_collection_push(). The
+ * period is sent. */
+#define MTK_BULK_DATA_COLLECTION_FLAG_PUSH (0x08)
+/* The signal starts a transfer to a multicast group, see
+ * mtk_bulk_data_collection_multicast(). The period is sent. */
+#define MTK_BULK_DATA_COLLECTION_FLAG_MULTICAST (0x10)
+/* Repair rounds of multicast transfers send fountain coded symbols, see
+ * mtk_bulk_data_collection_fountain_enable() */
+#define MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN (0x20)
+
+/* Sub-packet period of pushed and multicast transfers, in ms, if not set in
+ * the packet. */
+#ifndef MTK_BULK_DATA_COLLECTION_PUSH_PERIOD_MS
+#define MTK_BULK_DATA_COLLECTION_PUSH_PERIOD_MS (50)
+#endif
+
+/* Number of sub-packets pushed before the receiver confirms the transfer. The
+ * sender stops there without a confirmation. */
+#ifndef MTK_BULK_DATA_COLLECTION_PUSH_WINDOW
+#define MTK_BULK_DATA_COLLECTION_PUSH_WINDOW (8)
+#endif
+
+/* Number of packets in a pipeline at a time, see
+ * mtk_bulk_data_collection_pipeline(). At most 32. */
+#ifndef MTK_BULK_DATA_COLLECTION_PIPELINE_DEPTH
+#define MTK_BULK_DATA_COLLECTION_PIPELINE_DEPTH (4)
+#endif
+
+/* Time between two checks of the network state while transfers are suspended,
+ * in ms. Transfers are suspended while the node is not joined to the network,
+ * see mira_net_get_state(). */
+#ifndef MTK_BULK_DATA_COLLECTION_NET_POLL_MS
+#define MTK_BULK_DATA_COLLECTION_NET_POLL_MS (500)
+#endif
+
+/* A dual node both collects from senders and sends to a receiver, for example
+ * to relay packets, see module mtk_bdc_relay. */
 typedef enum
 {
     MTK_BULK_DATA_COLLECTION_RECEIVER,
     MTK_BULK_DATA_COLLECTION_SENDER,
+    MTK_BULK_DATA_COLLECTION_DUAL,
 } mtk_bulk_data_collection_role_t;
 
+/* Read len bytes of the data to send, starting at offset, into dst. Used for
+ * streaming transmission, see mtk_bulk_data_collection_register_tx_stream().
+ * Return the number of bytes read, or < 0 on error. */
+typedef int (*mtk_bulk_data_collection_read_callback_t)(uint8_t* dst,
+                                                         uint16_t offset,
+                                                         uint16_t len,
+                                                         void* storage);
+
+/* Write len bytes of received data, at offset in the whole packet. Used for
+ * streaming reception, see mtk_bulk_data_collection_register_rx_sink(). Data
+ * is written in order. Return < 0 on error, which aborts the reception. */
+typedef int (*mtk_bulk_data_collection_write_callback_t)(const uint8_t* src,
+                                                          uint16_t offset,
+                                                          uint16_t len,
+                                                          void* storage);
+
 /* Type used both on the receiving and the sending nodes */
-typedef struct
+typedef struct mtk_bulk_data_collection_packet
 {
     uint8_t* payload;
     uint16_t len;
+    /* Sender only: if set, payload is unused and data is read through this
+     * callback, one sub-packet at a time. */
+    mtk_bulk_data_collection_read_callback_t read_callback;
+    /* Receiver only: if set, payload is unused and data is handed to this
+     * callback in order, as soon as it is complete. */
+    mtk_bulk_data_collection_write_callback_t write_callback;
+    /* Receiver only: if set, payload is unused and sub-packets are received to
+     * blocks of the receive buffer pool, see
+     * mtk_bulk_data_collection_register_rx_pool(). */
+    bool pooled;
+    /* Passed to read_callback and write_callback */
+    void* storage;
     /* Address and port to the other node participating in the communication */
     mira_net_address_t node_addr;
     uint16_t node_port;
     uint16_t id;
     uint16_t period_ms;
+    /* Size of the sub-packets of this transfer, 0 for
+     * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES. See
+     * mtk_bulk_data_collection_sub_packet_size_set(). */
+    uint16_t sub_packet_size;
+    /* Sender only: sub-packets sent back to back every period_ms, as long as
+     * the UDP queue has room. 0 or 1 sends one at a time. */
+    uint8_t tx_window;
     uint64_t mask; /* bit 1 for sub-packets to send, or received */
     uint8_t num_sub_packets;
+    uint8_t flags; /* MTK_BULK_DATA_COLLECTION_FLAG_* */
+    uint32_t content_hash; /* CRC-32 of the whole data */
+    /* With MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED: length of the data, and
+     * number of bytes sent for it */
+    uint16_t original_len;
+    uint16_t compressed_len;
+    /* Sender only: priority announced in manifests, higher first */
+    uint8_t priority;
+    /* Sender only: packet sent right after this one, for batch requests */
+    struct mtk_bulk_data_collection_packet* next;
 } mtk_bulk_data_collection_packet_t;
 
+/* Packet listed in a manifest signal */
+typedef struct
+{
+    uint16_t packet_id;
+    uint8_t n_sub_packets;
+    uint16_t len;
+    uint8_t priority;
+} mtk_bulk_data_collection_manifest_entry_t;
+
+/* Progress of a reception, for resuming it after a reboot. */
+typedef struct
+{
+    mira_net_address_t node_addr;
+    uint16_t id;
+    uint32_t content_hash;
+    uint64_t mask; /* sub-packets written to payload, or to write_callback */
+    uint16_t len;
+    uint8_t num_sub_packets;
+    uint16_t sub_packet_size;
+} mtk_bulk_data_collection_checkpoint_t;
+
+/* Called during reception, for the application to persist the checkpoint.
+ * new_mask tells the sub-packets written since the previous checkpoint. When
+ * receiving to packet->payload, the application persists these regions too, at
+ * offset index * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES. Receptions to
+ * the pool are not resumed. */
+typedef void (*mtk_bulk_data_collection_checkpoint_callback_t)(
+  const mtk_bulk_data_collection_checkpoint_t* checkpoint,
+  uint64_t new_mask,
+  const mtk_bulk_data_collection_packet_t* packet,
+  void* storage);
+
 int mtk_bulk_data_collection_init(mtk_bulk_data_collection_role_t role);
 
 /* Get the mask for requesting all sub-packets */
@@ -80,6 +265,25 @@ int mtk_bulk_data_collection_send_whole_mask_get(uint64_t* mask, const uint16_t
 /* Get number of sub-packets that make up a large packet of size n_bytes. */
 uint8_t mtk_bulk_data_collection_n_sub_packets_get(const uint16_t n_bytes);
 
+/* Split the packet, of len bytes, into sub-packets of size bytes, setting its
+ * number of sub-packets. 0 sets the default size,
+ * MTK_BULK_DATA_COLLECTION_SUBPACKET_MAX_BYTES. Fails if size is larger than
+ * the default, or too small to fit the packet in
+ * MTK_BULK_DATA_COLLECTION_MAX_NUMBER_OF_SUBPACKETS sub-packets. Both ends of
+ * a transfer must use the same size: the receiver sets it before requesting
+ * the packet, which sends it along, and the sender sets the size of each
+ * request, see event_bdc_requested, before sending. Not for delta transfers
+ * and batch requests, which use the default size. */
+int mtk_bulk_data_collection_sub_packet_size_set(mtk_bulk_data_collection_packet_t* packet,
+                                                 const uint16_t size,
+                                                 const uint16_t len);
+
+/* Choose the sub-packet size to collect a packet of len bytes from src: small
+ * sub-packets, of MTK_BULK_DATA_COLLECTION_SUBPACKET_SMALL_BYTES, if the path
+ * is lossy, see mtk_bdcest_lossy(), or else the default size. */
+uint16_t mtk_bulk_data_collection_sub_packet_size_choose(const mira_net_address_t* src,
+                                                         const uint16_t len);
+
 /* Register the data to send. Transmission occurs only when requested by a
  * receiver. */
 int mtk_bulk_data_collection_register_tx(mtk_bulk_data_collection_packet_t* packet,
@@ -87,16 +291,210 @@ int mtk_bulk_data_collection_register_tx(mtk_bulk_data_collection_packet_t* pack
                                          const uint8_t* payload,
                                          const uint16_t len);
 
-/* Send the registered large packet. */
+/* Register data to send, read on demand through read_callback instead of being
+ * held in RAM. At most 1 + MTK_BULK_DATA_COLLECTION_TX_READ_AHEAD sub-packets
+ * are buffered at a time. Transmission occurs only when requested by a
+ * receiver. Fails unless MTK_BULK_DATA_COLLECTION_TX_STREAM is set. */
+int mtk_bulk_data_collection_register_tx_stream(
+  mtk_bulk_data_collection_packet_t* packet,
+  const uint16_t packet_id,
+  mtk_bulk_data_collection_read_callback_t read_callback,
+  const uint16_t len,
+  void* storage);
+
+/* Compute the content hash of a registered packet, and set
+ * MTK_BULK_DATA_COLLECTION_FLAG_CONTENT_HASH and
+ * MTK_BULK_DATA_COLLECTION_FLAG_LENGTH, so that both are signaled. When
+ * streaming, the whole data is read through the read callback. */
+int mtk_bulk_data_collection_content_hash_compute(mtk_bulk_data_collection_packet_t* packet);
+
+/* Compress the sub-packets of a registered packet when sending them, and set
+ * MTK_BULK_DATA_COLLECTION_FLAG_COMPRESSED. Each sub-packet is compressed on
+ * its own, so that it is decoded even if others are lost, and is sent as is if
+ * it doesn't compress. The receiver copies flags, original_len and
+ * compressed_len of the signal to its packet, and gets the data decompressed.
+ * When streaming, the whole data is read through the read callback to compute
+ * compressed_len. */
+int mtk_bulk_data_collection_compression_enable(mtk_bulk_data_collection_packet_t* packet);
+
+/* Repair lost sub-packets of a multicast transfer of the registered packet
+ * with fountain coded symbols, and set MTK_BULK_DATA_COLLECTION_FLAG_FOUNTAIN.
+ * A symbol is the XOR of sub-packets lost by the receivers, see module
+ * mtk_bdc_fountain, so that each symbol may repair a different sub-packet at
+ * each receiver. Symbols are coded from payload, not for streamed or
+ * compressed packets. Receivers need payload too, not a write callback. */
+int mtk_bulk_data_collection_fountain_enable(mtk_bulk_data_collection_packet_t* packet);
+
+/* Sender side of a delta request, which comes with n_hashes hashes of the
+ * sub-packets held by the receiver (see mtk_bdc_event_requested_data_t). Call
+ * after setting packet->mask and the receiver from the request, and before
+ * mtk_bulk_data_collection_send(). Unchanged sub-packets are removed from
+ * packet->mask, and the receiver is told. Does nothing without hashes. */
+int mtk_bulk_data_collection_delta_apply(mtk_bulk_data_collection_packet_t* packet,
+                                         const uint8_t n_hashes,
+                                         const uint32_t* hashes);
+
+/* Signal to dst that the registered packet is ready for sending, including the
+ * optional information given by packet->flags. */
+int mtk_bulk_data_collection_signal(const mtk_bulk_data_collection_packet_t* packet,
+                                    const mira_net_address_t* dst);
+
+/* Signal to dst that several packets are ready for sending, in a single
+ * message. At most MTK_BULK_DATA_COLLECTION_MANIFEST_MAX_ENTRIES packets. */
+int mtk_bulk_data_collection_signal_manifest(
+  const mtk_bulk_data_collection_packet_t* const* packets,
+  const uint8_t n_packets,
+  const mira_net_address_t* dst);
+
+/* Send the registered large packet, and then the packets chained by next.
+ * Each packet is released, see event_bdc_released, once acknowledged by the
+ * receiver or after MTK_BULK_DATA_COLLECTION_TX_LINGER_MS. Sending anew
+ * releases at once the packets still kept that are not sent again. Sending a
+ * packet of a running pipeline, upon a request, does nothing, the pipeline
+ * serving the request. At most 32 packets are chained. */
 int mtk_bulk_data_collection_send(mtk_bulk_data_collection_packet_t* packet);
 
+/* Signal the registered packet to dst and send it right away, without waiting
+ * for a request. The transfer stops if the receiver rejects it, see
+ * event_bdc_rejected, or if it doesn't confirm it within
+ * MTK_BULK_DATA_COLLECTION_PUSH_WINDOW sub-packets. Further sub-packets are
+ * then sent upon request, as usual. */
+int mtk_bulk_data_collection_push(mtk_bulk_data_collection_packet_t* packet,
+                                  const mira_net_address_t* dst);
+
+/* Push the registered packet to dst, see mtk_bulk_data_collection_push(), in a
+ * pipeline of transfers. If a pipeline to dst is running, the packet is
+ * signaled at once and appended to it, and its sub-packets follow those of the
+ * packets before it, without waiting for their completion. Sub-packets NACKed
+ * or requested again by the receiver, told apart by packet id, go before those
+ * of the packets after them. Each packet is released, see event_bdc_released,
+ * once acknowledged, or rejected, by the receiver, or after
+ * MTK_BULK_DATA_COLLECTION_TX_LINGER_MS without any packet to send. Packets
+ * are not held back until confirmed. At most
+ * MTK_BULK_DATA_COLLECTION_PIPELINE_DEPTH packets, including those not yet
+ * released. The receiver takes each with
+ * mtk_bulk_data_collection_receive_start(), and needs two sessions or more to
+ * take a packet before the previous one is complete. packet->next must be
+ * NULL. */
+int mtk_bulk_data_collection_pipeline(mtk_bulk_data_collection_packet_t* packet,
+                                      const mira_net_address_t* dst);
+
+/* Signal the registered packet to the multicast group joined with
+ * mtk_bdcmc_init(), and send each sub-packet once to the group, every
+ * period_ms (default MTK_BULK_DATA_COLLECTION_PUSH_PERIOD_MS). Receivers NACK
+ * the sub-packets they miss to the group. Their NACKs are merged into repair
+ * rounds, at most MTK_BULK_DATA_COLLECTION_MULTICAST_MAX_ROUNDS, until no
+ * receiver NACKs. The packet is then released, see event_bdc_released.
+ * packet->next must be NULL. */
+int mtk_bulk_data_collection_multicast(mtk_bulk_data_collection_packet_t* packet);
+
+/* Stop the running transmission between two sub-packets, for a more urgent
+ * one. The packets being sent keep the sub-packets left to send in mask, to
+ * be sent later on, and are not released. Fails if not sending, including
+ * while sent packets are only kept for late requests. */
+int mtk_bulk_data_collection_stop(void);
+
 /* Request sub-packets from dst, only the sub-packets defined by sub_packet_mask
  * bit at 1. */
 int mtk_bulk_data_collection_request(const mira_net_address_t* dst,
                                      const uint64_t sub_packet_mask,
                                      const uint16_t sub_packet_period_ms);
 
-/* Start this process upon sending requests, to handle reception. */
+/* Receive to write_callback instead of to packet->payload. Data is written in
+ * order, at most MTK_BULK_DATA_COLLECTION_RX_REORDER_WINDOW sub-packets are
+ * held in blocks of the receive buffer pool at a time. Call before starting the
+ * reception. */
+int mtk_bulk_data_collection_register_rx_sink(
+  mtk_bulk_data_collection_packet_t* packet,
+  mtk_bulk_data_collection_write_callback_t write_callback,
+  void* storage);
+
+/* Receive to blocks of the receive buffer pool, see module mtk_bdc_pool,
+ * instead of to packet->payload. A block is taken as each sub-packet arrives,
+ * so that RAM is used by the data in flight rather than by whole packets.
+ * Sub-packets arriving while all blocks are in use are dropped, and requested
+ * again. Upon event_bdc_received, the blocks are handed to the application,
+ * which reads them with mtk_bulk_data_collection_pooled_get(), and releases
+ * them with mtk_bulk_data_collection_pooled_release(). They are released at
+ * once if the reception fails. Fails if the packet still holds blocks. Not for
+ * delta, resumed or fountain coded receptions. Call before starting the
+ * reception. */
+int mtk_bulk_data_collection_register_rx_pool(mtk_bulk_data_collection_packet_t* packet);
+
+/* Get sub-packet index of a packet received to the pool, and its length in
+ * len. Returns NULL if the packet holds no block for it. */
+const uint8_t* mtk_bulk_data_collection_pooled_get(const mtk_bulk_data_collection_packet_t* packet,
+                                                   const uint8_t index,
+                                                   uint16_t* len);
+
+/* Add a holder of the blocks of a packet received to the pool, such as a
+ * process forwarding it. Each holder releases them. */
+void mtk_bulk_data_collection_pooled_hold(const mtk_bulk_data_collection_packet_t* packet);
+
+/* Release the blocks of a packet received to the pool. They are freed once all
+ * holders have released them, after which the packet may be received anew. */
+void mtk_bulk_data_collection_pooled_release(const mtk_bulk_data_collection_packet_t* packet);
+
+/* Call callback during reception, each time interval sub-packets have been
+ * written since the previous checkpoint, and when reception is aborted. NULL
+ * disables checkpoints. */
+int mtk_bulk_data_collection_checkpoint_register(
+  mtk_bulk_data_collection_checkpoint_callback_t callback,
+  uint8_t interval,
+  void* storage);
+
+/* Check if a packet signaled with a content hash and length len was received
+ * recently, from any sender. If so, acknowledge it to the sender in place of
+ * requesting it, see event_bdc_acked, and return true. The packet is set up as
+ * for a new reception, from the signal. The last
+ * MTK_BULK_DATA_COLLECTION_DEDUP_CACHE_SIZE packets received with a content
+ * hash are remembered. */
+bool mtk_bulk_data_collection_dedup(const mtk_bulk_data_collection_packet_t* packet,
+                                    const uint16_t len);
+
+/* Request a packet of which payload holds a previous version, of previous_len
+ * bytes. The packet is set up as for a new reception, from a signal of the
+ * sender. Only sub-packets that differ from the previous version are sent, the
+ * others are kept as they are in payload, see
+ * mtk_bulk_data_collection_receive_start(). */
+int mtk_bulk_data_collection_delta_request(mtk_bulk_data_collection_packet_t* packet,
+                                           const uint16_t previous_len);
+
+/* Resume a reception from a checkpoint. The packet is set up as for a new
+ * reception, from a signal of the sender, with payload holding the data of the
+ * checkpoint, if not receiving to a write callback. The sender, packet id and
+ * content hash must match the checkpoint. Only the missing sub-packets are
+ * requested, see mtk_bulk_data_collection_collect(). */
+int mtk_bulk_data_collection_resume(mtk_bulk_data_collection_packet_t* packet,
+                                    const mtk_bulk_data_collection_checkpoint_t* checkpoint);
+
+/* Receive a packet, of which the sub-packets set in packet->mask are already
+ * held. Call right after requesting the others, or upon the signal of a pushed
+ * packet, which is confirmed to the sender, or of a multicast packet, of which
+ * the missing sub-packets are then NACKed to the group. Fails if
+ * MTK_BULK_DATA_COLLECTION_RX_MAX_SESSIONS packets are already being received.
+ * A reception of the same packet, or of the same packet id from the same
+ * sender, is replaced. A replaced packet ends with event_bdc_receive_failed. */
+int mtk_bulk_data_collection_receive_start(mtk_bulk_data_collection_packet_t* packet);
+
+/* Request the sub-packets missing in packet->mask from the sender, and receive
+ * them, see mtk_bulk_data_collection_receive_start(). The packet is set up as
+ * for a new reception, from a signal of the sender. */
+int mtk_bulk_data_collection_collect(mtk_bulk_data_collection_packet_t* packet);
+
+/* Request several packets from the same sender in a single request, sent back
+ * to back, and receive them, see mtk_bulk_data_collection_collect(). Every
+ * packet but the first is requested whole. At most
+ * MTK_BULK_DATA_COLLECTION_BATCH_MAX_PACKETS + 1 packets, and as many
+ * receptions must be available. */
+int mtk_bulk_data_collection_collect_batch(mtk_bulk_data_collection_packet_t* const* packets,
+                                           const uint8_t n_packets);
+
+/* Handles receptions, started by mtk_bulk_data_collection_receive_start().
+ * Starting it with a packet as data does the same, if not already running. Posts
+ * event_bdc_received with the packet as data, once all sub-packets are
+ * received, and their content hash checked if the packet has one. Posts
+ * event_bdc_receive_failed otherwise. */
 PROCESS_NAME(mtk_bulk_data_collection_receive_proc);
 
 #endif